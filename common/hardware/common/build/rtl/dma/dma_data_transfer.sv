@@ -838,7 +838,9 @@ module dma_data_transfer #(
     
     always_comb begin
         dst_avmm_int.write      = wr_state_cur_is_write | wr_state_cur_is_write_magic_num;
-        dst_avmm_int.writedata  = wr_state_cur_is_write_magic_num ? MAGIC_NUMBER : databuffer_q;
+        dst_avmm_int.writedata  = !wr_state_cur_is_write_magic_num      ? databuffer_q :
+                                  disp_ctrl_if.magic_number_is_count ? {48'h0, magic_number_counter + 16'h1} :
+                                                                       MAGIC_NUMBER;
         dst_avmm_int.byteenable = dst_avmm_byteenable;
         dst_avmm_int.address    = dst_avmm_address;
         dst_avmm_int.burstcount = this_write_is_partial ? 'h1 : dst_avmm_burstcount;
@@ -14,6 +14,7 @@ import ofs_asp_pkg::*;
     
     output logic host_mem_rd_xfer_done,
     output logic host_mem_wr_xfer_done,
+    output logic local_mem_copy_xfer_done,
 
     //Avalon mem if - mmio64
     ofs_plat_avalon_mem_if.to_source mmio64_if,
@@ -22,7 +23,10 @@ import ofs_asp_pkg::*;
     dma_ctrl_intf.disp rd_ctrl [NUM_DMA_CHAN-1:0],
     
     //dispatcher-to-controller if - FPGA-to-host (write)
-    dma_ctrl_intf.disp wr_ctrl [NUM_DMA_CHAN-1:0]
+    dma_ctrl_intf.disp wr_ctrl [NUM_DMA_CHAN-1:0],
+    
+    //dispatcher-to-controller if - device-to-device copy
+    dma_ctrl_intf.disp copy_ctrl
 );
 
     localparam reg_width = MMIO64_DATA_WIDTH;
@@ -43,6 +47,11 @@ import ofs_asp_pkg::*;
     logic [NUM_DMA_CHAN_BITS-1:0] rd_ctrl_chan_cntr, wr_ctrl_chan_cntr;
     logic [NUM_DMA_CHAN-1:0] rd_rxd_irq, rd_wait_irq, wr_rxd_irq, wr_wait_irq;
     logic rd_ctrl_only_ch0_cmd, wr_ctrl_only_ch0_cmd;
+    logic [reg_width-1:0] rd_ctrl_done_cntr, wr_ctrl_done_cntr;
+    logic wr_ctrl_magic_num_is_count;
+    logic [reg_width-1:0] copy_ctrl_cmd_src_start_addr, copy_ctrl_cmd_dst_start_addr, copy_ctrl_cmd_xfer_length;
+    logic copy_ctrl_new_cmd, copy_ctrl_sclr, copy_ctrl_clear_irq;
+    logic [reg_width-1:0] copy_ctrl_done_cntr;
 
     
     //pipeline and duplicate the reset signal
@@ -75,6 +84,9 @@ import ofs_asp_pkg::*;
         wr_ctrl_new_cmd <= 1'b0;
         wr_ctrl_sclr <= 'b0;
         wr_ctrl_clear_irq <= 'b0;
+        copy_ctrl_new_cmd <= 1'b0;
+        copy_ctrl_sclr <= 'b0;
+        copy_ctrl_clear_irq <= 'b0;
         if (mmio64_if.write)
         begin
             case (this_address)
@@ -107,15 +119,32 @@ import ofs_asp_pkg::*;
                 begin
                     wr_ctrl_sclr        <= mmio64_if.writedata[CONFIG_REG_SCLR_BIT];
                     wr_ctrl_clear_irq   <= mmio64_if.writedata[CONFIG_REG_CLEAR_IRQ_BIT];
+                    wr_ctrl_magic_num_is_count <= mmio64_if.writedata[CONFIG_REG_MAGIC_NUM_IS_COUNT_BIT];
+                end
+                
+                //device-to-device copy channel
+                DEV_COPY_START_SRC_ADDR: copy_ctrl_cmd_src_start_addr <= mmio64_if.writedata;
+                DEV_COPY_START_DST_ADDR: copy_ctrl_cmd_dst_start_addr <= mmio64_if.writedata;
+                DEV_COPY_TRANSFER_LENGTH_ADDR: 
+                begin
+                    copy_ctrl_cmd_xfer_length <= mmio64_if.writedata;
+                    copy_ctrl_new_cmd         <= mmio64_if.writedata > 'h0 ? 1'b1 : 1'b0;
+                end
+                DEV_COPY_CONFIG_ADDR:
+                begin
+                    copy_ctrl_sclr      <= mmio64_if.writedata[CONFIG_REG_SCLR_BIT];
+                    copy_ctrl_clear_irq <= mmio64_if.writedata[CONFIG_REG_CLEAR_IRQ_BIT];
                 end
             endcase
         end
     
         if (rst_local) begin
             wr_ctrl_host_mem_magicnumber_addr <= 'h0;
+            wr_ctrl_magic_num_is_count <= 'b0;
             scratchpad_reg <= 'b0;
             rd_ctrl_new_cmd <= 'b0;
             wr_ctrl_new_cmd <= 'b0;
+            copy_ctrl_new_cmd <= 'b0;
         end
     end
     
@@ -136,6 +165,10 @@ import ofs_asp_pkg::*;
                 SCRATCHPAD_ADDR:                mmio64_if.readdata <= scratchpad_reg;
                 MAGICNUMBER_HOSTMEM_WR_ADDR:    mmio64_if.readdata <= wr_ctrl_host_mem_magicnumber_addr;
                 NUM_DMA_CHAN_ADDR:              mmio64_if.readdata <= NUM_DMA_CHAN;
+                HOST_RD_DONE_CNT_ADDR:          mmio64_if.readdata <= rd_ctrl_done_cntr;
+                HOST_WR_DONE_CNT_ADDR:          mmio64_if.readdata <= wr_ctrl_done_cntr;
+                DEV_COPY_DONE_CNT_ADDR:         mmio64_if.readdata <= DEV_COPY_ENABLE ? copy_ctrl_done_cntr : REG_RD_BADADDR_DATA;
+                HOST_WR_MAGIC_CNT_ADDR:         mmio64_if.readdata <= {{(reg_width-16){1'b0}}, wr_ctrl[0].magic_number_counter};
                 //host-to-FPGA transfers (read)
                 HOST_RD_START_SRC_ADDR:         mmio64_if.readdata <= rd_ctrl_cmd_src_start_addr;
                 HOST_RD_START_DST_ADDR:         mmio64_if.readdata <= rd_ctrl_cmd_dst_start_addr;
@@ -170,6 +203,10 @@ import ofs_asp_pkg::*;
                 //HOST_WR_THIS_CHAN_DST_ADDR:     mmio64_if.readdata <= wr_ctrl[wr_ctrl_chan_cntr].cmd.dst_start_addr;
                 //HOST_WR_THIS_CHAN_XFER_LEN_ADDR: mmio64_if.readdata <= wr_ctrl[wr_ctrl_chan_cntr].cmd.xfer_length;
                 //HOST_WR_THIS_CHAN_NUM_ADDR:     mmio64_if.readdata <= wr_ctrl_chan_cntr;
+                //device-to-device copies
+                DEV_COPY_START_SRC_ADDR:        mmio64_if.readdata <= copy_ctrl_cmd_src_start_addr;
+                DEV_COPY_START_DST_ADDR:        mmio64_if.readdata <= copy_ctrl_cmd_dst_start_addr;
+                DEV_COPY_TRANSFER_LENGTH_ADDR:  mmio64_if.readdata <= copy_ctrl_cmd_xfer_length;
 
                 default:                        mmio64_if.readdata <= REG_RD_BADADDR_DATA;
             endcase
@@ -205,6 +242,42 @@ import ofs_asp_pkg::*;
             wr_ctrl_chan_cntr <= 'b0;
     end
     
+    //count the completed commands in each direction so the host can keep several
+    //commands queued and still tell which of them are done.
+    always_ff @(posedge clk) begin
+        if (host_mem_rd_xfer_done)
+            rd_ctrl_done_cntr <= rd_ctrl_done_cntr + 1'b1;
+        if (host_mem_wr_xfer_done)
+            wr_ctrl_done_cntr <= wr_ctrl_done_cntr + 1'b1;
+        if (local_mem_copy_xfer_done)
+            copy_ctrl_done_cntr <= copy_ctrl_done_cntr + 1'b1;
+        if (rst_local) begin
+            rd_ctrl_done_cntr <= 'b0;
+            wr_ctrl_done_cntr <= 'b0;
+            copy_ctrl_done_cntr <= 'b0;
+        end
+    end
+    
+    //device-to-device copies run on a single data-transfer block whatever the number of
+    //DMA channels, so each command is passed along whole and its irq is the 'done' signal.
+    always_comb begin
+        copy_ctrl.sclr                      = copy_ctrl_sclr;
+        copy_ctrl.clear_irq                 = copy_ctrl_clear_irq;
+        copy_ctrl.host_mem_magicnumber_addr = 'b0;
+        copy_ctrl.magic_number_is_count     = 'b0;
+    end
+    always_ff @(posedge clk) begin
+        copy_ctrl.cmd.src_start_addr <= copy_ctrl_cmd_src_start_addr;
+        copy_ctrl.cmd.dst_start_addr <= copy_ctrl_cmd_dst_start_addr;
+        copy_ctrl.cmd.xfer_length    <= copy_ctrl_cmd_xfer_length;
+        copy_ctrl.new_cmd            <= copy_ctrl_new_cmd;
+        local_mem_copy_xfer_done     <= copy_ctrl.irq_pulse;
+        if (rst_local) begin
+            copy_ctrl.new_cmd        <= 'b0;
+            local_mem_copy_xfer_done <= 'b0;
+        end
+    end
+    
     //support multiple DMA channels, spread transfers across multiple channels
     genvar d;
     generate
@@ -213,6 +286,8 @@ import ofs_asp_pkg::*;
                 rd_ctrl[d].sclr                      = rd_ctrl_sclr;
                 rd_ctrl[d].clear_irq                 = rd_ctrl_clear_irq;
                 wr_ctrl[d].host_mem_magicnumber_addr = wr_ctrl_host_mem_magicnumber_addr;
+                wr_ctrl[d].magic_number_is_count     = wr_ctrl_magic_num_is_count;
+                rd_ctrl[d].magic_number_is_count     = 'b0;
                 wr_ctrl[d].sclr                      = wr_ctrl_sclr;
                 wr_ctrl[d].clear_irq                 = wr_ctrl_clear_irq;
             end
@@ -22,6 +22,7 @@ interface dma_ctrl_intf #(
     logic irq_pulse;
     logic clear_irq;
     logic [REGISTER_WIDTH-1:0] host_mem_magicnumber_addr;
+    logic magic_number_is_count;
     logic f2h_wr_fence_flag;
     logic [REGISTER_WIDTH-1:0] src_readdatavalid_counter, src_burst_cnt_counter, dst_write_counter;
     logic [15:0] magic_number_counter;
@@ -67,13 +68,13 @@ interface dma_ctrl_intf #(
                 dst_write_counter, magic_number_counter,
                 f2h_wait_for_magic_num_wr_pulse,
         output  cmd, new_cmd, sclr, clear_irq,
-                host_mem_magicnumber_addr
+                host_mem_magicnumber_addr, magic_number_is_count
     );
     
     //controller
     modport ctrl (
         input   cmd, new_cmd, sclr, clear_irq,
-                host_mem_magicnumber_addr, 
+                host_mem_magicnumber_addr, magic_number_is_count,
         output  controller_busy_rd, controller_busy_wr,
                 cmdq_status, databuf_status, irq, irq_pulse,
                 f2h_wr_fence_flag, cntrl_sts, src_burst_cnt_counter, 
@@ -0,0 +1,176 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+//
+
+`include "ofs_plat_if.vh"
+
+/*
+Share one local-memory AVMM port between two DMA data-transfer blocks - the
+host-memory transfer of a channel (in0) and the device-copy transfer (in1).
+ The high-level functional description is:
+    - the port is granted at burst boundaries; when both sides request, the grant
+      alternates so neither side can starve the other.
+    - a command that is held off by waitrequest keeps the grant, as does a write burst
+      until its last beat is accepted, so the sink never sees a command change or two
+      write bursts interleave.
+    - the memory returns read data in order; every accepted read pushes its requester
+      and burstcount into a FIFO, and the readdatavalid beats are steered back to the
+      requester at the head of that FIFO.
+    - reads are held off while the FIFO is nearly full.
+    - write responses are not forwarded, neither side uses them.
+ Only instantiated with DEV_COPY_ENABLE. common/source/util/dma_arb_model is a cycle model
+ of this module and of the copy traffic through it.
+*/
+
+module dma_local_mem_arb
+import dma_pkg::*;
+(
+    input clk,
+    input reset,
+
+    //host-memory transfer side
+    ofs_plat_avalon_mem_if.to_source in0_avmm,
+
+    //device-copy side
+    ofs_plat_avalon_mem_if.to_source in1_avmm,
+
+    //local memory
+    ofs_plat_avalon_mem_if.to_sink out_avmm
+);
+
+    localparam RSPQ_DATA_WIDTH = 1 + AVMM_BURSTCOUNT_BITS;
+
+    logic req0, req1;
+    logic grant, grant_q, hold_q;
+    logic [AVMM_BURSTCOUNT_BITS-1:0] wr_beats_left, wr_beats_left_nxt;
+    logic rspq_almost_full, rspq_empty, rspq_rdreq;
+    logic [RSPQ_DATA_WIDTH-1:0] rspq_q;
+    logic rspq_head_owner;
+    logic [AVMM_BURSTCOUNT_BITS-1:0] rspq_head_burstcount, rd_beats_returned;
+
+    //pipeline and duplicate the reset signal
+    localparam RESET_PIPE_DEPTH = 2;
+    logic [RESET_PIPE_DEPTH-1:0] rst_pipe;
+    logic rst_local;
+    always_ff @(posedge clk) begin
+        {rst_local,rst_pipe}  <= {rst_pipe[RESET_PIPE_DEPTH-1:0], 1'b0};
+        if (reset) begin
+            rst_local <= '1;
+            rst_pipe  <= '1;
+        end
+    end
+
+    assign req0 = in0_avmm.read | in0_avmm.write;
+    assign req1 = in1_avmm.read | in1_avmm.write;
+
+    //grant: 0 for in0, 1 for in1
+    always_comb begin
+        if (hold_q)
+            grant = grant_q;
+        else if (req0 & req1)
+            grant = !grant_q;
+        else
+            grant = req1;
+    end
+
+    //drive the granted command; hold reads back while the response FIFO can't take another burst
+    always_comb begin
+        out_avmm.address    = grant ? in1_avmm.address    : in0_avmm.address;
+        out_avmm.burstcount = grant ? in1_avmm.burstcount : in0_avmm.burstcount;
+        out_avmm.writedata  = grant ? in1_avmm.writedata  : in0_avmm.writedata;
+        out_avmm.byteenable = grant ? in1_avmm.byteenable : in0_avmm.byteenable;
+        out_avmm.write      = grant ? in1_avmm.write      : in0_avmm.write;
+        out_avmm.read       = (grant ? in1_avmm.read      : in0_avmm.read) & !rspq_almost_full;
+        out_avmm.user       = 'b0;
+
+        in0_avmm.waitrequest = grant  | out_avmm.waitrequest | (in0_avmm.read & rspq_almost_full);
+        in1_avmm.waitrequest = !grant | out_avmm.waitrequest | (in1_avmm.read & rspq_almost_full);
+    end
+
+    //count the beats of the current write burst; the burstcount is only valid on the first beat
+    always_comb begin
+        wr_beats_left_nxt = wr_beats_left;
+        if (out_avmm.write && !out_avmm.waitrequest)
+            wr_beats_left_nxt = |wr_beats_left ? wr_beats_left - 1'b1 : out_avmm.burstcount - 1'b1;
+    end
+
+    always_ff @(posedge clk) begin
+        wr_beats_left <= wr_beats_left_nxt;
+        grant_q <= grant;
+        //keep the grant for a command still waiting on the sink, or for the rest of a write burst
+        hold_q  <= ((out_avmm.read | out_avmm.write) & out_avmm.waitrequest) | (|wr_beats_left_nxt);
+        if (rst_local) begin
+            wr_beats_left <= 'b0;
+            grant_q <= 'b0;
+            hold_q  <= 'b0;
+        end
+    end
+
+    //
+    // read responses - remember who issued each accepted read burst
+    //
+    scfifo
+    #(
+`ifdef PLATFORM_INTENDED_DEVICE_FAMILY
+        .intended_device_family(`PLATFORM_INTENDED_DEVICE_FAMILY),
+`endif
+        .lpm_numwords(LOCAL_MEM_ARB_RSPQ_DEPTH),
+        .lpm_showahead("ON"),
+        .lpm_type("scfifo"),
+        .lpm_width(RSPQ_DATA_WIDTH),
+        .lpm_widthu($clog2(LOCAL_MEM_ARB_RSPQ_DEPTH)),
+        .almost_full_value(LOCAL_MEM_ARB_RSPQ_DEPTH - 'h2),
+        .overflow_checking("OFF"),
+        .underflow_checking("OFF"),
+        //small and read back within a few clocks of the write, keep it out of block RAM
+        .use_eab("OFF"),
+        .add_ram_output_register("OFF")
+    ) rsp_queue (
+        .clock          (clk),
+        .sclr           (rst_local),
+        .data           ({grant, out_avmm.burstcount}),
+        .wrreq          (out_avmm.read & !out_avmm.waitrequest),
+        .rdreq          (rspq_rdreq),
+        .q              (rspq_q),
+        .empty          (rspq_empty),
+        .almost_full    (rspq_almost_full),
+        .aclr           (1'b0),
+        .full           (),
+        .usedw          (),
+        .almost_empty   (),
+        .eccstatus      ()
+    );
+    assign {rspq_head_owner, rspq_head_burstcount} = rspq_q;
+
+    //pop the head entry with the last beat of its burst
+    assign rspq_rdreq = out_avmm.readdatavalid && (rd_beats_returned + 1'b1 == rspq_head_burstcount);
+    always_ff @(posedge clk) begin
+        if (rspq_rdreq)
+            rd_beats_returned <= 'b0;
+        else if (out_avmm.readdatavalid)
+            rd_beats_returned <= rd_beats_returned + 1'b1;
+        if (rst_local)
+            rd_beats_returned <= 'b0;
+    end
+
+    always_comb begin
+        in0_avmm.readdata      = out_avmm.readdata;
+        in1_avmm.readdata      = out_avmm.readdata;
+        in0_avmm.readdatavalid = out_avmm.readdatavalid & !rspq_head_owner;
+        in1_avmm.readdatavalid = out_avmm.readdatavalid &  rspq_head_owner;
+        in0_avmm.response          = out_avmm.response;
+        in1_avmm.response          = out_avmm.response;
+        in0_avmm.readresponseuser  = out_avmm.readresponseuser;
+        in1_avmm.readresponseuser  = out_avmm.readresponseuser;
+
+        //the data-transfer blocks post their writes and never look at write responses, so
+        //none are steered back
+        in0_avmm.writeresponsevalid = 'b0;
+        in1_avmm.writeresponsevalid = 'b0;
+        in0_avmm.writeresponse      = 'b0;
+        in1_avmm.writeresponse      = 'b0;
+        in0_avmm.writeresponseuser  = 'b0;
+        in1_avmm.writeresponseuser  = 'b0;
+    end
+
+endmodule : dma_local_mem_arb
@@ -22,6 +22,11 @@ package dma_pkg;
 
 	parameter DO_F2H_MAGIC_NUMBER_WRITE = 1;
 
+	//device-to-device copy block sharing the local-memory ports of channel 0. Off by default,
+	//the host transfers then own those ports alone and DEV_COPY_DONE_CNT_ADDR reads back as
+	//REG_RD_BADADDR_DATA, so the mmd copies through host memory.
+	parameter DEV_COPY_ENABLE = 0;
+
     parameter DFH_NEXT_AFU_OFFSET = 24'h01_0000;
 	
 	parameter NUM_DMA_CHAN_BITS = $clog2(ofs_asp_pkg::NUM_DMA_CHAN);
@@ -67,10 +72,23 @@ package dma_pkg;
     parameter SCRATCHPAD_ADDR               = REG_ASP_GEN_BASE_ADDR + 'h05;
     parameter MAGICNUMBER_HOSTMEM_WR_ADDR   = REG_ASP_GEN_BASE_ADDR + 'h06;
 	parameter NUM_DMA_CHAN_ADDR				= REG_ASP_GEN_BASE_ADDR + 'h07;
+    //number of commands completed since reset, per direction; lets the host keep
+    //several commands in flight and tell how many of them have finished.
+    parameter HOST_RD_DONE_CNT_ADDR         = REG_ASP_GEN_BASE_ADDR + 'h08;
+    parameter HOST_WR_DONE_CNT_ADDR         = REG_ASP_GEN_BASE_ADDR + 'h09;
+    //same for device-to-device copies; older bitstreams return REG_RD_BADADDR_DATA here,
+    //which is how the mmd tells whether the copy channel exists.
+    parameter DEV_COPY_DONE_CNT_ADDR        = REG_ASP_GEN_BASE_ADDR + 'h0A;
+    //count carried by the F2H magic-number write when CONFIG_REG_MAGIC_NUM_IS_COUNT_BIT is set,
+    //read from channel 0 which is the only channel writing it. Reset along with that channel
+    //(reset or sclr), so the host seeds its expected value from here and not from the done count.
+    parameter HOST_WR_MAGIC_CNT_ADDR        = REG_ASP_GEN_BASE_ADDR + 'h0B;
     
     //general data-transfer control registers
     parameter REG_HOSTRD_BASE_ADDR          = 'h10;
     parameter REG_HOSTWR_BASE_ADDR          = 'h20;
+    //local-memory to local-memory copies
+    parameter REG_DEVCOPY_BASE_ADDR         = 'h30;
     //specific register offsets (common between host-mem read and write controllers)
     parameter REG_START_SRC_ADDR_OFFSET     = 'h00;
     parameter REG_START_DST_ADDR_OFFSET     = 'h01;
@@ -128,6 +146,11 @@ package dma_pkg;
 	parameter HOST_WR_THIS_CHAN_XFER_LEN_ADDR = REG_HOSTWR_BASE_ADDR + REG_THIS_CHAN_XFER_LEN_ADDR_OFFSET;
 	parameter HOST_WR_THIS_CHAN_NUM_ADDR    = REG_HOSTWR_BASE_ADDR + REG_THIS_CHAN_NUM_ADDR_OFFSET;
 	parameter HOST_WR_LAST_REG_ADDR         = REG_HOSTWR_BASE_ADDR + LAST_PER_CHAN_REG_ADDR_OFFSET;
+    //device-to-device copies (local memory read, local memory write)
+    parameter DEV_COPY_START_SRC_ADDR       = REG_DEVCOPY_BASE_ADDR + REG_START_SRC_ADDR_OFFSET ;
+    parameter DEV_COPY_START_DST_ADDR       = REG_DEVCOPY_BASE_ADDR + REG_START_DST_ADDR_OFFSET ;
+    parameter DEV_COPY_TRANSFER_LENGTH_ADDR = REG_DEVCOPY_BASE_ADDR + REG_TRANSFER_LENGTH_OFFSET;
+    parameter DEV_COPY_CONFIG_ADDR          = REG_DEVCOPY_BASE_ADDR + REG_CONFIG_OFFSET         ;
 
     //data to return on a read that ends up in the default case
     parameter REG_RD_BADADDR_DATA = 64'h0BAD_0ADD_0BAD_0ADD;
@@ -143,6 +166,9 @@ package dma_pkg;
     parameter HOST_MEM_RD_BURSTCOUNT_MAX = 'h4;
     parameter HOST_MEM_WR_BURSTCOUNT_MAX = 'h4;
     
+    //outstanding read bursts tracked by the local-memory port arbiter
+    parameter LOCAL_MEM_ARB_RSPQ_DEPTH = 128;
+    
     //dispatcher register bit locations - status register
     parameter STATUS_REG_RD_BUSY_BIT = 0;
     parameter STATUS_REG_WR_BUSY_BIT = 1;
@@ -151,5 +177,7 @@ package dma_pkg;
     //dispatcher register bit locations - config register
     parameter CONFIG_REG_SCLR_BIT       = 0;
     parameter CONFIG_REG_CLEAR_IRQ_BIT  = 1;
+    //F2H only: write the (16-bit) completed-command count instead of MAGIC_NUMBER
+    parameter CONFIG_REG_MAGIC_NUM_IS_COUNT_BIT = 2;
     
 endpackage : dma_pkg
@@ -11,6 +11,9 @@ This is the top-level of the DMA controller.
     - Single dispatch/register/CSR module. Registers contain information for mmd describing
       what is instantiated (number of channels, more?)
     - generate loop for each instance of transfer channels
+    - optionally (DEV_COPY_ENABLE) a device-to-device copy block (local memory read, local
+      memory write) that shares the local-memory ports of DMA channel 0 with the host
+      transfers of that channel
 */
 
 module dma_top
@@ -45,8 +48,13 @@ dma_ctrl_intf
       .SRC_ADDR_WIDTH(DEVICE_MEM_ADDR_WIDTH),
       .DST_ADDR_WIDTH(HOST_MEM_ADDR_WIDTH) )
     wr_ctrl [NUM_DMA_CHAN-1:0] ();
+dma_ctrl_intf 
+    #(.DMA_DIR("D2D"),
+      .SRC_ADDR_WIDTH(DEVICE_MEM_ADDR_WIDTH),
+      .DST_ADDR_WIDTH(DEVICE_MEM_ADDR_WIDTH) )
+    copy_ctrl ();
 
-logic host_mem_rd_xfer_done, host_mem_wr_xfer_done;
+logic host_mem_rd_xfer_done, host_mem_wr_xfer_done, local_mem_copy_xfer_done;
 
 //pipeline and duplicate the reset signal
 parameter RESET_PIPE_DEPTH = 4;
@@ -66,12 +74,15 @@ dma_dispatcher dma_dispatcher_inst (
     .reset (rst_local),
 	.host_mem_rd_xfer_done,
 	.host_mem_wr_xfer_done,
+	.local_mem_copy_xfer_done,
     //Avalon mem if - mmio64
     .mmio64_if,
     //dispatcher-to-controller if - host-to-FPGA (read)
     .rd_ctrl,
     //dispatcher-to-controller if - FPGA-to-host (write)
-    .wr_ctrl
+    .wr_ctrl,
+    //dispatcher-to-controller if - device-to-device copy
+    .copy_ctrl
 );
 
 assign dma_irq_host2fpga = host_mem_rd_xfer_done;
@@ -82,6 +93,22 @@ genvar d;
 generate
 	for (d=0; d < NUM_DMA_CHAN; d=d+1) begin : dma_channels
 
+		//local-memory ports of the host transfers; with DEV_COPY_ENABLE they are shared on
+		//channel 0 with the device-to-device copy block below, elsewhere they connect
+		//straight through.
+		ofs_plat_avalon_mem_if
+		#(
+			.ADDR_WIDTH(DEVICE_MEM_ADDR_WIDTH),
+			.DATA_WIDTH(AVMM_DATA_WIDTH),
+			.BURST_CNT_WIDTH(AVMM_BURSTCOUNT_BITS)
+		) f2h_local_mem_rd_avmm();
+		ofs_plat_avalon_mem_if
+		#(
+			.ADDR_WIDTH(DEVICE_MEM_ADDR_WIDTH),
+			.DATA_WIDTH(AVMM_DATA_WIDTH),
+			.BURST_CNT_WIDTH(AVMM_BURSTCOUNT_BITS)
+		) h2f_local_mem_wr_avmm();
+
 		//data transfer - host memory reads
 		// read from host memory, write to local memory
 		dma_data_transfer #(
@@ -103,7 +130,7 @@ generate
 			//data-source AVMM
 			.src_avmm (host_mem_rd_avmm_if[d]),
 			//data-destination AVMM
-			.dst_avmm (local_mem_wr_avmm_if[d])
+			.dst_avmm (h2f_local_mem_wr_avmm)
 		);
 		
 		//data transfer - host memory writes
@@ -125,11 +152,95 @@ generate
 			//(magic-number) for completion notification to mmd
 			.all_transfers_complete (host_mem_wr_xfer_done),
 			//data-source AVMM
-			.src_avmm (local_mem_rd_avmm_if[d]),
+			.src_avmm (f2h_local_mem_rd_avmm),
 			//data-destination AVMM
 			.dst_avmm (host_mem_wr_avmm_if[d])
 		);
+
+		if ((d == 0) && DEV_COPY_ENABLE) begin : dev_copy
+			ofs_plat_avalon_mem_if
+			#(
+				.ADDR_WIDTH(DEVICE_MEM_ADDR_WIDTH),
+				.DATA_WIDTH(AVMM_DATA_WIDTH),
+				.BURST_CNT_WIDTH(AVMM_BURSTCOUNT_BITS)
+			) copy_local_mem_rd_avmm();
+			ofs_plat_avalon_mem_if
+			#(
+				.ADDR_WIDTH(DEVICE_MEM_ADDR_WIDTH),
+				.DATA_WIDTH(AVMM_DATA_WIDTH),
+				.BURST_CNT_WIDTH(AVMM_BURSTCOUNT_BITS)
+			) copy_local_mem_wr_avmm();
+
+			//data transfer - device-to-device copies
+			// read from local memory, write to local memory. Addresses and lengths
+			// must be 64-byte aligned, the mmd falls back to copying through host
+			// memory otherwise.
+			dma_data_transfer #(
+				.SRC_RD_BURSTCOUNT_MAX  (LOCAL_MEM_RD_BURSTCOUNT_MAX),
+				.DST_WR_BURSTCOUNT_MAX  (LOCAL_MEM_WR_BURSTCOUNT_MAX),
+				.SRC_ADDR_WIDTH         (DEVICE_MEM_ADDR_WIDTH),
+				.DST_ADDR_WIDTH         (DEVICE_MEM_ADDR_WIDTH),
+				.XFER_LENGTH_WIDTH      (XFER_SIZE_WIDTH),
+				.DIR_FPGA_TO_HOST       (1'b0),
+				.DMA_CHANNEL_NUM        (d)
+			) dma_data_transfer_dev_copy_inst (
+				.clk,
+				.reset (rst_local),
+				//CSR interface to Dispatcher
+				.disp_ctrl_if (copy_ctrl),
+				//no magic-number write for copies
+				.all_transfers_complete (local_mem_copy_xfer_done),
+				//data-source AVMM
+				.src_avmm (copy_local_mem_rd_avmm),
+				//data-destination AVMM
+				.dst_avmm (copy_local_mem_wr_avmm)
+			);
+
+			dma_local_mem_arb local_mem_rd_arb_inst (
+				.clk,
+				.reset (rst_local),
+				.in0_avmm (f2h_local_mem_rd_avmm),
+				.in1_avmm (copy_local_mem_rd_avmm),
+				.out_avmm (local_mem_rd_avmm_if[d])
+			);
+			dma_local_mem_arb local_mem_wr_arb_inst (
+				.clk,
+				.reset (rst_local),
+				.in0_avmm (h2f_local_mem_wr_avmm),
+				.in1_avmm (copy_local_mem_wr_avmm),
+				.out_avmm (local_mem_wr_avmm_if[d])
+			);
+		end : dev_copy
+		else begin : no_dev_copy
+			ofs_plat_avalon_mem_if_connect local_mem_rd_conn (
+				.mem_sink   (local_mem_rd_avmm_if[d]),
+				.mem_source (f2h_local_mem_rd_avmm)
+			);
+			ofs_plat_avalon_mem_if_connect local_mem_wr_conn (
+				.mem_sink   (local_mem_wr_avmm_if[d]),
+				.mem_source (h2f_local_mem_wr_avmm)
+			);
+		end : no_dev_copy
 	end : dma_channels
+
+	//without the copy block nothing answers the dispatcher on copy_ctrl
+	if (!DEV_COPY_ENABLE) begin : no_dev_copy_ctrl
+		always_comb begin
+			copy_ctrl.controller_busy_rd              = 'b0;
+			copy_ctrl.controller_busy_wr              = 'b0;
+			copy_ctrl.cmdq_status                     = 'b0;
+			copy_ctrl.databuf_status                  = 'b0;
+			copy_ctrl.irq                             = 'b0;
+			copy_ctrl.irq_pulse                       = 'b0;
+			copy_ctrl.f2h_wr_fence_flag               = 'b0;
+			copy_ctrl.cntrl_sts                       = 'b0;
+			copy_ctrl.src_burst_cnt_counter           = 'b0;
+			copy_ctrl.src_readdatavalid_counter       = 'b0;
+			copy_ctrl.dst_write_counter               = 'b0;
+			copy_ctrl.magic_number_counter            = 'b0;
+			copy_ctrl.f2h_wait_for_magic_num_wr_pulse = 'b0;
+		end
+	end : no_dev_copy_ctrl
 endgenerate
 
 endmodule : dma_top
@@ -12,5 +12,6 @@ set_global_assignment -name SYSTEMVERILOG_FILE "${THIS_DIR}/../dma_controller_wr
 set_global_assignment -name SYSTEMVERILOG_FILE "${THIS_DIR}/../dma_data_transfer.sv"
 set_global_assignment -name SYSTEMVERILOG_FILE "${THIS_DIR}/../dma_dispatcher.sv"
 set_global_assignment -name SYSTEMVERILOG_FILE "${THIS_DIR}/../dma_interfaces.sv"
+set_global_assignment -name SYSTEMVERILOG_FILE "${THIS_DIR}/../dma_local_mem_arb.sv"
 set_global_assignment -name SYSTEMVERILOG_FILE "${THIS_DIR}/../dma_pkg.sv"
 set_global_assignment -name SYSTEMVERILOG_FILE "${THIS_DIR}/../dma_top.sv"
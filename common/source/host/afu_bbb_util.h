@@ -19,6 +19,8 @@
 #include <opae/fpga.h>
 #include <uuid/uuid.h>
 
+#include <vector>
+
 #define DFH_FEATURE_EOL(dfh) (((dfh >> 40) & 1) == 1)
 #define DFH_FEATURE(dfh) ((dfh >> 60) & 0xf)
 #define DFH_FEATURE_IS_PRIVATE(dfh) (DFH_FEATURE(dfh) == 3)
@@ -76,35 +78,80 @@ static bool find_dfh_by_guid(fpga_handle afc_handle, uint64_t find_id_l,
   return false;
 }
 
-static bool find_dfh_by_guid(fpga_handle afc_handle, const char *guid_str,
-                             uint64_t *result_offset = NULL,
-                             uint64_t *result_next_offset = NULL) {
+// Splits a GUID string into the two 64 bit words found in a BBB/AFU DFH
+static bool parse_dfh_guid(const char *guid_str, uint64_t *find_id_l,
+                           uint64_t *find_id_h) {
   fpga_guid guid;
 
   if (uuid_parse(guid_str, guid) < 0)
-    return 0;
+    return false;
 
   uint32_t i;
-  uint32_t s;
 
-  uint64_t find_id_l = 0;
-  uint64_t find_id_h = 0;
+  *find_id_l = 0;
+  *find_id_h = 0;
 
   // The API expects the MSB of the GUID at [0] and the LSB at [15].
-  s = 64;
   for (i = 0; i < 8; ++i) {
-    s -= 8;
-    find_id_h = ((find_id_h << 8) | (0xff & guid[i]));
+    *find_id_h = ((*find_id_h << 8) | (0xff & guid[i]));
   }
 
-  s = 64;
   for (i = 0; i < 8; ++i) {
-    s -= 8;
-    find_id_l = ((find_id_l << 8) | (0xff & guid[8 + i]));
+    *find_id_l = ((*find_id_l << 8) | (0xff & guid[8 + i]));
   }
+  return true;
+}
+
+static bool find_dfh_by_guid(fpga_handle afc_handle, const char *guid_str,
+                             uint64_t *result_offset = NULL,
+                             uint64_t *result_next_offset = NULL) {
+  uint64_t find_id_l = 0;
+  uint64_t find_id_h = 0;
+
+  if (!parse_dfh_guid(guid_str, &find_id_l, &find_id_h))
+    return 0;
 
   return find_dfh_by_guid(afc_handle, find_id_l, find_id_h, result_offset,
                           result_next_offset);
 }
 
+// One BBB or AFU entry of the DFH list
+struct dfh_feature {
+  uint64_t offset;
+  uint64_t id_l;
+  uint64_t id_h;
+};
+
+// Walks the whole DFH list once and returns every BBB and AFU it holds, in
+// list order. Private features have no GUID and are skipped.
+static std::vector<dfh_feature> enumerate_dfh_features(fpga_handle afc_handle) {
+  std::vector<dfh_feature> features;
+  uint64_t offset = 0;
+  uint64_t dfh = 0;
+
+  // Same guard against a list without DFH_FEATURE_EOL as find_dfh_by_guid()
+  int MAX_DFH_SEARCHES = 5000;
+  int dfh_search_iterations = 0;
+
+  do {
+    fpgaReadMMIO64(afc_handle, 0, offset, &dfh);
+
+    if (DFH_FEATURE_IS_AFU(dfh) || DFH_FEATURE_IS_BBB(dfh)) {
+      dfh_feature feature = {offset, 0, 0};
+      fpgaReadMMIO64(afc_handle, 0, offset + 8, &feature.id_l);
+      fpgaReadMMIO64(afc_handle, 0, offset + 16, &feature.id_h);
+      features.push_back(feature);
+    }
+    if (DFH_FEATURE_NEXT(dfh) == 0)
+      break;
+    offset += DFH_FEATURE_NEXT(dfh);
+
+    dfh_search_iterations++;
+    if (dfh_search_iterations > MAX_DFH_SEARCHES)
+      break;
+  } while (!DFH_FEATURE_EOL(dfh));
+
+  return features;
+}
+
 #endif // AFU_BBB_UTIL_H__
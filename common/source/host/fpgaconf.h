@@ -5,7 +5,9 @@
 #define __FPGACONF_H__
 
 #include "opae/fpga.h"
+#ifndef DEBUG_LOG
 #define DEBUG_LOG(...) fprintf(stderr, __VA_ARGS__)
+#endif
 
 #ifdef __cplusplus
 extern "C" {
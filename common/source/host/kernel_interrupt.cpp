@@ -19,7 +19,6 @@ using namespace intel_opae_mmd;
 static const int mmd_kernel_interrupt_line_num = 1;
 static const uint32_t enable_int_mask = 0x00000001;
 static const uint32_t disable_int_mask = 0x00000000;
-static const char *yield_env_var_name = "MMD_YIELD_DELAY";
 
 int KernelInterrupt::aocl_mmd_yield_val = 1;
 bool KernelInterrupt::enable_thread = false;
@@ -53,7 +52,7 @@ KernelInterrupt::KernelInterrupt(fpga_handle fpga_handle_arg, int mmd_handle)
     : m_work_thread_active(false), m_eventfd(0), m_kernel_interrupt_fn(nullptr),
       m_kernel_interrupt_user_data(nullptr), m_fpga_handle(fpga_handle_arg),
       m_mmd_handle(mmd_handle), m_event_handle(nullptr) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt Constructor\n");
   } 
   read_env_vars();
@@ -64,7 +63,7 @@ KernelInterrupt::KernelInterrupt(fpga_handle fpga_handle_arg, int mmd_handle)
  *  calls disable_interrupts() 
  */
 KernelInterrupt::~KernelInterrupt() {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt Destructor\n");
   }
   try {
@@ -86,7 +85,7 @@ KernelInterrupt::~KernelInterrupt() {
  */
 void KernelInterrupt::disable_interrupts() {
   if (!enable_thread) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : KernelInterrupt disabling interrupts\n");
     }
     assert(m_work_thread_active == false);
@@ -109,7 +108,7 @@ void KernelInterrupt::disable_interrupts() {
     check_result(res, "error fpgaDestroyEventHandle");
   }
   set_interrupt_mask(disable_int_mask);
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt disabling interrupts\n");
   }
 }
@@ -147,7 +146,7 @@ void KernelInterrupt::notify_work_thread() {
  */
 void KernelInterrupt::enable_interrupts() {
   if (!enable_thread) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : KernelInterrupt enabling interrupts\n");
     }
     set_interrupt_mask(disable_int_mask);
@@ -172,13 +171,13 @@ void KernelInterrupt::enable_interrupts() {
   m_work_thread_active = true;
   m_work_thread = std::unique_ptr<std::thread>(
       new std::thread([this] { this->work_thread(); }));
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt enabling interrupts\n");
   }
 }
 
 void KernelInterrupt::set_interrupt_mask(uint32_t intr_mask) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt setting interrupt mask : %d\n",intr_mask );
   }
   fpga_result res;
@@ -220,7 +219,7 @@ void KernelInterrupt::wait_for_event() {
   // This may be caused by knonw race condition with runtime, or there may
   // be occasional events lost from OPAE. Re-evaluate need for timeout
   // after fixing race condition with runtime.
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt waiting for event using poll()\n");
   }
   const int timeout_ms = 250;
@@ -246,7 +245,7 @@ void KernelInterrupt::wait_for_event() {
 
 void KernelInterrupt::set_kernel_interrupt(aocl_mmd_interrupt_handler_fn fn,
                                            void *user_data) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt setting kernel interrupt\n");
   }
   std::lock_guard<std::mutex> lock(m_mutex);
@@ -258,7 +257,7 @@ void KernelInterrupt::set_kernel_interrupt(aocl_mmd_interrupt_handler_fn fn,
  *  it uses return_env_vars() to return appropriate value
  */
 int KernelInterrupt::yield_is_enabled() {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt enabling yield\n");
   }
   read_env_vars();
@@ -271,11 +270,11 @@ int KernelInterrupt::yield_is_enabled() {
  *  allowing other threads to run
  */
 int KernelInterrupt::yield() {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : KernelInterrupt::yield()\n");
   }
   if (use_usleep) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : KernelInterrupt::yield() Sleeping for %d\n",sleep_us);
     }
     usleep(sleep_us);
@@ -289,14 +288,16 @@ int KernelInterrupt::yield() {
   return 0;
 }
 
-/** Configure interrupts or polling using environment variable
+/** Configure interrupts or polling using yield_delay of the MMD configuration
+ *  (MMD_YIELD_DELAY). The runtime asks for it before any device is opened,
+ *  so it comes from the settings that are not tied to a device
  *  if less than -1 then use interrupts
  *  if equal -1 then yield but no sleep
  *  if greater than or equal 0 then yield for that many us
  *  read_env_vars() called from KernelInterrupts constructor
  */
 void KernelInterrupt::read_env_vars() {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Configure interrupts or polling using environment variable\n"
                "            if less than -1 then use interrupts\n"
                "            if equal -1 then yield but no sleep\n"
@@ -307,16 +308,11 @@ void KernelInterrupt::read_env_vars() {
     return;
   }
 
-  char *delay_env_var = std::getenv(yield_env_var_name);
-
-  int delay_env_val = -1;
-  if (delay_env_var != nullptr) {
-    delay_env_val = std::atoi(delay_env_var);
-  }
+  int64_t yield_delay = mmd_config::load("", "").yield_delay;
 
   // Use interrupts
-  if (delay_env_val < -1) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+  if (yield_delay < -1) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using interrupts\n");
     }
     aocl_mmd_yield_val = 0;
@@ -325,8 +321,8 @@ void KernelInterrupt::read_env_vars() {
     sleep_us = 0;
   }
   // Use yield without sleep
-  else if (delay_env_val < 0) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+  else if (yield_delay < 0) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using yield without sleep\n");
     }
     aocl_mmd_yield_val = 1;
@@ -339,9 +335,9 @@ void KernelInterrupt::read_env_vars() {
     aocl_mmd_yield_val = 1;
     enable_thread = false;
     use_usleep = true;
-    sleep_us = delay_env_val;
+    sleep_us = static_cast<int>(yield_delay);
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using yield with sleep : %d\n", sleep_us);
     }
   }
@@ -9,6 +9,8 @@
 #include <zlib.h>
 
 #include <linux/mman.h>
+#include <numa.h>
+#include <numaif.h>
 #include <sys/mman.h>
 
 // On some systems MAP_HUGE_2MB is not defined. It should be defined for all
@@ -31,11 +33,14 @@
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
-#include <unordered_map>
 
 #include "aocl_mmd.h"
+#include "mmd_alloc_registry.h"
 #include "mmd_device.h"
+#include "mmd_host_slab.h"
 #include "fpgaconf.h"
 #include "zlib_inflate.h"
 
@@ -54,12 +59,19 @@ using namespace intel_opae_mmd;
 
 #define ACL_PKG_SECTION_DCP_GBS_GZ ".acl.gbs.gz"
 
-/** Keep a mapping between allocated memory and associated handle*/
-// XXX: Note that this is not thread-safe.  Not recommened in long term
-// likely should reevalute soon.
-static std::unordered_map<void *,
-                          std::pair<size_t, std::unique_ptr<std::vector<int>>>>
-    mem_to_handles_map;
+/** Keep a mapping between allocated memory and associated handles, see
+ *  mmd_alloc_registry.h
+ */
+static alloc_registry host_allocations;
+
+/** Slabs that small host and shared allocations are carved from, one per set
+ *  of devices the allocations are for. See mmd_host_slab.h
+ *  host_slabs_mutex only guards the list: allocations take a reference to
+ *  their slab and carve outside of it, and frees find the slab of a block
+ *  through its arena in host_allocations, see slab_of().
+ */
+static std::vector<std::shared_ptr<host_slab>> host_slabs;
+static std::mutex host_slabs_mutex;
 
 /** If the MMD is loaded dynamically, destructors in the MMD will execute before
  *  the destructors in the runtime upon program termination. The DeviceMapManager
@@ -102,6 +114,11 @@ public:
   /** Closes specified device if it exists */
   void close_device_if_exists(int handle);
 
+  /** Returns the handles of the open devices with a live
+   *  aocl_mmd_device_alloc() allocation at addr
+   */
+  std::vector<int> device_mem_owners(uint64_t addr);
+
   /* Returns a reference to the class singleton */
   static DeviceMapManager &get_instance() {
     static DeviceMapManager instance;
@@ -119,7 +136,7 @@ public:
         std::cout << "# mmd.cpp: When destroying DeviceMapManager in ASE, assume it worked.\n";
         break;
       #endif
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : In DeviceMapManager destructor, closing device with handle %d \n", handle);
       }
     }
@@ -134,7 +151,7 @@ private:
     handle_to_dev_map = new t_handle_to_dev_map();
     id_to_handle_map = new t_id_to_handle_map();
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Constructing DeviceMapManager object\n");
     }
   }
@@ -153,7 +170,7 @@ int DeviceMapManager::get_or_create_device(const char *board_name, int *handle,
   Device *_device = nullptr;
 
   if (id_to_handle_map == nullptr || handle_to_dev_map == nullptr) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Failure in DeviceMapManager::get_or_create_device,id_to_handle_map or handle_to_dev_map is NULL\n");
     }
     return DeviceMapManager::FAILURE;
@@ -161,7 +178,7 @@ int DeviceMapManager::get_or_create_device(const char *board_name, int *handle,
 
   uint64_t obj_id = id_from_name(board_name);
   if (!obj_id) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Failure in DeviceMapManager::get_or_create_device. obj_id : %ld \n", obj_id);
     }
     return false;
@@ -173,20 +190,20 @@ int DeviceMapManager::get_or_create_device(const char *board_name, int *handle,
       id_to_handle_map->insert({obj_id, _handle});
       handle_to_dev_map->insert({_handle, _device});
     } catch (std::runtime_error &e) {
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Failure in DeviceMapManager::get_or_create_device %s\n", e.what());
       }
       LOG_ERR("%s\n", e.what());
       delete _device;
       return DeviceMapManager::FAILURE;
     }
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Success in creating new device object handle : %d \n", _handle);
     }
   } else {
     _handle = id_to_handle_map->at(obj_id);
     _device = handle_to_dev_map->at(_handle);
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Success in retrieving device metadata(handle , object) , handle : %d\n", _handle);
     }
   }
@@ -194,7 +211,7 @@ int DeviceMapManager::get_or_create_device(const char *board_name, int *handle,
   (*handle) = _handle;
   (*device) = _device;
 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Success in creating new device object , handle : %d\n", _handle);
   }
   return DeviceMapManager::SUCCESS;
@@ -204,12 +221,12 @@ int DeviceMapManager::get_or_create_device(const char *board_name, int *handle,
 uint64_t DeviceMapManager::id_from_name(const char *board_name) {
   uint64_t obj_id = 0;
   if (Device::parse_board_name(board_name, obj_id)) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Success in retrieving object id from board name\n");
     }
     return obj_id;
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Failed to retrieve object id from board name\n");
     }
     // TODO: add error hanlding for DeviceMapManager (make sure 0 is marked as
@@ -228,11 +245,11 @@ inline int DeviceMapManager::handle_from_id(uint64_t obj_id) {
     if (it != id_to_handle_map->end()) {
       handle = it->second;
     }
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Success in retrieving handle from object id. handle : %d \n", handle);
     }
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Failed to retrieve handle from object id \n");
     }
   }
@@ -249,17 +266,33 @@ Device *DeviceMapManager::device_from_handle(int handle) {
     if (it != handle_to_dev_map->end()) {
       return it->second;
     }
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Success in retrieving device from handle. handle : %d \n", handle);
     }
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Failed to retrieve device from handle\n");
     }
   }
   return dev;
 }
 
+/** Returns the handles of the open devices with a live
+ *  aocl_mmd_device_alloc() allocation at addr
+ */
+std::vector<int> DeviceMapManager::device_mem_owners(uint64_t addr) {
+  std::vector<int> handles;
+  if (handle_to_dev_map) {
+    for (auto &entry : *handle_to_dev_map) {
+      device_mem_allocator *device_mem = entry.second->get_device_mem();
+      if (device_mem && device_mem->owns(addr)) {
+        handles.push_back(entry.first);
+      }
+    }
+  }
+  return handles;
+}
+
 /** Closes specified device if it exists */
 void DeviceMapManager::close_device_if_exists(int handle) {
   if (handle_to_dev_map) {
@@ -270,16 +303,16 @@ void DeviceMapManager::close_device_if_exists(int handle) {
 
       handle_to_dev_map->erase(handle);
       id_to_handle_map->erase(obj_id);
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Closing device with handle : %d\n", handle);
       } 
     } else {
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Nothing to close. Device with handle : %d already closed\n", handle);
       }
     }
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error, no handle to device map entry found for handle : %d \n", handle);
     }
   }
@@ -291,7 +324,7 @@ static int program_aocx(int handle, void *data, size_t data_size);
 /** Interface for programing green bitstream(ASP + OneAPI Kernel) on device */
 int mmd_device_reprogram(const char *device_name, void *data,
                               size_t data_size) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Entering mmd_device_reprogram() \n");
   }
   int handle;
@@ -300,7 +333,7 @@ int mmd_device_reprogram(const char *device_name, void *data,
       DeviceMapManager::SUCCESS) {
       return program_aocx(handle, data, data_size);
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Exiting mmd_device_reprogram() with error\n");
     }
     return MMD_AOCL_ERR;
@@ -311,7 +344,7 @@ int mmd_device_reprogram(const char *device_name, void *data,
 bool mmd_asp_loaded(const char *name) {
   uint64_t obj_id = device_manager.id_from_name(name);
   if (!obj_id) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error, no object id found for board : %s \n", name);
     }
     return false;
@@ -321,12 +354,12 @@ bool mmd_asp_loaded(const char *name) {
   if (handle > 0) {
     Device *dev = device_manager.device_from_handle(handle);
     if(dev) {
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : ASP loaded for handle : %d \n", handle);
       }
       return dev->asp_loaded();
     } else {
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : ASP not loaded for handle : %d \n", handle);
       }
       return false;
@@ -338,13 +371,13 @@ bool mmd_asp_loaded(const char *name) {
       asp_loaded = dev.asp_loaded();
     } catch (std::runtime_error &e) {
       LOG_ERR("%s\n", e.what());
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : ASP not loaded for handle : %d , %s\n", handle, e.what());
       }
       return false;
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : ASP loaded : %d (0 - not loaded , 1 - loaded) for handle : %d \n", asp_loaded, handle);
     }
     return asp_loaded;
@@ -468,7 +501,7 @@ cleanup:
  */
 fpga_result build_board_names(std::vector<fpga_token> &toks, std::string &boards)
 {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Querying board name \n");
   }
   fpga_properties props = nullptr;
@@ -494,7 +527,7 @@ fpga_result build_board_names(std::vector<fpga_token> &toks, std::string &boards
     boards = boards.substr(0, boards.length() - 1);
   }
 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Found board name :  %s\n",boards.c_str());
   }
 
@@ -512,26 +545,26 @@ static bool get_offline_board_names(std::string &boards, bool asp_only = true) {
 
   if (get_dfl_tokens(dfl_tokens)) {
     LOG_ERR("get_dfl_tokens\n");
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Failed querying DFL Tokens \n");
     }
     return false;
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Success querying DFL Tokens \n");
     }  
   }
 
   if (asp_only) {
     if (uuid_parse(PCI_ASP_AFU_ID, pci_guid) < 0) {
-      if(std::getenv("MMD_ENABLE_DEBUG")){ 
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){ 
         DEBUG_LOG("Error parsing pci guid '%s'\n", pci_guid);
       }
       return false;
     }
 
     if (uuid_parse(SVM_ASP_AFU_ID, svm_guid) < 0) {
-      if(std::getenv("MMD_ENABLE_DEBUG")){ 
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){ 
         DEBUG_LOG("Error parsing svm guid '%s'\n", svm_guid);
       }
       return false;
@@ -623,6 +656,109 @@ static bool get_offline_board_names(std::string &boards, bool asp_only = true) {
   return true;
 }
 
+/** Returns the slab of the device set handles (sorted), creating it when
+ *  create is set. Returns nullptr if there is none or host_slab_max_kb of the
+ *  first device disables the slabs. Arenas are pinned with every device of
+ *  the set that is still open. Called with host_slabs_mutex held.
+ */
+static std::shared_ptr<host_slab> find_host_slab(const std::vector<int> &handles,
+                                                 bool create) {
+  for (const std::shared_ptr<host_slab> &slab : host_slabs) {
+    if (slab->handles() == handles) {
+      return slab;
+    }
+  }
+  if (!create || handles.empty()) {
+    return nullptr;
+  }
+  Device *dev = device_manager.device_from_handle(handles[0]);
+  if (dev == nullptr || dev->get_config().host_slab_max_kb == 0) {
+    return nullptr;
+  }
+
+  auto pin = [handles](void *addr, size_t len) {
+    for (size_t i = 0; i < handles.size(); i++) {
+      Device *d = device_manager.device_from_handle(handles[i]);
+      void *pinned = addr;
+      if (d != nullptr && d->pin_alloc(&pinned, len) == nullptr) {
+        for (size_t j = 0; j < i; j++) {
+          Device *done = device_manager.device_from_handle(handles[j]);
+          if (done != nullptr) {
+            done->free_prepinned_mem(addr);
+          }
+        }
+        return false;
+      }
+    }
+    return true;
+  };
+  auto unpin = [handles](void *addr) {
+    for (int handle : handles) {
+      Device *d = device_manager.device_from_handle(handle);
+      if (d != nullptr) {
+        d->free_prepinned_mem(addr);
+      }
+    }
+  };
+  std::shared_ptr<host_slab> slab = std::make_shared<host_slab>(
+      handles, dev->get_config().host_slab_max_kb * 1024, dev->get_numa_node(), pin, unpin,
+      host_allocations);
+  host_slabs.push_back(slab);
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : Created host slab for %zu device(s), first handle : %d \n", handles.size(), handles[0]);
+  }
+  return slab;
+}
+
+/** Returns the slab whose arena holds ptr, anywhere in the arena, nullptr for
+ *  other pointers. Arenas are arena_len aligned and registered in
+ *  host_allocations, so this is one lookup under one shard lock. The slab
+ *  stays alive while ptr is a live block of it.
+ */
+static host_slab *slab_of(const void *ptr) {
+  uintptr_t arena = reinterpret_cast<uintptr_t>(ptr) & ~(host_slab::arena_len - 1);
+  host_allocation allocation;
+  if (!host_allocations.find(reinterpret_cast<void *>(arena), &allocation)) {
+    return nullptr;
+  }
+  return allocation.slab;
+}
+
+/** Function called in aocl_mmd_open()
+ *  maps and pins host_slab_prewarm_mb of slab arenas up front, so the first
+ *  small allocations of the application don't pay for it
+ */
+static void prewarm_host_slab(int handle, Device *dev) {
+  uint64_t prewarm_mb = dev->get_config().host_slab_prewarm_mb;
+  std::lock_guard<std::mutex> lock(host_slabs_mutex);
+  std::shared_ptr<host_slab> slab = find_host_slab(std::vector<int>(1, handle), true);
+  if (slab == nullptr || prewarm_mb == 0) {
+    return;
+  }
+  if (!slab->prewarm(prewarm_mb * 1024 * 1024)) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Could not prewarm host slab for handle : %d \n", handle);
+    }
+  }
+}
+
+/** Function called in aocl_mmd_close()
+ *  slabs of the device that have no blocks handed out are retired, then
+ *  unpinned and unmapped once no allocation still holds them. The others
+ *  stay so their blocks can still be freed; handles are never reused, so no
+ *  new allocations come from them.
+ */
+static void release_host_slabs(int handle) {
+  std::lock_guard<std::mutex> lock(host_slabs_mutex);
+  for (auto it = host_slabs.begin(); it != host_slabs.end();) {
+    if ((*it)->uses(handle) && (*it)->retire()) {
+      it = host_slabs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 /** Function called in aocl_mmd_program()
  *  If environment variable (AOCL_MMD_PROGRAM_PRESERVE_GLOBAL_MEM)
  *  is set to preserve global memory
@@ -630,31 +766,36 @@ static bool get_offline_board_names(std::string &boards, bool asp_only = true) {
  *  before programming bitstream
  */
 static void unpin_all_mem_for_handle(int handle) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Trying to unpin all memory allocations for handle : %d \n", handle);
   }
   Device *dev = device_manager.device_from_handle(handle);
 
   if (dev == NULL) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : No device found for handle : %d \n", handle);
     }  
     return;
   }
 
-  for (auto mem_it = mem_to_handles_map.begin();
-       mem_it != mem_to_handles_map.end(); ++mem_it) {
-    if (find(mem_it->second.second.get()->begin(),
-             mem_it->second.second.get()->end(),
-             handle) != mem_it->second.second.get()->end()) {
-      void *addr = mem_it->first;
-      dev->free_prepinned_mem(addr);
-      if(std::getenv("MMD_ENABLE_DEBUG")){
-        DEBUG_LOG("DEBUG LOG : Unpinned addr : %p for handle : %d \n", addr,handle);
+  for (const host_allocation &allocation : host_allocations.for_device(handle)) {
+    dev->free_prepinned_mem(allocation.addr);
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Unpinned addr : %p for handle : %d \n", allocation.addr,handle);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(host_slabs_mutex);
+    for (const std::shared_ptr<host_slab> &slab : host_slabs) {
+      if (slab->uses(handle)) {
+        slab->for_each_arena([dev](void *addr, size_t) {
+          dev->free_prepinned_mem(addr);
+          return true;
+        });
       }
     }
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Done unpinning all memory allocations for handle : %d \n", handle);
   }
 }
@@ -668,38 +809,47 @@ static void unpin_all_mem_for_handle(int handle) {
  *  which will help us preserve global memory 
  */
 static int repin_all_mem_for_handle(int handle) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Trying to repin all memory allocations for handle : %d \n", handle);
   }
   Device *dev = device_manager.device_from_handle(handle);
 
   if (dev == NULL) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : No device found for handle : %d \n", handle);
     }
     return MMD_AOCL_ERR;
   }
 
-  for (auto mem_it = mem_to_handles_map.begin();
-       mem_it != mem_to_handles_map.end(); ++mem_it) {
-    if (find(mem_it->second.second.get()->begin(),
-             mem_it->second.second.get()->end(),
-             handle) != mem_it->second.second.get()->end()) {
-      void *addr = mem_it->first;
-      if (dev->pin_alloc(&addr, mem_it->second.first) == nullptr) {
-        if(std::getenv("MMD_ENABLE_DEBUG")){
-          DEBUG_LOG("DEBUG LOG : ERROR Re-pinning addr : %p for handle : %d \n", addr, handle);
-        }  
+  for (const host_allocation &allocation : host_allocations.for_device(handle)) {
+    void *addr = allocation.addr;
+    if (dev->pin_alloc(&addr, allocation.size) == nullptr) {
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+        DEBUG_LOG("DEBUG LOG : ERROR Re-pinning addr : %p for handle : %d \n", addr, handle);
+      }  
+      return MMD_AOCL_ERR;
+    } else {
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+        DEBUG_LOG("DEBUG LOG : Re-pinned addr : %p for handle : %d \n", addr,handle);
+      }  
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(host_slabs_mutex);
+    for (const std::shared_ptr<host_slab> &slab : host_slabs) {
+      if (slab->uses(handle) &&
+          !slab->for_each_arena([dev](void *addr, size_t len) {
+            return dev->pin_alloc(&addr, len) != nullptr;
+          })) {
+        if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+          DEBUG_LOG("DEBUG LOG : ERROR Re-pinning host slab arenas for handle : %d \n", handle);
+        }
         return MMD_AOCL_ERR;
-      } else {
-        if(std::getenv("MMD_ENABLE_DEBUG")){
-          DEBUG_LOG("DEBUG LOG : Re-pinned addr : %p for handle : %d \n", addr,handle);
-        }  
       }
     }
   }
 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Done Re-pinning all memory allocations for handle : %d \n", handle);
   }
 
@@ -712,14 +862,14 @@ static int repin_all_mem_for_handle(int handle) {
 static int program_aocx(int handle, void *data, size_t data_size) {
   Device *afu = device_manager.device_from_handle(handle);
   if (afu == NULL) {
-    if(std::getenv("MMD_PROGRAM_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_program: invalid handle: %d\n", handle);
     } 
     LOG_ERR("aocl_mmd_program: invalid handle: %d\n", handle);
     return MMD_AOCL_ERR;
   }
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Opening file from memory using pkg editor acl_pkg_open_file_from_memory()\n");
   }
   struct acl_pkg_file *pkg = acl_pkg_open_file_from_memory(
@@ -727,7 +877,7 @@ static int program_aocx(int handle, void *data, size_t data_size) {
   struct acl_pkg_file *fpga_bin_pkg = NULL;
   struct acl_pkg_file *search_pkg = pkg;
   if(pkg == NULL){
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Cannot open file from memory using pkg editor.\n");
     }
   }
@@ -744,18 +894,18 @@ static int program_aocx(int handle, void *data, size_t data_size) {
         (char *)fpga_bin_contents, fpga_bin_len, ACL_PKG_SHOW_ERROR);
     search_pkg = fpga_bin_pkg;
     if(search_pkg != NULL){
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Extracted bin from aocx.\n");
       }
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Failed to extract bin from aocx.\n");
       }
       ACL_DCP_ERROR_IF(search_pkg == NULL, return MMD_AOCL_ERR,
                    "Failed to extract bin from aocx.\n");
     }
   } else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocx file does not contain .bin section.\n");
     }
     ACL_DCP_ERROR_IF(search_pkg == NULL, return MMD_AOCL_ERR,
@@ -776,13 +926,13 @@ static int program_aocx(int handle, void *data, size_t data_size) {
 
     if (ret != Z_OK) {
       LOG_ERR("aocl_mmd_program error: GBS decompression FAILED!\n");
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_program error: GBS decompression FAILED!\n"); 
       }
       free(gbs_data);
       return MMD_AOCL_ERR;
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_program : GBS decompression PASSED!\n"); 
       }  
     }
@@ -808,7 +958,7 @@ static int program_aocx(int handle, void *data, size_t data_size) {
       return handle;
     }
   } else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_program : .bin file does not contain gbs section !\n"); 
     } 
   }
@@ -828,39 +978,39 @@ static int program_aocx(int handle, void *data, size_t data_size) {
  */
 AOCL_MMD_CALL int aocl_mmd_program(int handle, void *user_data, size_t size,
                                    aocl_mmd_program_mode_t program_mode) {
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Entering MMD API aocl_mmd_program()\n");
   }
   if ((program_mode & AOCL_MMD_PROGRAM_PRESERVE_GLOBAL_MEM) ==
       AOCL_MMD_PROGRAM_PRESERVE_GLOBAL_MEM) {
     unpin_all_mem_for_handle(handle);
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Unpinned memory allocated through MMD memory allocation APIs (if any) before programming bitstream\n");
       DEBUG_LOG("DEBUG LOG : We store MMD memory allocations in a data structure , which we used to determine the Unpin list\n");
     }
     int status = program_aocx(handle, user_data, size);
     if (status != MMD_AOCL_ERR) {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Programmed aocx successfully \n"); 
       } 
       if (repin_all_mem_for_handle(handle) == MMD_AOCL_ERR) {
-        if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+        if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
           DEBUG_LOG("DEBUG LOG : Error: FAILED to re-pin all memory after program\n");
         }
       } else {
-        if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+        if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
           DEBUG_LOG("DEBUG LOG : Re-pinned memory(if any was unpinned) which we had unpinned before programming bitstream\n");
           DEBUG_LOG("DEBUG LOG : We store MMD memory allocations in a data structure , which we used to determine the Re-pin list\n");
         }
       }
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Programming aocx FAILED \n"); 
       }
     }
     return status;
   } else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error: memory unpreserved programming not supported\n");
     }
     return MMD_AOCL_ERR;
@@ -880,7 +1030,7 @@ AOCL_MMD_CALL int aocl_mmd_program(int handle, void *user_data, size_t size,
  */
 int AOCL_MMD_CALL aocl_mmd_yield(int handle) {
   DEBUG_PRINT("* Called: aocl_mmd_yield\n");
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : * Called: aocl_mmd_yield\n");
   }
   Device *dev = device_manager.device_from_handle(handle);
@@ -1023,7 +1173,7 @@ int aocl_mmd_get_info(int handle, aocl_mmd_info_t requested_info_id,
                       size_t param_value_size, void *param_value,
                       size_t *param_size_ret) {
   DEBUG_PRINT("called aocl_mmd_get_info\n");
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : called aocl_mmd_get_info\n");
   }
   Device *dev = device_manager.device_from_handle(handle);
@@ -1073,20 +1223,28 @@ int aocl_mmd_get_info(int handle, aocl_mmd_info_t requested_info_id,
     }
     break;
   }
+  // One concurrent transfer per DMA engine and direction
   case AOCL_MMD_CONCURRENT_READS:
-    RESULT_INT(1);
+    RESULT_INT(std::max(1, dev->get_num_read_engines()));
     break;
   case AOCL_MMD_CONCURRENT_WRITES:
-    RESULT_INT(1);
+    RESULT_INT(std::max(1, dev->get_num_write_engines()));
     break;
   case AOCL_MMD_CONCURRENT_READS_OR_WRITES:
-    RESULT_INT(2);
+    RESULT_INT(std::max(1, dev->get_num_read_engines()) +
+               std::max(1, dev->get_num_write_engines()));
     break;
 
   case AOCL_MMD_MIN_HOST_MEMORY_ALIGNMENT:
     RESULT_SIZE_T(64);
     break;
 
+  case AOCL_MMD_EFFECTIVE_CONFIG: {
+    std::string config = dev->get_effective_config();
+    RESULT_STR(config.c_str());
+    break;
+  }
+
   case AOCL_MMD_HOST_MEM_CAPABILITIES: {
     if (dev->get_mem_capability_support()) {
       RESULT_INT(AOCL_MMD_MEM_CAPABILITY_SUPPORTED);
@@ -1105,9 +1263,22 @@ int aocl_mmd_get_info(int handle, aocl_mmd_info_t requested_info_id,
     break;
   }
 
-  case AOCL_MMD_DEVICE_MEM_CAPABILITIES:
-    RESULT_INT(0);
+  case AOCL_MMD_DEVICE_MEM_CAPABILITIES: {
+    // Only with device_alloc_mb set and interleaving off, see Device()
+    if (dev->get_device_mem()) {
+      RESULT_INT(AOCL_MMD_MEM_CAPABILITY_SUPPORTED);
+    } else {
+      RESULT_INT(0);
+    }
     break;
+  }
+
+  case AOCL_MMD_DEVICE_MEM_STATS: {
+    std::string stats = dev->get_device_mem() ? dev->get_device_mem()->stats_string() : "";
+    RESULT_STR(stats.c_str());
+    break;
+  }
+
   case AOCL_MMD_HOST_MEM_CONCURRENT_GRANULARITY:
     RESULT_SIZE_T(0);
     break;
@@ -1143,11 +1314,11 @@ int AOCL_MMD_CALL aocl_mmd_set_interrupt_handler(
   Device *dev = device_manager.device_from_handle(handle);
   if (dev) {
     dev->set_kernel_interrupt(fn, user_data);
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Set kernel interrupt handler for device handle : %d\n", handle);
     }
   } else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error setting kernel interrupt handler for device handle : %d\n", handle);
     }
     return MMD_AOCL_ERR;
@@ -1174,7 +1345,7 @@ int AOCL_MMD_CALL aocl_mmd_set_status_handler(int handle,
   Device *dev = device_manager.device_from_handle(handle);
   if (dev) {
     dev->set_status_handler(fn, user_data);
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Set status handler for device handle : %d\n", handle);
     }
   }
@@ -1216,14 +1387,14 @@ int AOCL_MMD_CALL aocl_mmd_write(int handle, aocl_mmd_op_t op, size_t len,
                                  size_t offset) {
   DCP_DEBUG_MEM("\n- aocl_mmd_write: %d\t %p\t %lu\t %p\t %d\t %lu\n", handle,
                 op, len, src, mmd_interface, offset);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : aocl_mmd_write: handle : %d\t operation : %p\t len : 0x%zx\t src : %p\t mmd_interface : %d\t offset : 0x%zx\n", handle,op, len, src, mmd_interface, offset );
   }
   Device *dev = device_manager.device_from_handle(handle);
   if (dev)
     return dev->write_block(op, mmd_interface, src, offset, len);
   else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error in aocl_mmd_write , device not found for handle : %d\n", handle);
     }
     return -1;
@@ -1263,20 +1434,92 @@ int AOCL_MMD_CALL aocl_mmd_read(int handle, aocl_mmd_op_t op, size_t len,
                                 void *dst, int mmd_interface, size_t offset) {
   DCP_DEBUG_MEM("\n+ aocl_mmd_read: %d\t %p\t %lu\t %p\t %d\t %lu\n", handle,
                 op, len, dst, mmd_interface, offset);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : aocl_mmd_read: handle : %d\t operation : %p\t len : 0x%zx\t dst : %p\t mmd_interface : %d\t offset : 0x%zx\n", handle,op, len, dst, mmd_interface, offset );
   }
   Device *dev = device_manager.device_from_handle(handle);
   if (dev)
     return dev->read_block(op, mmd_interface, dst, offset, len);
   else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error in aocl_mmd_read , device not found for handle : %d\n", handle);
     }
     return -1;
   }
 }
 
+/** Vectored host writing to device-global-memory (HOST DDR -> FPGA DDR)
+ *  Same as aocl_mmd_write() but gathers a list of host fragments into one
+ *  contiguous device range starting at offset, with a single completion of op
+ *  for the whole list. The iov array itself may be released on return.
+ */
+int AOCL_MMD_CALL aocl_mmd_writev(int handle, aocl_mmd_op_t op,
+                                  const aocl_mmd_iovec_t *iov, size_t iovcnt,
+                                  int mmd_interface, size_t offset) {
+  DCP_DEBUG_MEM("\n- aocl_mmd_writev: %d\t %p\t %p\t %lu\t %d\t %lu\n", handle,
+                op, iov, iovcnt, mmd_interface, offset);
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_writev: handle : %d\t operation : %p\t fragments : %zu\t mmd_interface : %d\t offset : 0x%zx\n", handle, op, iovcnt, mmd_interface, offset);
+  }
+  Device *dev = device_manager.device_from_handle(handle);
+  if (dev)
+    return dev->write_blockv(op, mmd_interface, iov, iovcnt, offset);
+  else {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Error in aocl_mmd_writev , device not found for handle : %d\n", handle);
+    }
+    return -1;
+  }
+}
+
+/** Vectored host reading from device-global-memory (FPGA DDR -> HOST DDR)
+ *  Same as aocl_mmd_read() but scatters one contiguous device range starting
+ *  at offset into a list of host fragments, with a single completion of op
+ *  for the whole list. The iov array itself may be released on return.
+ */
+int AOCL_MMD_CALL aocl_mmd_readv(int handle, aocl_mmd_op_t op,
+                                 const aocl_mmd_iovec_t *iov, size_t iovcnt,
+                                 int mmd_interface, size_t offset) {
+  DCP_DEBUG_MEM("\n+ aocl_mmd_readv: %d\t %p\t %p\t %lu\t %d\t %lu\n", handle,
+                op, iov, iovcnt, mmd_interface, offset);
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_readv: handle : %d\t operation : %p\t fragments : %zu\t mmd_interface : %d\t offset : 0x%zx\n", handle, op, iovcnt, mmd_interface, offset);
+  }
+  Device *dev = device_manager.device_from_handle(handle);
+  if (dev)
+    return dev->read_blockv(op, mmd_interface, iov, iovcnt, offset);
+  else {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Error in aocl_mmd_readv , device not found for handle : %d\n", handle);
+    }
+    return -1;
+  }
+}
+
+/** Priority class of the async transfers the calling thread starts on handle
+ *  High priority transfers overtake queued normal ones in the DMA work
+ *  threads, see mmd_dma::next_work_item()
+ */
+int AOCL_MMD_CALL aocl_mmd_set_transfer_priority(int handle,
+                                                 aocl_mmd_transfer_priority_t priority) {
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_set_transfer_priority: handle : %d\t priority : %d\n", handle, priority);
+  }
+  Device *dev = device_manager.device_from_handle(handle);
+  if (!dev) {
+    return -1;
+  }
+  switch (priority) {
+  case AOCL_MMD_TRANSFER_PRIORITY_NORMAL:
+    dev->set_transfer_priority(dma_priority::normal);
+    return 0;
+  case AOCL_MMD_TRANSFER_PRIORITY_HIGH:
+    dev->set_transfer_priority(dma_priority::high);
+    return 0;
+  }
+  return -1;
+}
+
 /** If op is NULL
  *     - Then these calls must block until the operation is complete.
  *     - The status handler is not called for this operation.
@@ -1310,14 +1553,14 @@ int AOCL_MMD_CALL aocl_mmd_copy(int handle, aocl_mmd_op_t op, size_t len,
                                 size_t dst_offset) {
   DCP_DEBUG_MEM("\n+ aocl_mmd_copy: %d\t %p\t %lu\t %d\t %lu %lu\n", handle, op,
                 len, mmd_interface, src_offset, dst_offset);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : aocl_mmd_copy: handle : %d\t operation : %p\t len : 0x%zx\t mmd_interface : %d\t src_offset : 0x%zx dst_offset : 0x%zx\n", handle,op, len, mmd_interface, src_offset, dst_offset );
   }
   Device *dev = device_manager.device_from_handle(handle);
   if (dev)
     return dev->copy_block(op, mmd_interface, src_offset, dst_offset, len);
   else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error in aocl_mmd_copy , device not found for handle : %d\n", handle);
     }
   }
@@ -1340,13 +1583,13 @@ int AOCL_MMD_CALL aocl_mmd_copy(int handle, aocl_mmd_op_t op, size_t len,
  */
 int AOCL_MMD_CALL aocl_mmd_open(const char *name) {
   DEBUG_PRINT("Opening device: %s\n", name);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : aocl_mmd_open, Opening device: %s\n", name );
   }
 
   uint64_t obj_id = device_manager.id_from_name(name);
   if (!obj_id) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error while aocl_mmd_open, object id not found for board : %s\n", name );
     }
     return MMD_INVALID_PARAM;
@@ -1356,7 +1599,7 @@ int AOCL_MMD_CALL aocl_mmd_open(const char *name) {
   Device *dev = nullptr;
   if (device_manager.get_or_create_device(name, &handle, &dev) !=
       DeviceMapManager::SUCCESS) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error while aocl_mmd_open, device not found for board : %s\n", name );
     }
     return MMD_AOCL_ERR;
@@ -1366,19 +1609,20 @@ int AOCL_MMD_CALL aocl_mmd_open(const char *name) {
   if (dev->asp_loaded()) {
     if (!dev->initialize_asp()) {
       LOG_ERR("Error initializing asp\n");
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Error while aocl_mmd_open, Error initializing asp for board : %s\n", name );
       }
       return MMD_ASP_INIT_FAILED;
     }
   } else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error while aocl_mmd_open, asp not loaded for board : %s\n", name );
     }
     return MMD_ASP_NOT_LOADED;
   }
+  prewarm_host_slab(handle, dev);
   DEBUG_PRINT("end of aocl_mmd_open \n");
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Success aocl_mmd_open for board : %s, handle : %d \n", name, handle );
   }
   return handle;
@@ -1389,13 +1633,106 @@ int AOCL_MMD_CALL aocl_mmd_open(const char *name) {
  */
 int AOCL_MMD_CALL aocl_mmd_close(int handle) {
   #ifndef SIM
+    release_host_slabs(handle);
     device_manager.close_device_if_exists(handle);
   #else
     std::cout << "# mmd.cpp: During simulation (ASE) we are not closing the device.\n";
   #endif
+  // Debug records of the closed device should not wait for the next flush
+  mmd_log_flush();
   return 0;
 }
 
+/** map_aligned() maps len bytes at an address aligned to alignment. When that
+ *  is more than the page size the kernel would align to, len + alignment
+ *  bytes are reserved without access first, the mapping is put over the
+ *  aligned part of the reservation with MAP_FIXED, and the rest of the
+ *  reservation is unmapped. The range stays reserved throughout, so no other
+ *  thread can take it in between. A failed mapping sets errno like a plain
+ *  mmap() would, map_host_pages() falls back to smaller pages on it.
+ */
+static void *map_aligned(size_t len, size_t alignment, size_t page_len,
+                         int prot, int flags) {
+  if (alignment <= page_len) {
+    return mmap(nullptr, len, prot, flags, -1, 0);
+  }
+  char *reserved = static_cast<char *>(mmap(nullptr, len + alignment, PROT_NONE,
+                                            MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0));
+  if (reserved == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  char *aligned = reinterpret_cast<char *>(
+      (reinterpret_cast<uintptr_t>(reserved) + alignment - 1) & ~(alignment - 1));
+  void *addr = mmap(aligned, len, prot, flags | MAP_FIXED, -1, 0);
+  if (addr == MAP_FAILED) {
+    int mmap_errno = errno;
+    munmap(reserved, len + alignment);
+    errno = mmap_errno;
+    return MAP_FAILED;
+  }
+  if (aligned > reserved) {
+    munmap(reserved, aligned - reserved);
+  }
+  munmap(aligned + len, reserved + len + alignment - (aligned + len));
+  return addr;
+}
+
+/** map_host_pages() maps *size bytes for aocl_mmd_host_alloc(), rounded up to
+ *  the page size used. It starts with pages of *page_len and falls back
+ *  1GB -> 2MB -> 4KB when the system has no hugepages of a size left (or
+ *  does not support them). On success *size and *page_len are updated to
+ *  what the mapping got.
+ *
+ *  Nothing is faulted in here: a numa_node >= 0 is set as the preferred
+ *  policy of the mapping first (preferred for the reason given in
+ *  staging_pool::map_region()), and the caller then faults the pages in.
+ */
+static void *map_host_pages(size_t *size, size_t alignment, size_t *page_len,
+                            int numa_node) {
+  const size_t page_lens[] = {1UL << 30, 1UL << 21, 1UL << 12};
+  const int prot = PROT_READ | PROT_WRITE;
+  const int base_flags = MAP_ANONYMOUS | MAP_PRIVATE;
+
+  for (size_t len_of_page : page_lens) {
+    if (len_of_page > *page_len) {
+      continue;
+    }
+    int flags = base_flags;
+    if (len_of_page == page_lens[0]) {
+      flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+    } else if (len_of_page == page_lens[1]) {
+      flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+    }
+    size_t len = (*size + len_of_page - 1) & ~(len_of_page - 1);
+    void *addr = map_aligned(len, alignment, len_of_page, prot, flags);
+    if (addr != MAP_FAILED) {
+      if (len_of_page < *page_len) {
+        fprintf(stderr,
+                "Warning allocation with %zuK pages failed, using %zuK pages instead\n",
+                *page_len / 1024, len_of_page / 1024);
+      }
+      if (numa_node >= 0) {
+        unsigned long nodemask = 1UL << numa_node;
+        if (numa_node >= static_cast<int>(sizeof(nodemask) * 8) ||
+            mbind(addr, len, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+          fprintf(stderr, "Warning could not place allocation on NUMA node %d\n", numa_node);
+        }
+      }
+      *size = len;
+      *page_len = len_of_page;
+      return addr;
+    }
+    if (errno != ENOMEM && errno != EINVAL) {
+      break;
+    }
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - no %zuK pages for 0x%zx bytes : %s\n",
+                len_of_page / 1024, len, strerror(errno));
+    }
+  }
+  return MAP_FAILED;
+}
+
 /**
  *  Host allocations provide memory that is allocated on the host. Host
  *  allocations are accessible by the host and one or more devices.
@@ -1424,16 +1761,16 @@ AOCL_MMD_CALL void *aocl_mmd_host_alloc(int *handles, size_t num_devices,
                                         aocl_mmd_mem_properties_t *properties,
                                         int *error) {
   if (num_devices == 0 || handles == nullptr) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - number of device =0 or handles = nullptr \n");
     }
     if (error) {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - error invalid handle \n" );
       }
       *error = AOCL_MMD_ERROR_INVALID_HANDLE;
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - returning nullptr \n" );
       }
     }
@@ -1441,37 +1778,59 @@ AOCL_MMD_CALL void *aocl_mmd_host_alloc(int *handles, size_t num_devices,
   }
 
   /* checking that alignment is power of 2
-     for now if user specifies alignment more than 2M it will be flagged as
-     error, since max page size used is 2M currently if user specifies
-     allocation_size <= 4K and alignment of 2M , address returned might not be
-     aligned to 2M but will definetely be aligned to 4K it might be possible to
-     support higher alignments in future
+     alignments up to 1G, the largest page size used, are supported; the
+     mapping is placed at an aligned address when the alignment is larger
+     than its page size
   */
-  const int page_2M = 1 << 21;
-  if ((alignment > page_2M) || ((alignment & (alignment - 1)) != 0)) {
+  const size_t page_1G = 1UL << 30;
+  if ((alignment > page_1G) || ((alignment & (alignment - 1)) != 0)) {
     if (error) {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - UNSUPPORTED_ALIGNMENT \n" );
       }
       *error = AOCL_MMD_ERROR_UNSUPPORTED_ALIGNMENT;
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc -  returning nullptr\n" );
       }
     }
     return nullptr;
   }
 
-  if ((properties != nullptr) &&
-      (*(properties) != AOCL_MMD_MEM_PROPERTIES_GLOBAL_MEMORY) &&
-      (*(properties) != AOCL_MMD_MEM_PROPERTIES_MEMORY_BANK)) {
+  // AOCL_MMD_MEM_PROPERTIES_PAGE_SIZE picks the page size to start with and
+  // AOCL_MMD_MEM_PROPERTIES_NUMA_NODE the node, global memory and bank are
+  // accepted but mean nothing for host memory
+  size_t requested_page_len = 0;
+  int requested_node = -1;
+  bool valid_properties = true;
+  for (size_t i = 0; properties != nullptr && properties[i] != 0; i += 2) {
+    if (properties[i] == AOCL_MMD_MEM_PROPERTIES_PAGE_SIZE) {
+      requested_page_len = static_cast<size_t>(properties[i + 1]);
+      if (requested_page_len != (1UL << 12) && requested_page_len != (1UL << 21) &&
+          requested_page_len != page_1G) {
+        valid_properties = false;
+        break;
+      }
+    } else if (properties[i] == AOCL_MMD_MEM_PROPERTIES_NUMA_NODE) {
+      requested_node = static_cast<int>(properties[i + 1]);
+      if (requested_node < 0 || numa_available() < 0 || requested_node > numa_max_node()) {
+        valid_properties = false;
+        break;
+      }
+    } else if (properties[i] != AOCL_MMD_MEM_PROPERTIES_GLOBAL_MEMORY &&
+               properties[i] != AOCL_MMD_MEM_PROPERTIES_MEMORY_BANK) {
+      valid_properties = false;
+      break;
+    }
+  }
+  if (!valid_properties) {
     if (error) {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - UNSUPPORTED_PROPERTY \n" );
       }
       *error = AOCL_MMD_ERROR_UNSUPPORTED_PROPERTY;
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - returning nullptr \n" );
       }
     }
@@ -1481,32 +1840,31 @@ AOCL_MMD_CALL void *aocl_mmd_host_alloc(int *handles, size_t num_devices,
   // error if size specified is <= 0
   if (size == 0) {
     if (error) {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - ERROR_OUT_OF_MEMORY \n" );
       }
       *error = AOCL_MMD_ERROR_OUT_OF_MEMORY;
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - returning nullptr \n" );
       }
     } 
     return nullptr;
   }
 
-  auto mmd_dev_handles =
-      std::unique_ptr<std::vector<int>>(new std::vector<int>());
+  device_set mmd_dev_handles;
   for (unsigned int i = 0; i < num_devices; i++) {
     Device *dev = device_manager.device_from_handle(handles[i]);
-    if (dev) {
-      mmd_dev_handles->push_back(handles[i]);
+    if (dev && mmd_dev_handles.add(handles[i])) {
+      continue;
     } else {
       if (error) {
-        if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+        if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
           DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - ERROR_INVALID_HANDLE \n" );
         }
         *error = AOCL_MMD_ERROR_INVALID_HANDLE;
       } else {
-        if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+        if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
           DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - returning nullptr \n" );
         }
       }
@@ -1514,76 +1872,91 @@ AOCL_MMD_CALL void *aocl_mmd_host_alloc(int *handles, size_t num_devices,
     }
   }
 
-  const int prot = PROT_READ | PROT_WRITE;
-
-#ifdef SIM
-  int flags = MAP_ANON | MAP_PRIVATE;
-#else
-  int flags = MAP_ANONYMOUS | MAP_PRIVATE | MAP_LOCKED;
-#endif
-
-  const int page_4K = 1 << 12;
-  if (size > page_4K) { // if allocation size > 4K use hugepages
-    flags |= MAP_HUGETLB | MAP_HUGE_2MB;
-    if (size % page_2M) {
-      size += (page_2M - (size % page_2M));
+  // Small allocations are carved out of the pinned arenas of the device set,
+  // unless the caller asked for pages of a particular size or node
+  if (requested_page_len == 0 && requested_node < 0) {
+    std::vector<int> slab_handles(mmd_dev_handles.begin(), mmd_dev_handles.end());
+    std::sort(slab_handles.begin(), slab_handles.end());
+    std::shared_ptr<host_slab> slab;
+    {
+      std::lock_guard<std::mutex> lock(host_slabs_mutex);
+      slab = find_host_slab(slab_handles, true);
     }
-  } else {
-    if (size % page_4K) {
-      size += (page_4K - (size % page_4K));
+    if (slab != nullptr && slab->serves(size, alignment)) {
+      void *block = slab->alloc(size, alignment);
+      if (block != nullptr) {
+        if (error) {
+          *error = AOCL_MMD_ERROR_SUCCESS;
+        }
+        if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+          DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - slab block : %p, %zu \n", block, size );
+        }
+        return block;
+      }
+      // Fall back to a mapping of its own
     }
   }
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - allocating memory using mmap() \n" );
+  // if allocation size > 4K use hugepages, 1G ones from host_huge_1g_mb up
+  const size_t page_4K = 1UL << 12;
+  size_t page_len = (size > page_4K) ? (1UL << 21) : page_4K;
+  Device *first_dev = device_manager.device_from_handle(*mmd_dev_handles.begin());
+  uint64_t huge_1g_mb = first_dev->get_config().host_huge_1g_mb;
+  if (requested_page_len != 0) {
+    page_len = requested_page_len;
+  } else if (huge_1g_mb != 0 && size >= huge_1g_mb * 1024 * 1024) {
+    page_len = page_1G;
   }
-  void *addr = mmap(nullptr, size, prot, flags, -1, 0);
-  if (addr == MAP_FAILED && errno == ENOMEM) {
 
-#ifdef SIM
-    flags = MAP_ANONYMOUS | MAP_PRIVATE;
-#else
-    flags = MAP_ANONYMOUS | MAP_PRIVATE | MAP_LOCKED;
-#endif
-    addr = mmap(nullptr, size, prot, flags, -1, 0);
-    if (addr != MAP_FAILED) {
-      fprintf(
-          stderr,
-          "Warning allocation with 2M pages failed, using 4K pages instead\n");
-    }
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - allocating memory using mmap() \n" );
   }
+  // Placed on the node of the first device unless the caller asked otherwise
+  int numa_node = requested_node >= 0 ? requested_node : first_dev->get_numa_node();
+  void *addr = map_host_pages(&size, alignment, &page_len, numa_node);
 
   DEBUG_PRINT("aocl mmd alloc: mmap: %p, %zu\n", addr, size);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - mmap() : %p, %zu \n", addr, size );
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - mmap() : %p, %zu , %zuK pages \n", addr, size, page_len / 1024 );
   }
 
   if (addr == MAP_FAILED) {
     LOG_ERR("aocl mmd alloc failed: %s\n", strerror(errno));
     if (error) {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc -  ERROR_OUT_OF_MEMORY\n" );
       }
       *error = AOCL_MMD_ERROR_OUT_OF_MEMORY;
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc -  returning nullptr\n" );
       }
     }
     return nullptr;
   }
 
-  for (auto handle : *mmd_dev_handles) {
+  // Fault the pages in on the copy workers of the first device rather than
+  // one at a time inside mmap, then lock them as MAP_LOCKED used to
+  first_dev->prefault_host_mem(addr, size, page_len);
+#ifndef SIM
+  if (mlock(addr, size) != 0) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - mlock() : %s , relying on the VTP pin \n", strerror(errno) );
+    }
+  }
+#endif
+
+  for (auto handle : mmd_dev_handles) {
     // TODO: need to add a cleanup step in case this operation fails
     Device *dev = device_manager.device_from_handle(handle);
     if (dev != nullptr && dev->pin_alloc(&addr, size) == nullptr) {
       if (error) {
-        if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+        if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
           DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc -  ERROR_OUT_OF_MEMORY\n" );
         }
         *error = AOCL_MMD_ERROR_OUT_OF_MEMORY;
       } else {
-        if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+        if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
           DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc -  returning nullptr\n" );
         }
       }
@@ -1591,11 +1964,16 @@ AOCL_MMD_CALL void *aocl_mmd_host_alloc(int *handles, size_t num_devices,
     }
   }
 
-  mem_to_handles_map[addr] = std::make_pair(size, std::move(mmd_dev_handles));
+  host_allocation allocation;
+  allocation.addr = addr;
+  allocation.size = size;
+  allocation.page_len = page_len;
+  allocation.devices = mmd_dev_handles;
+  host_allocations.insert(allocation);
   if (error) {
     *error = AOCL_MMD_ERROR_SUCCESS;
   }
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : aocl_mmd_host_alloc - Exiting with SUCCESS  \n" );
   }
   return addr;
@@ -1612,55 +1990,95 @@ AOCL_MMD_CALL int aocl_mmd_free(void *mem) {
 
   // TODO: check on return code in case of freeing null
   if (mem == nullptr) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : ERROR aocl_mmd_free - trying to free nullptr\n" );
     }
-    return 0;
+    return AOCL_MMD_ERROR_SUCCESS;
   }
 
-  auto handle_iter = mem_to_handles_map.find(mem);
-  if (handle_iter == mem_to_handles_map.end()) {
-    // TODO: more rigorous error handling
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : ERROR aocl_mmd_free - address to free not found in datastructure mem_to_handles_map \n" );
+  host_slab *slab = slab_of(mem);
+  if (slab != nullptr) {
+    // Never fall through to the registry, the arena itself is registered there
+    if (!slab->free(mem)) {
+      LOG_ERR("aocl_mmd_free: %p is not a block handed out by the host slab\n", mem);
+      return AOCL_MMD_ERROR_INVALID_POINTER;
     }
-    return -1;
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : aocl_mmd_free - returned slab block %p \n", mem );
+    }
+    return AOCL_MMD_ERROR_SUCCESS;
   }
 
-  auto mmd_dev_handles = std::move(handle_iter->second.second);
+  // Taking the allocation out of the registry first makes sure only one of
+  // two threads freeing the same pointer goes on to unpin and unmap it
+  host_allocation allocation;
+  if (!host_allocations.erase(mem, &allocation)) {
+    // Device pointers of two devices can be equal, which one is meant is
+    // left to aocl_mmd_device_free()
+    std::vector<int> owners = device_manager.device_mem_owners(reinterpret_cast<uint64_t>(mem));
+    if (owners.size() == 1) {
+      return aocl_mmd_device_free(owners[0], mem);
+    } else if (owners.size() > 1) {
+      LOG_ERR("aocl_mmd_free: device pointer %p is allocated on %zu devices, use aocl_mmd_device_free\n",
+              mem, owners.size());
+      return AOCL_MMD_ERROR_INVALID_POINTER;
+    }
+    // TODO: more rigorous error handling
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : ERROR aocl_mmd_free - address to free not found in host allocation registry \n" );
+    }
+    return AOCL_MMD_ERROR_INVALID_POINTER;
+  }
 
   int rc = 0;
-  for (auto handle : *mmd_dev_handles) {
+  for (auto handle : allocation.devices) {
     Device *dev = device_manager.device_from_handle(handle);
     if (dev) {
       dev->free_prepinned_mem(mem);
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : aocl_mmd_free - freeing pinned mem at address %p \n", mem );
       }
     } else {
-      if(std::getenv("MMD_PROGRAM_DEBUG")){
-        DEBUG_LOG("DEBUG LOG : ERROR aocl_mmd_free - device not found for handle : %d \n", handle );
+      // The pins went away with the device's MPF connection when it was closed
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM)){
+        DEBUG_LOG("DEBUG LOG : aocl_mmd_free - device not found for handle : %d , nothing to unpin \n", handle );
       }
-      return -1;
     }
   }
   DEBUG_PRINT("aocl_mmd_free: munmap: %p %zu\n", mem,
-              handle_iter->second.first);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : aocl_mmd_free: munmap: %p %zu\n" ,mem, handle_iter->second.first );
+              allocation.size);
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_free: munmap: %p %zu\n" ,mem, allocation.size );
   }
-  rc = munmap(mem, handle_iter->second.first);
+  rc = munmap(mem, allocation.size);
   if (rc < 0) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_free: munmap FAILED\n");
     }
     perror("munmap failed");
-    return rc;
+    return AOCL_MMD_ERROR_INVALID_POINTER;
   }
-  mem_to_handles_map.erase(handle_iter);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : aocl_mmd_free: munmap SUCCESS\n");
   }
+  return AOCL_MMD_ERROR_SUCCESS;
+}
+
+/**
+ * Returns the size in bytes of the pages backing memory allocated by
+ * aocl_mmd_host_alloc() or aocl_mmd_shared_alloc(), 0 if mem is not the
+ * start of such an allocation. Lets the page size be matched up with the VTP
+ * hit rates of the DMA.
+ */
+AOCL_MMD_CALL size_t aocl_mmd_host_alloc_page_size(void *mem) {
+  host_slab *slab = slab_of(mem);
+  if (slab != nullptr) {
+    return slab->page_len(mem);
+  }
+  host_allocation allocation;
+  if (host_allocations.find(mem, &allocation)) {
+    return allocation.page_len;
+  }
   return 0;
 }
 
@@ -1670,18 +2088,126 @@ int mmd_get_handle(const char *name) {
   Device *dev = nullptr;
   if (device_manager.get_or_create_device(name, &handle, &dev) !=
       DeviceMapManager::SUCCESS) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG :mmd_get_handle FAILED for board name : %s\n", name);
     }
     return MMD_AOCL_ERR;
   } else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG :mmd_get_handle PASSED for board name : %s\n", name);
     }
     return handle;
   }
 }
 
+/**
+ *  Allocate memory that is owned by the device, out of the top
+ *  device_alloc_mb of each memory bank. AOCL_MMD_MEM_PROPERTIES_MEMORY_BANK
+ *  picks the bank, numbered from 1 like the buffer bank flags of the runtime,
+ *  0 or no bank lets the allocator pick the bank with the most free memory.
+ *  Not supported unless device_alloc_mb is set and device_mem_interleaved
+ *  is 0, since the runtime places its own buffers without asking the MMD
+ *  and interleaved banks are not bank_mb apart. AOCL_MMD_EFFECTIVE_CONFIG
+ *  reports the memory per bank left to the runtime.
+ *
+ *  @param  handle Device that will have access to this memory
+ *  @param  size The size of the memory region
+ *  @param  alignment The alignment in bytes of the memory region
+ *  @param  properties Specifies additional information about the allocated
+ *    memory, described by a property type name and its corresponding value.
+ *  @param error The error code defined by AOCL_MMD_ERROR*
+ *  @return Pointer that can be passed into the kernel. NULL on failure.
+ */
+AOCL_MMD_CALL void *aocl_mmd_device_alloc(int handle, size_t size,
+                                          size_t alignment,
+                                          aocl_mmd_mem_properties_t *properties,
+                                          int *error) {
+  Device *dev = device_manager.device_from_handle(handle);
+  if (!dev || !dev->get_device_mem()) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : aocl_mmd_device_alloc - no device allocator for handle %d\n", handle);
+    }
+    if (error) {
+      *error = AOCL_MMD_ERROR_INVALID_HANDLE;
+    }
+    return nullptr;
+  }
+  device_mem_allocator *device_mem = dev->get_device_mem();
+
+  if (alignment & (alignment - 1)) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : aocl_mmd_device_alloc - UNSUPPORTED_ALIGNMENT %zu\n", alignment);
+    }
+    if (error) {
+      *error = AOCL_MMD_ERROR_UNSUPPORTED_ALIGNMENT;
+    }
+    return nullptr;
+  }
+
+  int bank = -1;
+  bool valid_properties = true;
+  for (size_t i = 0; properties != nullptr && properties[i] != 0; i += 2) {
+    if (properties[i] == AOCL_MMD_MEM_PROPERTIES_MEMORY_BANK) {
+      if (properties[i + 1] > device_mem->num_banks()) {
+        valid_properties = false;
+        break;
+      }
+      bank = static_cast<int>(properties[i + 1]) - 1;
+    } else if (properties[i] != AOCL_MMD_MEM_PROPERTIES_GLOBAL_MEMORY) {
+      valid_properties = false;
+      break;
+    }
+  }
+  if (!valid_properties) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : aocl_mmd_device_alloc - UNSUPPORTED_PROPERTY \n" );
+    }
+    if (error) {
+      *error = AOCL_MMD_ERROR_UNSUPPORTED_PROPERTY;
+    }
+    return nullptr;
+  }
+
+  uint64_t addr = 0;
+  if (size == 0 || !device_mem->alloc(size, alignment, bank, &addr)) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : aocl_mmd_device_alloc - ERROR_OUT_OF_MEMORY size %zu bank %d\n", size, bank);
+    }
+    if (error) {
+      *error = AOCL_MMD_ERROR_OUT_OF_MEMORY;
+    }
+    return nullptr;
+  }
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_device_alloc - allocated 0x%lx size %zu\n", addr, size);
+  }
+  if (error) {
+    *error = AOCL_MMD_ERROR_SUCCESS;
+  }
+  return reinterpret_cast<void *>(addr);
+}
+
+/** Frees memory allocated by aocl_mmd_device_alloc() for the device of
+ *  handle. aocl_mmd_free() ends up here when the pointer is live on one
+ *  device only.
+ */
+AOCL_MMD_CALL int aocl_mmd_device_free(int handle, void *mem) {
+  Device *dev = device_manager.device_from_handle(handle);
+  if (!dev || !dev->get_device_mem()) {
+    return AOCL_MMD_ERROR_INVALID_HANDLE;
+  }
+  if (!dev->get_device_mem()->free(reinterpret_cast<uint64_t>(mem))) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : ERROR aocl_mmd_device_free - %p is not allocated on handle %d\n", mem, handle);
+    }
+    return AOCL_MMD_ERROR_INVALID_POINTER;
+  }
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : aocl_mmd_device_free - freed %p on handle %d\n", mem, handle);
+  }
+  return AOCL_MMD_ERROR_SUCCESS;
+}
+
 /**
  *  Shared allocations may migrate between the host and one or more associated
  *  device. The same pointer to a shared allocation may be used on the host and
@@ -1729,12 +2255,12 @@ AOCL_MMD_CALL void *aocl_mmd_shared_alloc(int handle, size_t size,
      allocate on host, not on device. So we can use aocl_mmd_host_alloc()_API
      under the hood.
   */
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : In aocl_mmd_shared_alloc which uses aocl_mmd_host_alloc underthehood\n");
   }
   void *return_value =
       aocl_mmd_host_alloc(&handle, 1, size, alignment, properties, error);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Exiting aocl_mmd_shared_alloc\n");
   }
   return return_value;
@@ -1777,7 +2303,7 @@ AOCL_MMD_CALL int aocl_mmd_shared_migrate(int handle, void *shared_ptr,
       "aocl_mmd_shared_alloc() API may be implemented with memory being "
       "allocated on the device and migrated between host and device");
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : aocl_mmd_shared_migrate API is being used for completeness but not "
       "doing any work other than validating API params.\nSince shared "
       "allocation is always allocated on host no migration needs to be done "
@@ -1788,7 +2314,7 @@ AOCL_MMD_CALL int aocl_mmd_shared_migrate(int handle, void *shared_ptr,
 
   // validating 'handle' param
   if (!device_manager.device_from_handle(handle)) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_shared_migrate ERROR_INVALID_HANDLE\n");
     }
     return AOCL_MMD_ERROR_INVALID_HANDLE;
@@ -1800,29 +2326,31 @@ AOCL_MMD_CALL int aocl_mmd_shared_migrate(int handle, void *shared_ptr,
 
   // error if size specified is <= 0
   if (size == 0) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_shared_migrate ERROR_INVALID_MIGRATION_SIZE for handle : %d\n", handle);
     }
     return AOCL_MMD_ERROR_INVALID_MIGRATION_SIZE;
   }
 
   if ((size % page_4K != 0) && (size % page_2M != 0)) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_shared_migrate ERROR_INVALID_MIGRATION_SIZE for handle : %d\n", handle);
     }
     return AOCL_MMD_ERROR_INVALID_MIGRATION_SIZE;
   }
 
-  // validating 'shared_ptr' param
-  auto handle_iter = mem_to_handles_map.find(shared_ptr);
-  if (handle_iter == mem_to_handles_map.end()) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  // validating 'shared_ptr' param, the start of an allocation or a slab block
+  // is found with a single lookup, only other interior pointers search
+  host_allocation allocation;
+  if (slab_of(shared_ptr) == nullptr && !host_allocations.find(shared_ptr, &allocation) &&
+      !host_allocations.find_containing(shared_ptr, &allocation)) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : aocl_mmd_shared_migrate ERROR_INVALID_POINTER for handle : %d\n", handle);
     }
     return AOCL_MMD_ERROR_INVALID_POINTER;
   }
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Exiting aocl_mmd_shared_migrate for handle : %d \n", handle);
   }
   return 0;
@@ -0,0 +1,116 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "mmd_alloc_registry.h"
+
+namespace intel_opae_mmd {
+
+bool device_set::add(int handle) {
+  if (contains(handle)) {
+    return true;
+  }
+  if (m_count == max_devices) {
+    return false;
+  }
+  m_handles[m_count++] = handle;
+  return true;
+}
+
+bool device_set::contains(int handle) const {
+  return std::find(begin(), end(), handle) != end();
+}
+
+/** shard_of() hashes the page number of addr, allocations are at least 4KB
+ *  aligned so the low bits carry nothing.
+ */
+alloc_registry::shard &alloc_registry::shard_of(uintptr_t addr) {
+  uint64_t h = static_cast<uint64_t>(addr >> 12) * 0x9e3779b97f4a7c15ULL;
+  return m_shards[(h >> 32) % num_shards];
+}
+
+bool alloc_registry::insert(const host_allocation &allocation) {
+  uintptr_t addr = reinterpret_cast<uintptr_t>(allocation.addr);
+  shard &s = shard_of(addr);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (!s.allocations.insert(std::make_pair(addr, allocation)).second) {
+    return false;
+  }
+  for (int handle : allocation.devices) {
+    s.by_device[handle].insert(addr);
+  }
+  return true;
+}
+
+bool alloc_registry::find(const void *addr, host_allocation *allocation) {
+  uintptr_t key = reinterpret_cast<uintptr_t>(addr);
+  shard &s = shard_of(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto it = s.allocations.find(key);
+  if (it == s.allocations.end()) {
+    return false;
+  }
+  *allocation = it->second;
+  return true;
+}
+
+/** find_containing() looks through every shard, since the shard of an
+ *  allocation follows from its start address only. Each shard is searched
+ *  for the last allocation starting at or below addr.
+ */
+bool alloc_registry::find_containing(const void *addr, host_allocation *allocation) {
+  uintptr_t key = reinterpret_cast<uintptr_t>(addr);
+  for (shard &s : m_shards) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.allocations.upper_bound(key);
+    if (it == s.allocations.begin()) {
+      continue;
+    }
+    --it;
+    if (key < it->first + it->second.size) {
+      *allocation = it->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool alloc_registry::erase(const void *addr, host_allocation *allocation) {
+  uintptr_t key = reinterpret_cast<uintptr_t>(addr);
+  shard &s = shard_of(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto it = s.allocations.find(key);
+  if (it == s.allocations.end()) {
+    return false;
+  }
+  for (int handle : it->second.devices) {
+    auto dev_it = s.by_device.find(handle);
+    if (dev_it != s.by_device.end()) {
+      dev_it->second.erase(key);
+      if (dev_it->second.empty()) {
+        s.by_device.erase(dev_it);
+      }
+    }
+  }
+  *allocation = it->second;
+  s.allocations.erase(it);
+  return true;
+}
+
+std::vector<host_allocation> alloc_registry::for_device(int handle) {
+  std::vector<host_allocation> allocations;
+  for (shard &s : m_shards) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto dev_it = s.by_device.find(handle);
+    if (dev_it == s.by_device.end()) {
+      continue;
+    }
+    for (uintptr_t addr : dev_it->second) {
+      allocations.push_back(s.allocations.at(addr));
+    }
+  }
+  return allocations;
+}
+
+}; // namespace intel_opae_mmd
@@ -0,0 +1,95 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_ALLOC_REGISTRY_H_
+#define MMD_ALLOC_REGISTRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace intel_opae_mmd {
+
+class host_slab;
+
+/** Handles of the devices an allocation is pinned with, stored inline */
+class device_set final {
+public:
+  static const size_t max_devices = 16;
+
+  device_set() : m_count(0) {}
+
+  // Returns false when the set is full, adding a handle twice is a no-op
+  bool add(int handle);
+  bool contains(int handle) const;
+  size_t size() const { return m_count; }
+  const int *begin() const { return m_handles; }
+  const int *end() const { return m_handles + m_count; }
+
+private:
+  int m_handles[max_devices];
+  size_t m_count;
+};
+
+/** A mapping made by aocl_mmd_host_alloc() and the devices it is pinned with,
+ *  or an arena of a host slab. Arenas are registered with no devices, their
+ *  pins belong to the slab.
+ */
+struct host_allocation {
+  void *addr;
+  size_t size;
+  size_t page_len; // page size the mapping ended up with
+  device_set devices;
+  host_slab *slab = nullptr; // slab the arena belongs to, see mmd_host_slab.h
+};
+
+/** Registry of the host allocations of the process, safe to use from any
+ *  thread.
+ *
+ *  Allocations are spread over shards by a hash of their start address, each
+ *  shard with a lock of its own, so threads allocating and freeing different
+ *  buffers rarely meet. A shard keeps its allocations ordered by address for
+ *  lookups of interior pointers, and an index per device so the allocations
+ *  of one device are found without walking all of them. Lookups return
+ *  copies; an allocation found can be freed by another thread right after.
+ */
+class alloc_registry final {
+public:
+  alloc_registry() = default;
+
+  // Returns false if an allocation at the same address is registered
+  bool insert(const host_allocation &allocation);
+  // Allocation starting at addr
+  bool find(const void *addr, host_allocation *allocation);
+  // Allocation holding addr anywhere in its range
+  bool find_containing(const void *addr, host_allocation *allocation);
+  // Removes the allocation starting at addr, returning it
+  bool erase(const void *addr, host_allocation *allocation);
+  // Allocations pinned with the device of handle
+  std::vector<host_allocation> for_device(int handle);
+
+  alloc_registry(const alloc_registry &) = delete;
+  alloc_registry &operator=(const alloc_registry &) = delete;
+
+private:
+  static const size_t num_shards = 16;
+
+  struct shard {
+    std::mutex mutex;
+    std::map<uintptr_t, host_allocation> allocations; // keyed by start
+    std::unordered_map<int, std::unordered_set<uintptr_t>> by_device;
+  };
+
+  shard &shard_of(uintptr_t addr);
+
+  shard m_shards[num_shards];
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_ALLOC_REGISTRY_H_
@@ -0,0 +1,123 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <chrono>
+
+#include "mmd_completion.h"
+#include "mmd_device.h"
+
+namespace intel_opae_mmd {
+
+// Completions the ring holds before the DMA work thread has to wait for the
+// dispatch thread
+static const size_t completion_ring_slots = 4096;
+
+// Most entries taken off the ring before their callbacks are run
+static const size_t completion_batch_max = 64;
+
+static inline uint64_t steady_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+completion_dispatcher::completion_dispatcher(const char *name, completion_fn done,
+                                             std::atomic<uint64_t> *outstanding)
+    : m_name(name), m_done(done), m_outstanding(outstanding),
+      m_ring(completion_ring_slots), m_pushed(0), m_popped(0),
+      m_ring_full_waits(0), m_stats(), m_parked(false), m_stopping(false),
+      m_thread(nullptr) {
+  m_thread = new std::thread([this] { this->dispatch_thread(); });
+}
+
+completion_dispatcher::~completion_dispatcher() {
+  {
+    // Flip the flag under the park mutex so the dispatch thread can't miss the wakeup
+    std::lock_guard<std::mutex> lock(m_park_mutex);
+    m_stopping = true;
+  }
+  m_notify.notify_one();
+  m_thread->join();
+  delete m_thread;
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : DMA %s completions : callbacks %ld , batches %ld , avg callback %ld ns , max callback %ld ns , max backlog %ld , ring full waits %ld\n",
+              m_name, m_stats.callbacks, m_stats.batches,
+              m_stats.callbacks ? m_stats.total_callback_ns / m_stats.callbacks : 0,
+              m_stats.max_callback_ns, m_stats.max_backlog, m_ring_full_waits.load());
+  }
+}
+
+/** push() queues one completion, waking the dispatch thread if it is parked.
+ *  If the ring is full we yield until the dispatch thread makes room.
+ */
+void completion_dispatcher::push(aocl_mmd_op_t op, int status) {
+  entry e = {op, status};
+  while (!m_ring.try_push(e)) {
+    m_ring_full_waits.fetch_add(1, std::memory_order_relaxed);
+    std::this_thread::yield();
+  }
+  m_pushed.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_parked.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(m_park_mutex);
+    m_notify.notify_one();
+  }
+}
+
+/** dispatch_thread() takes up to completion_batch_max entries off the ring,
+ *  which frees their slots for the DMA straight away, and then runs their
+ *  callbacks. The time of each callback and the backlog found at the start
+ *  of each batch go into m_stats.
+ */
+void completion_dispatcher::dispatch_thread() {
+  entry batch[completion_batch_max];
+  while (true) {
+    uint64_t backlog = m_pushed.load(std::memory_order_relaxed) - m_popped;
+    size_t n = 0;
+    while (n < completion_batch_max && m_ring.try_pop(batch[n])) {
+      n++;
+    }
+    if (n == 0) {
+      if (!wait_for_entries()) {
+        return;
+      }
+      continue;
+    }
+    m_popped += n;
+    m_stats.batches++;
+    m_stats.max_backlog = std::max(m_stats.max_backlog, std::max<uint64_t>(backlog, n));
+
+    for (size_t i = 0; i < n; i++) {
+      uint64_t start_ns = steady_now_ns();
+      m_done(batch[i].op, batch[i].status);
+      uint64_t callback_ns = steady_now_ns() - start_ns;
+      m_stats.callbacks++;
+      m_stats.total_callback_ns += callback_ns;
+      m_stats.max_callback_ns = std::max(m_stats.max_callback_ns, callback_ns);
+      m_outstanding->fetch_sub(1, std::memory_order_release);
+    }
+  }
+}
+
+/** wait_for_entries() parks the dispatch thread until the ring has entries,
+ *  or returns false once it is empty and the dispatcher is being destroyed.
+ *  Same handshake with push() as the DMA work thread has with enqueue_dma().
+ */
+bool completion_dispatcher::wait_for_entries() {
+  std::unique_lock<std::mutex> lock(m_park_mutex);
+  m_parked.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (m_ring.empty()) {
+    if (m_stopping) {
+      m_parked.store(false, std::memory_order_relaxed);
+      return false;
+    }
+    m_notify.wait(lock);
+  }
+  m_parked.store(false, std::memory_order_relaxed);
+  return true;
+}
+
+}; // namespace intel_opae_mmd
@@ -0,0 +1,80 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_COMPLETION_H_
+#define MMD_COMPLETION_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "aocl_mmd.h"
+#include "mmd_mpsc_ring.h"
+
+namespace intel_opae_mmd {
+
+/** Reports DMA completions to the runtime from a thread of its own.
+ *
+ *  The DMA work thread pushes the op and status of every finished transfer
+ *  into a lock free ring and moves straight on to the next transfer. The
+ *  dispatch thread drains the ring in batches and calls done(op, status)
+ *  for each entry in the order they were pushed, then takes one off
+ *  *outstanding. A slow status handler only grows the backlog; the DMA
+ *  stalls only once the ring is full. Any thread may push.
+ */
+class completion_dispatcher final {
+public:
+  typedef std::function<void(aocl_mmd_op_t op, int status)> completion_fn;
+
+  completion_dispatcher(const char *name, completion_fn done,
+                        std::atomic<uint64_t> *outstanding);
+  // Reports everything still queued first
+  ~completion_dispatcher();
+
+  void push(aocl_mmd_op_t op, int status);
+
+  completion_dispatcher(const completion_dispatcher &) = delete;
+  completion_dispatcher &operator=(const completion_dispatcher &) = delete;
+
+private:
+  struct entry {
+    aocl_mmd_op_t op;
+    int status;
+  };
+
+  // Dispatch thread counters
+  struct stats {
+    uint64_t callbacks;
+    uint64_t batches;
+    uint64_t total_callback_ns;
+    uint64_t max_callback_ns;
+    uint64_t max_backlog;  // entries waiting when a batch was started
+    uint64_t ring_full_waits;
+  };
+
+  void dispatch_thread();
+  bool wait_for_entries();
+
+  const char *m_name;
+  completion_fn m_done;
+  std::atomic<uint64_t> *m_outstanding;
+  mpsc_ring<entry> m_ring;
+  std::atomic<uint64_t> m_pushed;
+  uint64_t m_popped; // dispatch thread only
+  std::atomic<uint64_t> m_ring_full_waits;
+  stats m_stats;
+
+  std::mutex m_park_mutex;
+  std::condition_variable m_notify;
+  std::atomic<bool> m_parked;
+  bool m_stopping; // protected by m_park_mutex
+  std::thread *m_thread;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_COMPLETION_H_
@@ -0,0 +1,288 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "mmd_config.h"
+#include "mmd_device.h"
+#include "mmd_dma.h"
+
+namespace intel_opae_mmd {
+
+static const char *default_config_file = "/etc/opae/oneapi-asp.conf";
+static const char *config_file_env_var_name = "MMD_CONFIG_FILE";
+
+// Section of the configuration file that applies to this build of the MMD
+#if BOARD_TYPE == 1
+static const char *board_type_section = "n6001";
+#else
+static const char *board_type_section = "d5005";
+#endif
+
+// The ASE simulation often runs on systems that do not have permission
+// for allocating 2M pages. This results in a lot of extra time spent pinning
+// thousands of 4K pages if 2M is used for DMA buffer size. Solution is to
+// reduce size to 4K in simuation.
+#ifdef SIM
+static const uint64_t default_staging_slot_bytes = 4 * 1024;
+static const uint64_t default_copy_threshold = 4 * 1024;
+#else
+static const uint64_t default_staging_slot_bytes = 2 * 1024 * 1024;
+static const uint64_t default_copy_threshold = 0;
+#endif
+
+/** One configuration key and where it is stored in mmd_config. Exactly one
+ *  of the member pointers is set.
+ */
+struct config_key {
+  const char *name;
+  const char *env_var_name;
+  uint64_t mmd_config::*u64;
+  int64_t mmd_config::*i64;
+  std::string mmd_config::*str;
+};
+
+static const config_key config_keys[] = {
+    {"dma_copy_threshold", "OFS_OCL_ENV_DMA_THRESHOLD", &mmd_config::dma_copy_threshold, nullptr, nullptr},
+    {"dma_calibrate", "OFS_OCL_ENV_DMA_CALIBRATE", &mmd_config::dma_calibrate, nullptr, nullptr},
+    {"dma_staging_slots", "OFS_OCL_ENV_DMA_STAGING_SLOTS", &mmd_config::dma_staging_slots, nullptr, nullptr},
+    {"dma_staging_slot_bytes", "OFS_OCL_ENV_DMA_STAGING_BYTES", &mmd_config::dma_staging_slot_bytes, nullptr, nullptr},
+    {"dma_max_len", "OFS_OCL_ENV_DMA_MAX_LEN", &mmd_config::dma_max_len, nullptr, nullptr},
+    {"dma_max_inflight", "OFS_OCL_ENV_DMA_MAX_INFLIGHT", &mmd_config::dma_max_inflight, nullptr, nullptr},
+    {"dma_wait_h2f", "OFS_OCL_ENV_DMA_WAIT_H2F", nullptr, nullptr, &mmd_config::dma_wait_h2f},
+    {"dma_wait_f2h", "OFS_OCL_ENV_DMA_WAIT_F2H", nullptr, nullptr, &mmd_config::dma_wait_f2h},
+    {"dma_spin_us", "OFS_OCL_ENV_DMA_SPIN_US", &mmd_config::dma_spin_us, nullptr, nullptr},
+    {"dma_worker_spin_us", "OFS_OCL_ENV_DMA_WORKER_SPIN_US", &mmd_config::dma_worker_spin_us, nullptr, nullptr},
+    {"dma_coalesce_bytes", "OFS_OCL_ENV_DMA_COALESCE_BYTES", &mmd_config::dma_coalesce_bytes, nullptr, nullptr},
+    {"dma_inline_bytes", "OFS_OCL_ENV_DMA_INLINE_BYTES", &mmd_config::dma_inline_bytes, nullptr, nullptr},
+    {"dma_stripe_mb", "OFS_OCL_ENV_DMA_STRIPE_MB", &mmd_config::dma_stripe_mb, nullptr, nullptr},
+    {"dma_slice_kb", "OFS_OCL_ENV_DMA_SLICE_KB", &mmd_config::dma_slice_kb, nullptr, nullptr},
+    {"dma_normal_deadline_us", "OFS_OCL_ENV_DMA_NORMAL_DEADLINE_US", &mmd_config::dma_normal_deadline_us, nullptr, nullptr},
+    {"dma_normal_mbps", "OFS_OCL_ENV_DMA_NORMAL_MBPS", &mmd_config::dma_normal_mbps, nullptr, nullptr},
+    {"dma_high_mbps", "OFS_OCL_ENV_DMA_HIGH_MBPS", &mmd_config::dma_high_mbps, nullptr, nullptr},
+    {"copy_workers", "OFS_OCL_ENV_COPY_WORKERS", &mmd_config::copy_workers, nullptr, nullptr},
+    {"copy_parallel_kb", "OFS_OCL_ENV_COPY_PARALLEL_KB", &mmd_config::copy_parallel_kb, nullptr, nullptr},
+    {"copy_nt_kb", "OFS_OCL_ENV_COPY_NT_KB", &mmd_config::copy_nt_kb, nullptr, nullptr},
+    {"copy_isa", "OFS_OCL_ENV_COPY_ISA", nullptr, nullptr, &mmd_config::copy_isa},
+    {"staging_page_kb", "OFS_OCL_ENV_STAGING_PAGE_KB", &mmd_config::staging_page_kb, nullptr, nullptr},
+    {"copy_pipeline_buffers", "OFS_OCL_ENV_COPY_PIPELINE_BUFFERS", &mmd_config::copy_pipeline_buffers, nullptr, nullptr},
+    {"dma_device_copy", "OFS_OCL_ENV_DMA_DEVICE_COPY", &mmd_config::dma_device_copy, nullptr, nullptr},
+    {"pin_cache_mb", "OFS_OCL_ENV_PIN_CACHE_MB", &mmd_config::pin_cache_mb, nullptr, nullptr},
+    {"dma_pin_window_mb", "OFS_OCL_ENV_DMA_PIN_WINDOW_MB", &mmd_config::dma_pin_window_mb, nullptr, nullptr},
+    {"host_slab_max_kb", "OFS_OCL_ENV_HOST_SLAB_MAX_KB", &mmd_config::host_slab_max_kb, nullptr, nullptr},
+    {"host_slab_prewarm_mb", "OFS_OCL_ENV_HOST_SLAB_PREWARM_MB", &mmd_config::host_slab_prewarm_mb, nullptr, nullptr},
+    {"host_huge_1g_mb", "OFS_OCL_ENV_HOST_HUGE_1G_MB", &mmd_config::host_huge_1g_mb, nullptr, nullptr},
+    {"device_mem_banks", "OFS_OCL_ENV_DEVICE_MEM_BANKS", &mmd_config::device_mem_banks, nullptr, nullptr},
+    {"device_mem_bank_mb", "OFS_OCL_ENV_DEVICE_MEM_BANK_MB", &mmd_config::device_mem_bank_mb, nullptr, nullptr},
+    {"device_mem_interleaved", "OFS_OCL_ENV_DEVICE_MEM_INTERLEAVED", &mmd_config::device_mem_interleaved, nullptr, nullptr},
+    {"device_alloc_mb", "OFS_OCL_ENV_DEVICE_ALLOC_MB", &mmd_config::device_alloc_mb, nullptr, nullptr},
+    {"numa_enable", "MMD_ENABLE_NUMA", nullptr, &mmd_config::numa_enable, nullptr},
+    {"yield_delay", "MMD_YIELD_DELAY", nullptr, &mmd_config::yield_delay, nullptr},
+};
+
+static std::string trim(const std::string &s) {
+  size_t begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  size_t end = s.find_last_not_of(" \t\r");
+  return s.substr(begin, end - begin + 1);
+}
+
+/** set_value() parses value into the field of key, numbers may be given in
+ *  decimal or with a 0x prefix. Returns false and leaves the field alone
+ *  when the value does not parse.
+ */
+static bool set_value(mmd_config &config, const config_key &key,
+                      const std::string &value) {
+  if (key.str) {
+    config.*key.str = value;
+    return true;
+  }
+  if (value.empty()) {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  if (key.u64) {
+    if (value[0] == '-') {
+      return false;
+    }
+    uint64_t v = strtoull(value.c_str(), &end, 0);
+    if (errno != 0 || *end != '\0') {
+      return false;
+    }
+    config.*key.u64 = v;
+  } else {
+    int64_t v = strtoll(value.c_str(), &end, 0);
+    if (errno != 0 || *end != '\0') {
+      return false;
+    }
+    config.*key.i64 = v;
+  }
+  return true;
+}
+
+static const config_key *find_key(const std::string &name) {
+  for (const config_key &key : config_keys) {
+    if (name == key.name) {
+      return &key;
+    }
+  }
+  return nullptr;
+}
+
+/** apply_config_file() applies the global lines of the file and those of
+ *  every section named in sections. Sections are applied in the order given,
+ *  so later ones override earlier ones wherever they appear in the file.
+ */
+static void apply_config_file(mmd_config &config, const std::string &path,
+                              const std::vector<std::string> &sections) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return;
+  }
+
+  // Lines per section, the global part is section ""
+  std::vector<std::vector<std::pair<std::string, std::string>>> lines(sections.size() + 1);
+  std::string line;
+  int line_num = 0;
+  int section_index = 0; // index into lines, -1 for sections of other devices
+  while (std::getline(file, line)) {
+    line_num++;
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    if (line[0] == '[') {
+      std::string name = trim(line.substr(1, line.find(']') - 1));
+      section_index = -1;
+      for (size_t i = 0; i < sections.size(); i++) {
+        if (!sections[i].empty() && name == sections[i]) {
+          section_index = static_cast<int>(i) + 1;
+        }
+      }
+      continue;
+    }
+    size_t eq = line.find('=');
+    if (eq == std::string::npos) {
+      fprintf(stderr, "%s:%d: ignoring line without '='\n", path.c_str(), line_num);
+      continue;
+    }
+    if (section_index >= 0) {
+      lines[section_index].push_back(
+          std::make_pair(trim(line.substr(0, eq)), trim(line.substr(eq + 1))));
+    }
+  }
+
+  for (const auto &section : lines) {
+    for (const auto &kv : section) {
+      const config_key *key = find_key(kv.first);
+      if (key == nullptr) {
+        fprintf(stderr, "%s: ignoring unknown key '%s'\n", path.c_str(), kv.first.c_str());
+      } else if (!set_value(config, *key, kv.second)) {
+        fprintf(stderr, "%s: ignoring bad value '%s' for %s\n", path.c_str(),
+                kv.second.c_str(), kv.first.c_str());
+      }
+    }
+  }
+}
+
+mmd_config mmd_config::load(const std::string &board_name, const std::string &bdf) {
+  mmd_config config;
+  config.dma_copy_threshold = default_copy_threshold;
+  config.dma_calibrate = 0;
+  config.dma_staging_slots = 4;
+  config.dma_staging_slot_bytes = default_staging_slot_bytes;
+  config.dma_max_len = 0;
+  config.dma_max_inflight = intel_opae_mmd::dma_max_inflight;
+  config.dma_wait_h2f = "interrupt";
+  config.dma_wait_f2h = "spin";
+  config.dma_spin_us = 20;
+  config.dma_worker_spin_us = 50;
+  config.dma_coalesce_bytes = 0;
+  config.dma_inline_bytes = 0;
+  config.dma_stripe_mb = 0;
+  config.dma_slice_kb = 2048;
+  config.dma_normal_deadline_us = 1000;
+  config.dma_normal_mbps = 0;
+  config.dma_high_mbps = 0;
+  config.copy_workers = 0;
+  config.copy_parallel_kb = 1024;
+  config.copy_nt_kb = 1024;
+  config.copy_isa = "auto";
+  config.staging_page_kb = 2048;
+  config.copy_pipeline_buffers = 4;
+  config.dma_device_copy = 1;
+  config.pin_cache_mb = 0;
+  config.dma_pin_window_mb = 64;
+  config.host_slab_max_kb = 0;
+  config.host_slab_prewarm_mb = 0;
+  config.host_huge_1g_mb = 0;
+  config.device_mem_banks = 4;
+  config.device_mem_bank_mb = 4096;
+  config.device_mem_interleaved = 1;
+  config.device_alloc_mb = 0;
+  config.numa_enable = 1;
+  config.yield_delay = -1;
+
+  const char *path = getenv(config_file_env_var_name);
+  std::vector<std::string> sections = {board_type_section, board_name, bdf};
+  apply_config_file(config, path ? path : default_config_file, sections);
+
+  for (const config_key &key : config_keys) {
+    const char *env = getenv(key.env_var_name);
+    if (env != nullptr && !set_value(config, key, trim(env))) {
+      fprintf(stderr, "Ignoring bad value '%s' for %s\n", env, key.env_var_name);
+    }
+  }
+
+  // Keep the values the DMA relies on valid
+  if (config.dma_staging_slots < 2) {
+    config.dma_staging_slots = 2;
+  }
+  config.dma_staging_slot_bytes = (config.dma_staging_slot_bytes + 4095) & ~4095ULL;
+  if (config.dma_staging_slot_bytes == 0) {
+    config.dma_staging_slot_bytes = default_staging_slot_bytes;
+  }
+  if (config.copy_pipeline_buffers < 2) {
+    config.copy_pipeline_buffers = 2;
+  }
+  if (config.dma_max_len % 64 != 0) {
+    config.dma_max_len = 0;
+  }
+  if (config.dma_max_inflight < 1 || config.dma_max_inflight > intel_opae_mmd::dma_max_inflight) {
+    config.dma_max_inflight = intel_opae_mmd::dma_max_inflight;
+  }
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE | MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : MMD configuration %s : %s\n", board_name.c_str(), config.to_string().c_str());
+  }
+  return config;
+}
+
+std::string mmd_config::to_string() const {
+  std::ostringstream out;
+  const char *sep = "";
+  for (const config_key &key : config_keys) {
+    out << sep << key.name << "=";
+    if (key.u64) {
+      out << this->*key.u64;
+    } else if (key.i64) {
+      out << this->*key.i64;
+    } else {
+      out << this->*key.str;
+    }
+    sep = ";";
+  }
+  return out.str();
+}
+
+}; // namespace intel_opae_mmd
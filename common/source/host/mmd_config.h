@@ -0,0 +1,151 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_CONFIG_H_
+#define MMD_CONFIG_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace intel_opae_mmd {
+
+/** Tuning knobs of the MMD, resolved once per device.
+ *
+ *  Values come from, in increasing priority: the built-in defaults, the
+ *  global part of the configuration file, its section for the board type
+ *  ([n6001] or [d5005]), its section for the device (by PCIe address such as
+ *  [3b:00.0], or by board name), and finally the environment. The file is
+ *  MMD_CONFIG_FILE, or /etc/opae/oneapi-asp.conf when that is not set, and
+ *  holds "key = value" lines; '#' starts a comment. Keys are the field
+ *  names below, each one can also be set with the environment variable
+ *  listed next to it. The defaults keep the behaviour of earlier releases:
+ *  the pin cache, inline transfers, striping, copy workers, host slabs and
+ *  automatic 1GB pages are off until configured.
+ */
+struct mmd_config {
+  // Host buffers up to this size are copied through the staging slots
+  // instead of being pinned (OFS_OCL_ENV_DMA_THRESHOLD)
+  uint64_t dma_copy_threshold;
+  // 1 to measure the host and DMA at open time and pick the copy threshold
+  // and staging chunk size of each direction from that, replacing
+  // dma_copy_threshold (OFS_OCL_ENV_DMA_CALIBRATE)
+  uint64_t dma_calibrate;
+  // Pinned staging slots per DMA direction, at least 2
+  // (OFS_OCL_ENV_DMA_STAGING_SLOTS)
+  uint64_t dma_staging_slots;
+  // Size of each staging slot, a multiple of 4KB
+  // (OFS_OCL_ENV_DMA_STAGING_BYTES)
+  uint64_t dma_staging_slot_bytes;
+  // Longest fpga->host descriptor, a multiple of 64, 0 for no limit
+  // (OFS_OCL_ENV_DMA_MAX_LEN)
+  uint64_t dma_max_len;
+  // Descriptors in flight per direction, capped by the hardware queue
+  // (OFS_OCL_ENV_DMA_MAX_INFLIGHT)
+  uint64_t dma_max_inflight;
+  // Completion wait policy: spin, umwait, hybrid or interrupt
+  // (OFS_OCL_ENV_DMA_WAIT_H2F, OFS_OCL_ENV_DMA_WAIT_F2H)
+  std::string dma_wait_h2f;
+  std::string dma_wait_f2h;
+  // Spin time of the hybrid wait policy (OFS_OCL_ENV_DMA_SPIN_US)
+  uint64_t dma_spin_us;
+  // Spin time of the DMA work thread before it parks
+  // (OFS_OCL_ENV_DMA_WORKER_SPIN_US)
+  uint64_t dma_worker_spin_us;
+  // Largest async transfer merged with its neighbours, 0 disables
+  // coalescing (OFS_OCL_ENV_DMA_COALESCE_BYTES)
+  uint64_t dma_coalesce_bytes;
+  // Largest normal priority async transfer run on the caller's thread
+  // instead of the DMA work thread when nothing else is queued and no
+  // bandwidth cap is set, 0 always queues
+  // (OFS_OCL_ENV_DMA_INLINE_BYTES)
+  uint64_t dma_inline_bytes;
+  // Smallest transfer striped over several DMA engines, 0 disables striping
+  // (OFS_OCL_ENV_DMA_STRIPE_MB)
+  uint64_t dma_stripe_mb;
+  // Normal priority async transfers longer than this are sent in slices so
+  // high priority ones can go in between, 0 disables slicing
+  // (OFS_OCL_ENV_DMA_SLICE_KB)
+  uint64_t dma_slice_kb;
+  // Longest normal priority transfers are held back by high priority ones,
+  // 0 for no limit (OFS_OCL_ENV_DMA_NORMAL_DEADLINE_US)
+  uint64_t dma_normal_deadline_us;
+  // Bandwidth cap per direction of each priority class in MB/s, 0 for no cap
+  // (OFS_OCL_ENV_DMA_NORMAL_MBPS, OFS_OCL_ENV_DMA_HIGH_MBPS)
+  uint64_t dma_normal_mbps;
+  uint64_t dma_high_mbps;
+  // Worker threads that help copy large transfers into and out of the
+  // staging slots, 0 copies on the DMA thread only (OFS_OCL_ENV_COPY_WORKERS)
+  uint64_t copy_workers;
+  // Smallest copy split across the copy workers (OFS_OCL_ENV_COPY_PARALLEL_KB)
+  uint64_t copy_parallel_kb;
+  // Smallest copy written with non-temporal stores, bypassing the cache
+  // (OFS_OCL_ENV_COPY_NT_KB)
+  uint64_t copy_nt_kb;
+  // Instruction set of the staging copies: auto for the widest the CPU has,
+  // or sse2, avx2 or avx512 to cap it (OFS_OCL_ENV_COPY_ISA)
+  std::string copy_isa;
+  // Page size of the staging memory in KB: 1048576 for 1GB hugepages, 2048
+  // for 2MB hugepages, anything else for normal pages. Falls back to smaller
+  // pages when none are reserved (OFS_OCL_ENV_STAGING_PAGE_KB)
+  uint64_t staging_page_kb;
+  // Host buffers cycled by aocl_mmd_copy, at least 2 so reading one chunk
+  // overlaps writing the previous one (OFS_OCL_ENV_COPY_PIPELINE_BUFFERS)
+  uint64_t copy_pipeline_buffers;
+  // 1 to let aocl_mmd_copy use the device-to-device copy channel of the DMA
+  // when the bitstream has one, 0 always copies through host memory
+  // (OFS_OCL_ENV_DMA_DEVICE_COPY)
+  uint64_t dma_device_copy;
+  // Budget of the pinned region cache, 0 disables it. Off by default, unmap
+  // notifications can arrive after the range was reused, see pin_cache
+  // (OFS_OCL_ENV_PIN_CACHE_MB)
+  uint64_t pin_cache_mb;
+  // Host buffers larger than this that are not pinned yet are pinned and
+  // sent a window at a time, 0 pins the whole buffer
+  // (OFS_OCL_ENV_DMA_PIN_WINDOW_MB)
+  uint64_t dma_pin_window_mb;
+  // Host and shared allocations up to this size are carved out of pinned
+  // slab arenas instead of being mapped and pinned one by one, 0 disables
+  // the slabs (OFS_OCL_ENV_HOST_SLAB_MAX_KB)
+  uint64_t host_slab_max_kb;
+  // Slab arena memory mapped and pinned when the device is opened
+  // (OFS_OCL_ENV_HOST_SLAB_PREWARM_MB)
+  uint64_t host_slab_prewarm_mb;
+  // Host and shared allocations of at least this size are backed with 1GB
+  // hugepages, falling back to 2MB and then normal pages when none are
+  // reserved; 0 uses 1GB pages only on request (OFS_OCL_ENV_HOST_HUGE_1G_MB)
+  uint64_t host_huge_1g_mb;
+  // Memory banks of the board and the size of each, banks are this far
+  // apart in the device address space
+  // (OFS_OCL_ENV_DEVICE_MEM_BANKS, OFS_OCL_ENV_DEVICE_MEM_BANK_MB)
+  uint64_t device_mem_banks;
+  uint64_t device_mem_bank_mb;
+  // 0 when the kernel system is compiled without memory interleaving, the
+  // board_spec.xml default is interleaved. Device allocations are only
+  // supported with interleaving off (OFS_OCL_ENV_DEVICE_MEM_INTERLEAVED)
+  uint64_t device_mem_interleaved;
+  // Top of every bank that aocl_mmd_device_alloc() hands out, it must be
+  // kept clear of the buffers the runtime places itself; 0 leaves device
+  // allocations unsupported (OFS_OCL_ENV_DEVICE_ALLOC_MB)
+  uint64_t device_alloc_mb;
+  // 1 to bind DMA threads and buffers to the NUMA node of the card
+  // (MMD_ENABLE_NUMA)
+  int64_t numa_enable;
+  // Kernel interrupt handling, process wide since the runtime asks before
+  // opening a device: < -1 interrupts, -1 yield, >= 0 yield and sleep this
+  // many us (MMD_YIELD_DELAY)
+  int64_t yield_delay;
+
+  /** Resolves the configuration of one device. board_name and bdf select
+   *  the device section of the file, pass empty strings for settings that
+   *  are not tied to a device.
+   */
+  static mmd_config load(const std::string &board_name, const std::string &bdf);
+
+  // Effective values as "key=value" pairs separated by ';'
+  std::string to_string() const;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_CONFIG_H_
@@ -0,0 +1,315 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <numa.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <system_error>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "mmd_copy.h"
+
+namespace intel_opae_mmd {
+
+typedef void (*stream_copy_fn)(char *dst, const char *src, size_t len);
+
+#if defined(__x86_64__)
+/** The stream_copy_* functions copy the unaligned head with memcpy, stream
+ *  four vectors per iteration to the now aligned destination and copy the
+ *  tail with memcpy again. The sfence orders the streaming stores before
+ *  anything the caller does next, e.g. starting a DMA from the buffer.
+ */
+static void stream_copy_sse2(char *dst, const char *src, size_t len) {
+  size_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+  head = std::min(head, len);
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  len -= head;
+  for (; len >= 64; len -= 64, dst += 64, src += 64) {
+    const __m128i *s = reinterpret_cast<const __m128i *>(src);
+    __m128i *d = reinterpret_cast<__m128i *>(dst);
+    __m128i v0 = _mm_loadu_si128(s);
+    __m128i v1 = _mm_loadu_si128(s + 1);
+    __m128i v2 = _mm_loadu_si128(s + 2);
+    __m128i v3 = _mm_loadu_si128(s + 3);
+    _mm_stream_si128(d, v0);
+    _mm_stream_si128(d + 1, v1);
+    _mm_stream_si128(d + 2, v2);
+    _mm_stream_si128(d + 3, v3);
+  }
+  memcpy(dst, src, len);
+  _mm_sfence();
+}
+
+__attribute__((target("avx2"))) static void stream_copy_avx2(char *dst, const char *src, size_t len) {
+  size_t head = (32 - (reinterpret_cast<uintptr_t>(dst) & 31)) & 31;
+  head = std::min(head, len);
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  len -= head;
+  for (; len >= 128; len -= 128, dst += 128, src += 128) {
+    const __m256i *s = reinterpret_cast<const __m256i *>(src);
+    __m256i *d = reinterpret_cast<__m256i *>(dst);
+    __m256i v0 = _mm256_loadu_si256(s);
+    __m256i v1 = _mm256_loadu_si256(s + 1);
+    __m256i v2 = _mm256_loadu_si256(s + 2);
+    __m256i v3 = _mm256_loadu_si256(s + 3);
+    _mm256_stream_si256(d, v0);
+    _mm256_stream_si256(d + 1, v1);
+    _mm256_stream_si256(d + 2, v2);
+    _mm256_stream_si256(d + 3, v3);
+  }
+  memcpy(dst, src, len);
+  _mm_sfence();
+}
+
+__attribute__((target("avx512f"))) static void stream_copy_avx512(char *dst, const char *src, size_t len) {
+  size_t head = (64 - (reinterpret_cast<uintptr_t>(dst) & 63)) & 63;
+  head = std::min(head, len);
+  memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  len -= head;
+  for (; len >= 256; len -= 256, dst += 256, src += 256) {
+    __m512i v0 = _mm512_loadu_si512(src);
+    __m512i v1 = _mm512_loadu_si512(src + 64);
+    __m512i v2 = _mm512_loadu_si512(src + 128);
+    __m512i v3 = _mm512_loadu_si512(src + 192);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst), v0);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 64), v1);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 128), v2);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 192), v3);
+  }
+  memcpy(dst, src, len);
+  _mm_sfence();
+}
+
+// detect_copy_isa() picks the widest instruction set the CPU supports
+static copy_isa detect_copy_isa() {
+  __builtin_cpu_init();
+  copy_isa isa = copy_isa::sse2;
+  if (__builtin_cpu_supports("avx512f")) {
+    isa = copy_isa::avx512;
+  } else if (__builtin_cpu_supports("avx2")) {
+    isa = copy_isa::avx2;
+  }
+  return isa;
+}
+
+static const copy_isa g_copy_isa = detect_copy_isa();
+
+static stream_copy_fn stream_copy_impl(copy_isa isa) {
+  switch (isa) {
+  case copy_isa::avx512:
+    return stream_copy_avx512;
+  case copy_isa::avx2:
+    return stream_copy_avx2;
+  default:
+    return stream_copy_sse2;
+  }
+}
+#else
+static const copy_isa g_copy_isa = copy_isa::sse2;
+
+static void stream_copy_memcpy(char *dst, const char *src, size_t len) {
+  memcpy(dst, src, len);
+}
+
+static stream_copy_fn stream_copy_impl(copy_isa) { return stream_copy_memcpy; }
+#endif
+
+copy_isa stream_copy_isa() { return g_copy_isa; }
+
+/** copy_isa_from_name() only ever narrows the instruction set, e.g. to
+ *  compare them or to avoid AVX-512 frequency drops on older Xeons.
+ */
+copy_isa copy_isa_from_name(const std::string &name) {
+  if (name == "sse2") {
+    return copy_isa::sse2;
+  }
+  if (name == "avx2" && g_copy_isa == copy_isa::avx512) {
+    return copy_isa::avx2;
+  }
+  return g_copy_isa;
+}
+
+const char *copy_isa_name(copy_isa isa) {
+  switch (isa) {
+  case copy_isa::avx512:
+    return "avx512";
+  case copy_isa::avx2:
+    return "avx2";
+  default:
+    return "sse2";
+  }
+}
+
+void stream_copy(void *dst, const void *src, size_t len, uint64_t nt_min_bytes,
+                 copy_isa isa) {
+  if (len < nt_min_bytes) {
+    memcpy(dst, src, len);
+    return;
+  }
+  stream_copy_impl(isa)(static_cast<char *>(dst), static_cast<const char *>(src), len);
+}
+
+void stream_copy(void *dst, const void *src, size_t len, uint64_t nt_min_bytes) {
+  stream_copy(dst, src, len, nt_min_bytes, g_copy_isa);
+}
+
+copy_engine::copy_engine(unsigned num_workers, uint64_t parallel_min_bytes,
+                         uint64_t nt_min_bytes, int numa_node, copy_isa isa)
+    : m_parallel_min_bytes(parallel_min_bytes), m_nt_min_bytes(nt_min_bytes),
+      m_numa_node(numa_node), m_isa(isa), m_stopping(false) {
+  if (m_parallel_min_bytes == 0) {
+    num_workers = 0;
+  }
+  for (unsigned i = 0; i < num_workers; i++) {
+    try {
+      m_workers.push_back(new std::thread(&copy_engine::worker_thread, this));
+    } catch (const std::system_error &e) {
+      // Fewer workers only costs copy bandwidth
+      fprintf(stderr, "Copy engine started %u of %u worker threads: %s\n", i,
+              num_workers, e.what());
+      break;
+    }
+  }
+}
+
+copy_engine::~copy_engine() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_work_cv.notify_all();
+  for (std::thread *worker : m_workers) {
+    worker->join();
+    delete worker;
+  }
+}
+
+/** claim_piece() hands out the next piece of j, the job leaves the queue
+ *  once its last piece is claimed. Called with m_mutex held.
+ */
+bool copy_engine::claim_piece(job &j, size_t &piece) {
+  if (j.next_piece == j.num_pieces) {
+    return false;
+  }
+  piece = j.next_piece++;
+  if (j.next_piece == j.num_pieces) {
+    m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &j));
+  }
+  return true;
+}
+
+void copy_engine::copy_piece(const job &j, size_t piece) {
+  size_t offset = piece * j.piece_len;
+  size_t len = std::min(j.piece_len, j.len - offset);
+  if (j.src == nullptr) {
+    for (size_t page = 0; page < len; page += j.page_len) {
+      *static_cast<volatile char *>(j.dst + offset + page) = 0;
+    }
+    return;
+  }
+  // Streaming is decided for the whole copy, not per piece
+  stream_copy(j.dst + offset, j.src + offset, len,
+              j.len >= m_nt_min_bytes ? 0 : UINT64_MAX, m_isa);
+}
+
+void copy_engine::worker_thread() {
+  if (m_numa_node >= 0 && numa_run_on_node(m_numa_node) != 0) {
+    fprintf(stderr, "Copy engine could not bind a worker to NUMA node %d\n", m_numa_node);
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_work_cv.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+    if (m_stopping) {
+      return;
+    }
+    job *j = m_jobs.front();
+    size_t piece;
+    if (!claim_piece(*j, piece)) {
+      continue;
+    }
+    lock.unlock();
+    copy_piece(*j, piece);
+    lock.lock();
+    if (++j->done_pieces == j->num_pieces) {
+      m_done_cv.notify_all();
+    }
+  }
+}
+
+/** copy() splits the copy into one piece per worker plus one for the
+ *  caller, who copies pieces too and returns once all of them are done.
+ *  Pieces are large, so claiming them under the mutex costs nothing
+ *  measurable.
+ */
+void copy_engine::copy(void *dst, const void *src, size_t len) {
+  if (m_workers.empty() || len < m_parallel_min_bytes) {
+    stream_copy(dst, src, len, m_nt_min_bytes, m_isa);
+    return;
+  }
+
+  job j;
+  j.dst = static_cast<char *>(dst);
+  j.src = static_cast<const char *>(src);
+  j.page_len = 0;
+  j.len = len;
+  run(j, 4096);
+}
+
+/** prefault() spreads the page faults of a new mapping over the workers, so
+ *  zeroing a multi-GB allocation does not run on the allocating thread
+ *  alone. Pieces hold whole pages.
+ */
+void copy_engine::prefault(void *addr, size_t len, size_t page_len) {
+  job j;
+  j.dst = static_cast<char *>(addr);
+  j.src = nullptr;
+  j.page_len = page_len;
+  j.len = len;
+  if (m_workers.empty() || len <= page_len) {
+    j.piece_len = len;
+    copy_piece(j, 0);
+    return;
+  }
+  run(j, page_len);
+}
+
+/** run() splits j into one piece per worker plus one for the caller, aligned
+ *  to piece_align, and returns once all of them are done.
+ */
+void copy_engine::run(job &j, size_t piece_align) {
+  size_t num_pieces = m_workers.size() + 1;
+  size_t piece_len = (j.len + num_pieces - 1) / num_pieces;
+  piece_len = (piece_len + piece_align - 1) & ~(piece_align - 1);
+
+  j.piece_len = piece_len;
+  j.num_pieces = (j.len + piece_len - 1) / piece_len;
+  j.next_piece = 0;
+  j.done_pieces = 0;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_jobs.push_back(&j);
+  m_work_cv.notify_all();
+  size_t piece;
+  while (claim_piece(j, piece)) {
+    lock.unlock();
+    copy_piece(j, piece);
+    lock.lock();
+    j.done_pieces++;
+  }
+  m_done_cv.wait(lock, [&j] { return j.done_pieces == j.num_pieces; });
+}
+
+}; // namespace intel_opae_mmd
@@ -0,0 +1,97 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_COPY_H_
+#define MMD_COPY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace intel_opae_mmd {
+
+// Instruction set used by stream_copy()
+enum class copy_isa { sse2, avx2, avx512 };
+
+// Widest instruction set of the CPU, picked once at load time
+copy_isa stream_copy_isa();
+// sse2, avx2 or avx512 capped at what the CPU supports, anything else (e.g.
+// "auto") is the widest
+copy_isa copy_isa_from_name(const std::string &name);
+const char *copy_isa_name(copy_isa isa);
+
+/** stream_copy() copies len bytes like memcpy, but copies of at least
+ *  nt_min_bytes are written with non-temporal stores so they do not evict
+ *  the last level cache. Meant for data only the DMA or the application will
+ *  touch next, such as staging slots. nt_min_bytes of 0 always streams,
+ *  UINT64_MAX never does.
+ */
+void stream_copy(void *dst, const void *src, size_t len, uint64_t nt_min_bytes,
+                 copy_isa isa);
+// Same with the widest instruction set of the CPU
+void stream_copy(void *dst, const void *src, size_t len, uint64_t nt_min_bytes);
+
+/** Copy engine for the DMA staging paths.
+ *
+ *  Copies of at least parallel_min_bytes are split into 4KB aligned pieces
+ *  that the calling thread and a small pool of worker threads copy with
+ *  stream_copy(). The workers are bound to numa_node so they run next to
+ *  the staging memory and the card; a negative node leaves them unbound.
+ *  The same workers fault in new host allocations with prefault().
+ *  copy() and prefault() may be called from any number of threads at once.
+ */
+class copy_engine final {
+public:
+  copy_engine(unsigned num_workers, uint64_t parallel_min_bytes,
+              uint64_t nt_min_bytes, int numa_node, copy_isa isa);
+  ~copy_engine();
+
+  void copy(void *dst, const void *src, size_t len);
+  // Writes the first byte of every page_len page of [addr, addr + len)
+  void prefault(void *addr, size_t len, size_t page_len);
+
+  unsigned num_workers() const { return static_cast<unsigned>(m_workers.size()); }
+  copy_isa isa() const { return m_isa; }
+
+  copy_engine(const copy_engine &) = delete;
+  copy_engine &operator=(const copy_engine &) = delete;
+
+private:
+  struct job {
+    char *dst;
+    const char *src; // nullptr to fault in dst instead of copying
+    size_t page_len;
+    size_t len;
+    size_t piece_len;
+    size_t num_pieces;
+    size_t next_piece; // protected by m_mutex
+    size_t done_pieces; // protected by m_mutex
+  };
+
+  void worker_thread();
+  void run(job &j, size_t piece_align);
+  bool claim_piece(job &j, size_t &piece);
+  void copy_piece(const job &j, size_t piece);
+
+  uint64_t m_parallel_min_bytes;
+  uint64_t m_nt_min_bytes;
+  int m_numa_node;
+  copy_isa m_isa;
+  std::vector<std::thread *> m_workers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+  std::deque<job *> m_jobs; // jobs with unclaimed pieces
+  bool m_stopping;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_COPY_H_
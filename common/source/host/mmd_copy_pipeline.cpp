@@ -0,0 +1,166 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "mmd_copy_pipeline.h"
+#include "mmd_device.h"
+
+namespace intel_opae_mmd {
+
+// Size of one chunk and of each pipeline buffer
+static const uint64_t copy_chunk_bytes = 2 * 1024 * 1024;
+
+copy_pipeline::copy_pipeline(dma_engine_set *f2h, dma_engine_set *h2f,
+                             staging_pool *pool, mmd_dma *device_copier,
+                             uint64_t num_buffers, completion_fn done)
+    : m_f2h(f2h), m_h2f(h2f), m_pool(pool), m_device_copier(device_copier),
+      m_num_buffers(std::max<uint64_t>(num_buffers, 2)), m_done(done),
+      m_thread(nullptr), m_stopping(false) {}
+
+copy_pipeline::~copy_pipeline() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_work_cv.notify_one();
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+  }
+}
+
+int copy_pipeline::copy(aocl_mmd_op_t op, size_t src_addr, size_t dst_addr,
+                        size_t size) {
+  if (op == nullptr) {
+    return run(src_addr, dst_addr, size);
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_thread == nullptr) {
+    try {
+      m_thread = new std::thread([this] { this->work_thread(); });
+    } catch (const std::system_error &e) {
+      fprintf(stderr, "Error starting the device copy thread: %s\n", e.what());
+      return -1;
+    }
+  }
+  job j = {op, src_addr, dst_addr, size};
+  m_jobs.push_back(j);
+  m_work_cv.notify_one();
+  return 0;
+}
+
+/** work_thread() runs queued copies in the order they were queued, and
+ *  finishes whatever is left before it exits.
+ */
+void copy_pipeline::work_thread() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_work_cv.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+    if (m_jobs.empty()) {
+      return;
+    }
+    job j = m_jobs.front();
+    m_jobs.pop_front();
+    lock.unlock();
+    int status = run(j.src_addr, j.dst_addr, j.size);
+    m_done(j.op, status);
+    lock.lock();
+  }
+}
+
+/** run() copies one range, on the card when the copy channel can take it
+ */
+int copy_pipeline::run(size_t src_addr, size_t dst_addr, size_t size) {
+  const uint64_t align = mmd_dma::device_copy_align;
+  if (m_device_copier && ((src_addr | dst_addr | size) % align) == 0) {
+    return m_device_copier->device_copy(src_addr, dst_addr, size);
+  }
+  return run_through_host(src_addr, dst_addr, size);
+}
+
+/** run_through_host() copies one range through host buffers. Iteration k writes chunk k-1 once it has been
+ *  read, then reads chunk k into its buffer once the write that last used
+ *  that buffer is done; the read of chunk k and the write of chunk k-1 are
+ *  then in flight together. Overlapping ranges keep the old one chunk at a
+ *  time order, so a chunk is never read while an earlier one is written.
+ *  Every transfer has completed when it returns, also on error.
+ */
+int copy_pipeline::run_through_host(size_t src_addr, size_t dst_addr, size_t size) {
+  const bool overlap = src_addr < dst_addr + size && dst_addr < src_addr + size;
+  const uint64_t num_chunks = (size + copy_chunk_bytes - 1) / copy_chunk_bytes;
+  const uint64_t depth = overlap ? 1 : std::min<uint64_t>(m_num_buffers, std::max<uint64_t>(num_chunks, 1));
+
+  std::vector<void *> buffers;
+  for (uint64_t i = 0; i < depth; i++) {
+    void *buffer = m_pool->get(copy_chunk_bytes);
+    if (buffer == nullptr) {
+      for (void *b : buffers) {
+        m_pool->put(b, copy_chunk_bytes);
+      }
+      return -1;
+    }
+    buffers.push_back(buffer);
+  }
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : DMA ---- copy 0x%zx -> 0x%zx , size 0x%zx , chunks %ld , buffers %ld\n",
+              src_addr, dst_addr, size, num_chunks, depth);
+  }
+
+  std::vector<std::unique_ptr<dma_completion_group>> reads(depth);
+  std::vector<std::unique_ptr<dma_completion_group>> writes(depth);
+  int status = 0;
+  auto finish = [&status](std::unique_ptr<dma_completion_group> &group) {
+    if (group) {
+      int s = group->wait();
+      if (s != 0 && status == 0) {
+        status = s;
+      }
+      group.reset();
+    }
+  };
+  auto chunk_len = [&](uint64_t k) {
+    return std::min<uint64_t>(copy_chunk_bytes, size - k * copy_chunk_bytes);
+  };
+
+  for (uint64_t k = 0; k <= num_chunks && status == 0; k++) {
+    if (k > 0) {
+      uint64_t prev = (k - 1) % depth;
+      finish(reads[prev]);
+      if (status != 0) {
+        break;
+      }
+      writes[prev].reset(new dma_completion_group(nullptr, 1));
+      m_h2f->transfer_piece(writes[prev].get(), buffers[prev],
+                            dst_addr + (k - 1) * copy_chunk_bytes, chunk_len(k - 1),
+                            dma_priority::normal);
+    }
+    if (k < num_chunks) {
+      uint64_t slot = k % depth;
+      finish(writes[slot]);
+      if (status != 0) {
+        break;
+      }
+      reads[slot].reset(new dma_completion_group(nullptr, 1));
+      m_f2h->transfer_piece(reads[slot].get(), buffers[slot],
+                            src_addr + k * copy_chunk_bytes, chunk_len(k),
+                            dma_priority::normal);
+    }
+  }
+
+  for (uint64_t i = 0; i < depth; i++) {
+    finish(reads[i]);
+    finish(writes[i]);
+    m_pool->put(buffers[i], copy_chunk_bytes);
+  }
+  return status;
+}
+
+}; // namespace intel_opae_mmd
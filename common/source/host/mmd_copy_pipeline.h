@@ -0,0 +1,76 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_COPY_PIPELINE_H_
+#define MMD_COPY_PIPELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "aocl_mmd.h"
+#include "mmd_dma_engines.h"
+#include "mmd_staging_pool.h"
+
+namespace intel_opae_mmd {
+
+/** Device to device copies for aocl_mmd_copy().
+ *
+ *  When the DMA has a copy channel (device_copier is not null) aligned copies
+ *  go to it and stay on the card. Everything else goes through host memory:
+ *  the copy is split in chunks that cycle through num_buffers pinned host
+ *  buffers from the staging pool: fpga->host reads chunk k into one buffer
+ *  while host->fpga writes chunk k-1 out of another, so both DMA directions
+ *  are busy at once. Copies with an op are queued to a work thread and the
+ *  caller returns straight away; done(op, status) reports them when the
+ *  copy is done. Copies without an op run on the caller's thread.
+ */
+class copy_pipeline final {
+public:
+  typedef std::function<void(aocl_mmd_op_t op, int status)> completion_fn;
+
+  copy_pipeline(dma_engine_set *f2h, dma_engine_set *h2f, staging_pool *pool,
+                mmd_dma *device_copier, uint64_t num_buffers, completion_fn done);
+  // Finishes the queued copies first
+  ~copy_pipeline();
+
+  // src_addr and dst_addr are DMA addresses, like those of the engine sets
+  int copy(aocl_mmd_op_t op, size_t src_addr, size_t dst_addr, size_t size);
+
+  copy_pipeline(const copy_pipeline &) = delete;
+  copy_pipeline &operator=(const copy_pipeline &) = delete;
+
+private:
+  struct job {
+    aocl_mmd_op_t op;
+    size_t src_addr;
+    size_t dst_addr;
+    size_t size;
+  };
+
+  int run(size_t src_addr, size_t dst_addr, size_t size);
+  int run_through_host(size_t src_addr, size_t dst_addr, size_t size);
+  void work_thread();
+
+  dma_engine_set *m_f2h;
+  dma_engine_set *m_h2f;
+  staging_pool *m_pool;
+  mmd_dma *m_device_copier; // nullptr without a copy channel
+  uint64_t m_num_buffers;
+  completion_fn m_done;
+
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::deque<job> m_jobs;
+  std::thread *m_thread; // started by the first queued copy
+  bool m_stopping;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_COPY_PIPELINE_H_
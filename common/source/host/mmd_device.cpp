@@ -19,12 +19,16 @@
 // TODO: better encapsulation of afu_bbb_util functions
 #include "afu_bbb_util.h"
 
-#define MMD_COPY_BUFFER_SIZE (2 * 1024 * 1024)
 
 using namespace intel_opae_mmd;
 
 int Device::next_mmd_handle{1};
 
+// Transfer priority of the calling thread per device handle, only handles
+// set to something other than normal are listed. A thread rarely uses more
+// than a device or two, so a short list does.
+static thread_local std::vector<std::pair<int, dma_priority>> thread_priorities;
+
 std::string Device::get_board_name(std::string prefix, uint64_t obj_id) {
   std::ostringstream stream;
   stream << prefix << std::setbase(16) << obj_id;
@@ -40,17 +44,21 @@ std::string Device::get_board_name(std::string prefix, uint64_t obj_id) {
  */
 Device::Device(uint64_t obj_id)
     : fpga_obj_id(obj_id), kernel_interrupt_thread(NULL), event_update(NULL),
-      event_update_user_data(NULL), enable_set_numa(false),
+      event_update_user_data(NULL), h2f_calibrated(false),
+      f2h_calibrated(false), h2f_calibration(), f2h_calibration(),
+      enable_set_numa(false),
       fme_sysfs_temp_initialized(false), bus(0), device(0), function(0),
       afu_initialized(false), asp_initialized(false), mmio_is_mapped(false),
       port_handle(NULL), filter(NULL), port_token(NULL),
       mmio_token(NULL), mmio_handle(NULL),
       filter_fme(NULL), fme_token(NULL), guid(), ddr_offset(0), mpf_mmio_offset(0),
-      dma_ch0_dfh_offset(0), dma_ch1_dfh_offset(0), iopipes_dfh_offset(0),
-      dma_host_to_fpga(NULL), dma_fpga_to_host(NULL), io_pipes(NULL), mmd_copy_buffer(NULL) {
+      iopipes_dfh_offset(0),
+      dma_host_to_fpga(NULL), dma_fpga_to_host(NULL), pinned_regions(NULL),
+      dma_copy_engine(NULL), dma_staging_pool(NULL), dma_device_copy(NULL), dma_copies(NULL),
+      io_pipes(NULL), device_mem(NULL) {
   // Note that this constructor is not thread-safe because next_mmd_handle
   // is shared between all class instances
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Constructing Device object\n");
   }
   mmd_handle = next_mmd_handle;
@@ -59,12 +67,6 @@ Device::Device(uint64_t obj_id)
   else
     next_mmd_handle++;
 
-  int pma_res = posix_memalign((void **)&mmd_copy_buffer, 64, MMD_COPY_BUFFER_SIZE);
-  if (pma_res) {
-    throw std::runtime_error(std::string("posix_memalign failed for mmd_copy_buffer")
-    + std::string(strerror(pma_res)));
-  }
-
   /** Initializing filter list for DFL and VFIO
    *  filters are used in OPAE API fpgaPropertiesSetInterface()
    *  which helps in enumeration
@@ -79,7 +81,7 @@ Device::Device(uint64_t obj_id)
   fpga_properties props = nullptr;
 
   board_type=BOARD_TYPE;
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     if(board_type == 1){
       DEBUG_LOG("DEBUG LOG : board_type = %d , n6001 board\n", board_type);
     }else{
@@ -110,7 +112,7 @@ Device::Device(uint64_t obj_id)
   if (num_matches < 1) {
     fpgaDestroyProperties(&filter); 
     LOG_ERR("Error creating properties object: %s\n", fpgaErrStr(res));
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error creating properties object: %s\n", fpgaErrStr(res));
     }
     throw std::runtime_error("DFL device not found");
@@ -205,13 +207,13 @@ Device::Device(uint64_t obj_id)
   }
 
   LOG_ERR("num_matches = %d\n", num_matches); 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : num_matches = %d\n", num_matches);
   }
   if (num_matches < 1) {
     fpgaDestroyProperties(&filter); 
     LOG_ERR("Error creating properties object: %s\n", fpgaErrStr(res));
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : DFL device not found\n");
     }
     throw std::runtime_error("DFL device not found");
@@ -243,7 +245,7 @@ Device::Device(uint64_t obj_id)
   // value.
   if (uuid_parse(SVM_ASP_AFU_ID, svm_guid) < 0) {
     LOG_ERR("Error parsing guid '%s'\n", SVM_ASP_AFU_ID);
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error parsing guid '%s'\n", SVM_ASP_AFU_ID);
     }
   }
@@ -264,12 +266,28 @@ Device::Device(uint64_t obj_id)
     mpf_mmio_offset = SVM_MMD_MPF;
   }
 
+  mmd_dev_name = get_board_name(ASP_NAME, obj_id);
+  config = mmd_config::load(mmd_dev_name, get_bdf());
+  if (config.device_alloc_mb && config.device_mem_banks && config.device_mem_bank_mb) {
+    // The allocator maps bank i to the i-th bank_mb of the address space,
+    // which is only where the kernel looks when interleaving is off
+    if (config.device_mem_interleaved) {
+      LOG_ERR("device_alloc_mb needs device_mem_interleaved=0, device allocations are disabled\n");
+    } else if (config.device_alloc_mb >= config.device_mem_bank_mb) {
+      LOG_ERR("device_alloc_mb %lu leaves no memory in the %lu MB banks for the runtime, device allocations are disabled\n",
+              config.device_alloc_mb, config.device_mem_bank_mb);
+    } else {
+      device_mem = new device_mem_allocator(static_cast<unsigned>(config.device_mem_banks),
+                                            config.device_mem_bank_mb * 1024 * 1024,
+                                            config.device_alloc_mb * 1024 * 1024);
+    }
+  }
+
   initialize_fme_sysfs();
 
   mpf_handle = nullptr;
-  mmd_dev_name = get_board_name(ASP_NAME, obj_id);
   afu_initialized = true;
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Done constructing Device object\n");
   }
 }
@@ -279,7 +297,7 @@ Device::Device(uint64_t obj_id)
  */
 bool Device::parse_board_name(const char *board_name_str,
                                   uint64_t &obj_id) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Parsing board name\n");
   }
   std::string prefix(ASP_NAME);
@@ -289,7 +307,7 @@ bool Device::parse_board_name(const char *board_name_str,
   if (board_name.length() <= prefix.length() &&
       board_name.compare(0, prefix.length(), prefix)) {
     LOG_ERR("Error parsing device name '%s'\n", board_name_str);
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error parsing device name '%s'\n", board_name_str);
     }
     return false;
@@ -325,12 +343,7 @@ void Device::initialize_fme_sysfs() {
   snprintf(numa_path, MAX_LEN,
            "/sys/class/fpga_region/region%d/device/numa_node", dev_num);
 
-  char *numa_env_var = std::getenv("MMD_ENABLE_NUMA");
-  int numa_env_val = 1;
-  if (numa_env_var != nullptr) {
-    numa_env_val = std::atoi(numa_env_var);
-  }
-  if (numa_env_val == 1) {
+  if (config.numa_enable == 1) {
     // Read NUMA node and set value for future use. If not available set to -1
     // and disable use of NUMA setting
     std::ifstream sysfs_numa_node(numa_path, std::ifstream::in);
@@ -356,57 +369,197 @@ void Device::initialize_fme_sysfs() {
 /** find_dma_dfh_offsets() function is used in Device::initialize_asp() 
  *  We need to reinitialize DMA after we initialize asp 
  *  because we fpgaReset() as part of initializing ASP
- *  find_dma_dfh_offsets() helps us find the appropriate DFH offsets
+ *  find_dma_dfh_offsets() walks the whole DFH list and records every DMA BBB,
+ *  each instance provides one HOST -> FPGA and one FPGA -> HOST channel
  */ 
 bool Device::find_dma_dfh_offsets() {
-  uint64_t dfh_offset = 0;
-  uint64_t next_dfh_offset = 0;
-  if (find_dfh_by_guid(mmio_handle, DMA_BBB_GUID, &dfh_offset,
-                       &next_dfh_offset)) {
-    dma_ch0_dfh_offset = dfh_offset;
-    if(std::getenv("MMD_ENABLE_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : DMA CH1 offset: 0x%lX\t GUID: %s\n", dma_ch0_dfh_offset, DMA_BBB_GUID);
+  uint64_t dma_id_l = 0;
+  uint64_t dma_id_h = 0;
+  parse_dfh_guid(DMA_BBB_GUID, &dma_id_l, &dma_id_h);
+
+  dma_dfh_offsets.clear();
+  for (const dfh_feature &feature : enumerate_dfh_features(mmio_handle)) {
+    if (feature.id_l != dma_id_l || feature.id_h != dma_id_h) {
+      continue;
     }
-    DEBUG_PRINT("DMA CH1 offset: 0x%lX\t GUID: %s\n", dma_ch0_dfh_offset,
-                DMA_BBB_GUID);
-  } else {
+    assert(feature.offset != 0);
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : DMA %zu offset: 0x%lX\t GUID: %s\n", dma_dfh_offsets.size(), feature.offset, DMA_BBB_GUID);
+    }
+    DEBUG_PRINT("DMA %zu offset: 0x%lX\t GUID: %s\n", dma_dfh_offsets.size(),
+                feature.offset, DMA_BBB_GUID);
+    dma_dfh_offsets.push_back(feature.offset);
+  }
+
+  if (dma_dfh_offsets.empty()) {
     fprintf(stderr,
-            "Error initalizing DMA: Cannot find DMA channel 0 DFH offset\n");
+            "Error initalizing DMA: Cannot find DMA DFH offset\n");
     return false;
   }
 
-  dfh_offset += 0;//next_dfh_offset;
-  if (find_dfh_by_guid(mmio_handle, DMA_BBB_GUID, &dfh_offset,
-                       &next_dfh_offset)) {
-    dma_ch1_dfh_offset = dfh_offset;
-    DEBUG_PRINT("DMA CH2 offset: 0x%lX\t GUID: %s\n", dma_ch1_dfh_offset,
-                DMA_BBB_GUID);
-    if(std::getenv("MMD_ENABLE_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : DMA CH2 offset: 0x%lX\t GUID: %s\n", dma_ch1_dfh_offset, DMA_BBB_GUID);
-    }
-  } else {
-    fprintf(stderr,
-            "Error initalizing DMA. Cannot find DMA channel 2 DFH offset\n");
+  return true;
+}
+
+/** create_dma_engines() builds one HOST -> FPGA and one FPGA -> HOST mmd_dma
+ *  per DMA BBB found by find_dma_dfh_offsets(). The ASP only routes the DMA
+ *  interrupts of the first instance, further engines poll for completion.
+ *  An extra engine that fails to initialize is left out; the first one is
+ *  required.
+ */
+bool Device::create_dma_engines() {
+  const int dma_h2f_interrupt_num = 0; // DMA channel 0 hardcoded to interrupt 0
+  const int dma_f2h_interrupt_num = 2; // DMA channel 1 hardcoded to interrupt 2
+
+  if (dma_dfh_offsets.empty()) {
     return false;
   }
 
-  assert(dma_ch0_dfh_offset != 0);
-  assert(dma_ch1_dfh_offset != 0);
+  dma_host_to_fpga = new dma_engine_set(dma_mode::h2f, config);
+  dma_fpga_to_host = new dma_engine_set(dma_mode::f2h, config);
+
+  for (size_t i = 0; i < dma_dfh_offsets.size(); i++) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Initializing HOST -> FPGA DMA channel %zu \n", i);
+    }
+    mmd_dma *h2f =
+        new mmd_dma(mmio_handle, mmd_handle, mpf_handle, dma_dfh_offsets[i],
+                    i == 0 ? dma_h2f_interrupt_num : -1, dma_mode::h2f,
+                    pinned_regions, &prepinned_ranges, dma_copy_engine,
+                    dma_staging_pool, config);
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Initializing FPGA -> HOST DMA channel %zu \n", i);
+    }
+    mmd_dma *f2h =
+        new mmd_dma(mmio_handle, mmd_handle, mpf_handle, dma_dfh_offsets[i],
+                    i == 0 ? dma_f2h_interrupt_num : -1, dma_mode::f2h,
+                    pinned_regions, &prepinned_ranges, dma_copy_engine,
+                    dma_staging_pool, config);
+    if (!h2f->initialized() || !f2h->initialized()) {
+      if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
+        DEBUG_LOG("DEBUG LOG : Error initializing DMA channel %zu \n", i);
+      }
+      delete h2f;
+      delete f2h;
+      if (i == 0) {
+        fprintf(stderr, "Error initializing MMD DMA\n");
+        return false;
+      }
+      continue;
+    }
+    dma_host_to_fpga->add(h2f);
+    dma_fpga_to_host->add(f2h);
+  }
+
+  if (event_update) {
+    dma_host_to_fpga->set_status_handler(event_update, event_update_user_data);
+    dma_fpga_to_host->set_status_handler(event_update, event_update_user_data);
+  }
 
+  // Bitstreams built without DEV_COPY_ENABLE, and older ones, have no copy
+  // channel, aocl_mmd_copy() then always goes through host memory
+  if (config.dma_device_copy) {
+    dma_device_copy =
+        new mmd_dma(mmio_handle, mmd_handle, mpf_handle, dma_dfh_offsets[0], -1,
+                    dma_mode::d2d, pinned_regions, &prepinned_ranges,
+                    dma_copy_engine, dma_staging_pool, config);
+    if (!dma_device_copy->initialized()) {
+      delete dma_device_copy;
+      dma_device_copy = NULL;
+    }
+  }
+
+  dma_copies = new copy_pipeline(dma_fpga_to_host, dma_host_to_fpga, dma_staging_pool,
+                                 dma_device_copy, config.copy_pipeline_buffers,
+                                 [this](aocl_mmd_op_t op, int status) {
+                                   this->event_update_fn(op, status);
+                                 });
   return true;
 }
 
+/** calibrate_dma() measures both DMA directions once, see
+ *  mmd_dma::calibrate(), and keeps the results so that engines rebuilt after
+ *  reprogramming get the same settings. The device memory it uses is read
+ *  first and written back afterwards.
+ */
+void Device::calibrate_dma() {
+  if (h2f_calibrated && f2h_calibrated) {
+    dma_host_to_fpga->apply_calibration(h2f_calibration);
+    dma_fpga_to_host->apply_calibration(f2h_calibration);
+    return;
+  }
+
+  const uint64_t dev_addr = 0;
+  std::vector<char> saved(config.dma_staging_slot_bytes);
+  if (dma_fpga_to_host->fpga_to_host(nullptr, saved.data(), dev_addr, saved.size(), dma_priority::normal) != 0) {
+    fprintf(stderr, "DMA calibration skipped, cannot read device memory\n");
+    return;
+  }
+  f2h_calibrated = dma_fpga_to_host->calibrate(dev_addr, f2h_calibration) == 0;
+  h2f_calibrated = dma_host_to_fpga->calibrate(dev_addr, h2f_calibration) == 0;
+  if (dma_host_to_fpga->host_to_fpga(nullptr, saved.data(), dev_addr, saved.size(), dma_priority::normal) != 0) {
+    fprintf(stderr, "DMA calibration could not restore device memory\n");
+  }
+  if (!h2f_calibrated || !f2h_calibrated) {
+    fprintf(stderr, "DMA calibration failed, using the configured copy threshold\n");
+  }
+}
+
+std::string Device::get_effective_config() {
+  std::ostringstream out;
+  out << config.to_string();
+  if (dma_host_to_fpga && dma_fpga_to_host) {
+    out << ";h2f_copy_threshold=" << dma_host_to_fpga->copy_threshold()
+        << ";h2f_chunk_len=" << dma_host_to_fpga->chunk_len()
+        << ";f2h_copy_threshold=" << dma_fpga_to_host->copy_threshold()
+        << ";f2h_chunk_len=" << dma_fpga_to_host->chunk_len()
+        << ";device_copy=" << (dma_device_copy ? 1 : 0);
+  }
+  // Global memory left to the runtime below the device allocations of
+  // every bank, the runtime does not learn it any other way
+  out << ";device_alloc=" << (device_mem ? 1 : 0);
+  if (device_mem) {
+    out << ";runtime_mem_per_bank_mb=" << config.device_mem_bank_mb - config.device_alloc_mb;
+  }
+  return out.str();
+}
+
+/** destroy_dma_engines() drains and deletes every DMA engine, it has to run
+ *  while the MPF connection and the pin cache are still alive
+ */
+void Device::destroy_dma_engines() {
+  // Queued copies still use the engines
+  if (dma_copies) {
+    delete dma_copies;
+    dma_copies = NULL;
+  }
+
+  if (dma_device_copy) {
+    delete dma_device_copy;
+    dma_device_copy = NULL;
+  }
+
+  if (dma_host_to_fpga) {
+    delete dma_host_to_fpga;
+    dma_host_to_fpga = NULL;
+  }
+
+  if (dma_fpga_to_host) {
+    delete dma_fpga_to_host;
+    dma_fpga_to_host = NULL;
+  }
+}
+
 bool Device::find_iopipes_dfh_offsets() {
   uint64_t dfh_offset = 0;
   uint64_t next_dfh_offset = 0;
   if (find_dfh_by_guid(mmio_handle, IOPIPES_GUID, &dfh_offset,
                        &next_dfh_offset)) {
     iopipes_dfh_offset = dfh_offset;
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : IOPIPES offset: 0x%lX\t GUID: %s\n", iopipes_dfh_offset, IOPIPES_GUID);
     }
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){  
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){  
       DEBUG_LOG("DEBUG LOG : IO Pipes feature not enabled, IO Pipes not instantiated in ASP\n");
     }
     return false;
@@ -421,11 +574,11 @@ bool Device::find_iopipes_dfh_offsets() {
  *  It resets AFC and reinitializes DMA, Kernel Interrupts if in use 
  */ 
 bool Device::initialize_asp() {
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Initializing ASP ... \n");
   }
   if (asp_initialized) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : ASP already initialized \n");
     }
     return true;
@@ -434,7 +587,7 @@ bool Device::initialize_asp() {
   fpga_result res = fpgaMapMMIO(mmio_handle, 0, NULL);
   if (res != FPGA_OK) {
     LOG_ERR("Error mapping MMIO space: %s\n", fpgaErrStr(res));
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error mapping MMIO space: %s\n",fpgaErrStr(res));
     }
     return false;
@@ -445,12 +598,12 @@ bool Device::initialize_asp() {
   res = fpgaReset(port_handle);
   if (res != FPGA_OK) {
     LOG_ERR("Error resetting AFC: %s\n", fpgaErrStr(res));
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error resetting AFC: %s\n",fpgaErrStr(res));
     }
     return false;
   } else {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : AFC reset \n");
     }
   }
@@ -465,56 +618,49 @@ bool Device::initialize_asp() {
   // The performance also improves slighlty if the DMA threads are on the same
   // NUMA node as the FPGA PCI device.
   //
-  // This code pins memory allocation to occur from FPGA NUMA node prior to
-  // initializing the DMA buffers.  It also pins all threads in the process
-  // to run on this same node.
-  struct bitmask *mask = NULL;
-  if (enable_set_numa) {
-    mask = numa_parse_nodestring(fpga_numa_node.c_str());
-    numa_set_membind(mask);
-    int ret = numa_run_on_node_mask_all(mask);
-    if (ret < 0) {
-      fprintf(stderr, " Error setting NUMA node mask\n");
-    }
+  // The staging pool places its memory on the FPGA NUMA node and the DMA and
+  // copy threads bind themselves to it; the memory and CPU policy of the
+  // rest of the process is left alone.
+  const int numa_node = enable_set_numa ? std::stoi(fpga_numa_node) : -1;
+  dma_staging_pool = new staging_pool(numa_node, config.staging_page_kb, &prepinned_ranges);
+
+  if (!find_dma_dfh_offsets()) {
+    release_asp_resources();
+    return false;
   }
 
-  find_dma_dfh_offsets();
-
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Connecting MPF \n");
   }
   mpfConnect(mmio_handle, 0, mpf_mmio_offset, &mpf_handle, 0);
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : Initializing HOST -> FPGA DMA channel \n");
-  }
-  const int dma_ch0_interrupt_num = 0; // DMA channel 0 hardcoded to interrupt 0
-  dma_host_to_fpga =
-      new mmd_dma(mmio_handle, mmd_handle, mpf_handle, dma_ch0_dfh_offset,
-                  dma_ch0_interrupt_num, dma_mode::h2f);
-  if (!dma_host_to_fpga->initialized()) {
-    fprintf(stderr, "Error initializing MMD DMA\n");
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : Error initializing HOST -> FPGA DMA channel \n");
+  // Pinned host regions are shared by both DMA directions
+  pinned_regions = new pin_cache(mpf_handle, config.pin_cache_mb * 1024 * 1024);
+
+  if (!dma_staging_pool->pin(mpf_handle)) {
+    LOG_ERR("Error pinning DMA staging memory\n");
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Could not pin the DMA staging pool with MPF \n");
     }
-    delete dma_host_to_fpga;
+    release_asp_resources();
     return false;
   }
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : Initializing FPGA -> HOST DMA channel \n");
+  dma_copy_engine = new copy_engine(config.copy_workers, config.copy_parallel_kb * 1024,
+                                    config.copy_nt_kb * 1024, numa_node,
+                                    copy_isa_from_name(config.copy_isa));
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : DMA copy engine : %s , %u workers \n",
+              copy_isa_name(dma_copy_engine->isa()), dma_copy_engine->num_workers());
   }
-  const int dma_ch1_interrupt_num = 2; // DMA channel 1 hardcoded to interrupt 2
-  dma_fpga_to_host =
-      new mmd_dma(mmio_handle, mmd_handle, mpf_handle, dma_ch1_dfh_offset,
-                  dma_ch1_interrupt_num, dma_mode::f2h);
-  if (!dma_fpga_to_host->initialized()) {
-    fprintf(stderr, "Error initializing mmd dma\n");
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : Error initializing FPGA -> HOST DMA channel \n");
-    }
+
+  if (!create_dma_engines()) {
+    release_asp_resources();
     return false;
   }
+  if (config.dma_calibrate) {
+    calibrate_dma();
+  }
 
   /** IO Pipes initialization
    ** Read from NUM_IOPIPES CSR and pass it to iopipes constructor call
@@ -535,54 +681,62 @@ bool Device::initialize_asp() {
       local_ip_address = std::getenv("LOCAL_IP_ADDRESS");
     } else{
       fprintf(stderr, "Please set environment variable LOCAL_IP_ADDRESS to use IO PIPES\n");
-      return false;   
+      release_asp_resources();
+      return false;
     }
 
     if(std::getenv("LOCAL_MAC_ADDRESS")){
       local_mac_address = std::getenv("LOCAL_MAC_ADDRESS");
     } else{
       fprintf(stderr, "Please set environment variable LOCAL_MAC_ADDRESS to use IO PIPES\n");
-      return false;  
+      release_asp_resources();
+      return false;
     }
 
     if(std::getenv("LOCAL_NETMASK")){
       local_netmask = std::getenv("LOCAL_NETMASK");
     } else{
       fprintf(stderr, "Please set environment variable LOCAL_NETMASK to use IO PIPES\n");
-      return false;   
+      release_asp_resources();
+      return false;
     }
 
     if(std::getenv("LOCAL_UDP_PORT")){
       local_udp_port = atoi(std::getenv("LOCAL_UDP_PORT"));
     } else{
       fprintf(stderr, "Please set environment variable LOCAL_UDP_PORT to use IO PIPES\n");
-      return false;   
+      release_asp_resources();
+      return false;
     }
 
     if(std::getenv("REMOTE_IP_ADDRESS")){
       remote_ip_address = std::getenv("REMOTE_IP_ADDRESS");
     } else{
       fprintf(stderr, "Please set environment variable REMOTE_IP_ADDRESS to use IO PIPES\n");
-      return false;   
+      release_asp_resources();
+      return false;
     }
 
     if(std::getenv("REMOTE_MAC_ADDRESS")){
       remote_mac_address = std::getenv("REMOTE_MAC_ADDRESS");
     } else{
       fprintf(stderr, "Please set environment variable REMOTE_MAC_ADDRESS to use IO PIPES\n");
-      return false;   
+      release_asp_resources();
+      return false;
     }
 
     if(std::getenv("REMOTE_UDP_PORT")){
       remote_udp_port = atoi(std::getenv("REMOTE_UDP_PORT"));
     } else{
       fprintf(stderr, "Please set environment variable REMOTE_UDP_PORT to use IO PIPES\n");
-      return false;   
+      release_asp_resources();
+      return false;
     }
 
     DEBUG_LOG("DEBUG LOG : Creating iopipes object and setting up iopipes\n");
     io_pipes = new iopipes(mmd_handle, local_ip_address, local_mac_address, local_netmask, local_udp_port, remote_ip_address, remote_mac_address, remote_udp_port, iopipes_dfh_offset);
     if(!(io_pipes->setup_iopipes_asp(mmio_handle))){
+      release_asp_resources();
       return false;
     }
   }
@@ -593,34 +747,57 @@ bool Device::initialize_asp() {
   //                     sizeof(*desc));
   //ON_ERR_GOTO(res, out, "MMIOWrite64Blk");
 
-  // Turn off membind restriction in order to allow future allocation to
-  // occur on different NUMA nodes if needed.  Hypothesis is that only
-  // the pinned buffers are performance critical for the memcpy. Other
-  // allocations in the process can occur on other NUMA nodes if needed.
-  if (enable_set_numa) {
-    numa_set_membind(numa_nodes_ptr);
-    numa_free_nodemask(mask);
-  }
-
   try {
     kernel_interrupt_thread = new KernelInterrupt(mmio_handle, mmd_handle);
   } catch (const std::system_error &e) {
     std::cerr << "Error initializing kernel interrupt thread: " << e.what()
               << e.code() << std::endl;
+    release_asp_resources();
     return false;
   } catch (const std::exception &e) {
     std::cerr << "Error initializing kernel interrupt thread: " << e.what()
               << std::endl;
+    release_asp_resources();
     return false;
   }
 
   asp_initialized = true;
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : ASP Initialized ! \n");
   }
   return asp_initialized;
 }
 
+/** release_asp_resources() frees the DMA engines, copy engine, staging pool
+ *  and pin cache and disconnects MPF, in that order. Used by the destructor
+ *  and when initialize_asp() fails part way, so a failed open leaves no
+ *  pinned memory or threads behind.
+ */
+void Device::release_asp_resources() {
+  destroy_dma_engines();
+
+  if (dma_copy_engine) {
+    delete dma_copy_engine;
+    dma_copy_engine = NULL;
+  }
+
+  // Releases the VTP pins, so it has to go before the MPF connection
+  if (dma_staging_pool) {
+    delete dma_staging_pool;
+    dma_staging_pool = NULL;
+  }
+
+  if (pinned_regions) {
+    delete pinned_regions;
+    pinned_regions = NULL;
+  }
+
+  if (mpf_handle) {
+    mpfDisconnect(mpf_handle);
+    mpf_handle = nullptr;
+  }
+}
+
 /** Device Class Destructor implementation
  *  Properly releasing and free-ing memory
  *  part of best coding practices and help
@@ -628,32 +805,21 @@ bool Device::initialize_asp() {
  *  helps reduce bugs
  */
 Device::~Device() {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Destructing Device object \n");
   }
   int num_errors = 0;
-  if (mmd_copy_buffer) {
-    free(mmd_copy_buffer);
-    mmd_copy_buffer = NULL;
-  }
 
   if (kernel_interrupt_thread) {
     delete kernel_interrupt_thread;
     kernel_interrupt_thread = NULL;
   }
 
-  if (dma_host_to_fpga) {
-    delete dma_host_to_fpga;
-    dma_host_to_fpga = NULL;
-  }
-
-  if (dma_fpga_to_host) {
-    delete dma_fpga_to_host;
-    dma_fpga_to_host = NULL;
-  }
+  release_asp_resources();
 
-  if (mpf_handle) {
-    mpfDisconnect(mpf_handle);
+  if (device_mem) {
+    delete device_mem;
+    device_mem = NULL;
   }
 
   if (mmio_is_mapped) {
@@ -688,7 +854,7 @@ Device::~Device() {
 
   if (num_errors > 0) {
     DEBUG_PRINT("Error freeing resources in Device destructor\n");
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error freeing resources in Device destructor\n");
     }
   }
@@ -700,7 +866,7 @@ Device::~Device() {
  */ 
 int Device::program_bitstream(uint8_t *data, size_t data_size) {
   if (!afu_initialized) {
-   if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+   if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : FPGA NOT FOUND \n");
     }
     return FPGA_NOT_FOUND;
@@ -712,8 +878,22 @@ int Device::program_bitstream(uint8_t *data, size_t data_size) {
     kernel_interrupt_thread->disable_interrupts();
   }
 
+  // The DMA engines are rebuilt for the new bitstream, drain the old ones
+  // while their MPF connection still exists
+  bool dma_was_initialized = dma_host_to_fpga != NULL;
+  destroy_dma_engines();
+
+  // Cached pins belong to the MPF connection, release them before it goes away
+  if (pinned_regions) {
+    delete pinned_regions;
+    pinned_regions = NULL;
+  }
+  if (dma_staging_pool) {
+    dma_staging_pool->unpin();
+  }
+
   if (mpf_handle) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Disconnecting MPF before program bitstream, this will also disconnect DMA. \n");
     }
     mpfDisconnect(mpf_handle);
@@ -722,19 +902,19 @@ int Device::program_bitstream(uint8_t *data, size_t data_size) {
   find_fpga_target target = {bus, device, function, -1};
   fpga_token fpga_dev;
   int num_found = find_fpga(target, &fpga_dev);
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Trying to find FPGA using bus, device, function. \n");
   }
 
   int result;
   if (num_found == 1) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : FPGA found , programming bitstream using program_gbs_bitstream() \n");
     }
     result = program_gbs_bitstream(fpga_dev, data, data_size);
   } else {
     LOG_ERR("Error programming FPGA\n");
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : FPGA not found , Error programming FPGA \n");
     }
     result = -1;
@@ -749,14 +929,14 @@ int Device::program_bitstream(uint8_t *data, size_t data_size) {
 
   if (uuid_parse(PCI_ASP_AFU_ID, pci_guid) < 0) {
     LOG_ERR("Error parsing guid '%s'\n", PCI_ASP_AFU_ID);
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG :  Error parsing guid '%s' \n", PCI_ASP_AFU_ID);
     }
   }
 
   if (uuid_parse(SVM_ASP_AFU_ID, svm_guid) < 0) {
     LOG_ERR("Error parsing guid '%s'\n", SVM_ASP_AFU_ID);
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error parsing guid '%s' \n",SVM_ASP_AFU_ID );
     }
   }
@@ -813,46 +993,39 @@ int Device::program_bitstream(uint8_t *data, size_t data_size) {
     mpf_mmio_offset = SVM_MMD_MPF;
   }
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Connecting MPF after program bitstream \n");
   }
 
   mpf_handle = nullptr;
   mpfConnect(mmio_handle, 0, mpf_mmio_offset, &mpf_handle, 0);
+  pinned_regions = new pin_cache(mpf_handle, config.pin_cache_mb * 1024 * 1024);
 
   if (kernel_interrupt_thread) {
     kernel_interrupt_thread->enable_interrupts();
   }
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : Initializing HOST -> FPGA DMA after program bitstream \n");
-  }
-  if (dma_host_to_fpga) {
-    const int dma_ch0_interrupt_num = 0; // DMA channel 0 hardcoded to interrupt 0
-    dma_host_to_fpga =
-        new mmd_dma(mmio_handle, mmd_handle, mpf_handle, dma_ch0_dfh_offset,
-                    dma_ch0_interrupt_num, dma_mode::h2f);
-    if (!dma_host_to_fpga->initialized()) {
-      LOG_ERR("Error initializing mmd H2F DMA\n");
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-        DEBUG_LOG("DEBUG LOG : Error Initializing HOST -> FPGA DMA after program bitstream \n");
-      }
-      delete dma_host_to_fpga;
-      return false;
+  // The staging pool backs every DMA, without it the device is unusable
+  if (dma_staging_pool && !dma_staging_pool->pin(mpf_handle)) {
+    LOG_ERR("Error pinning DMA staging memory after program bitstream\n");
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Could not pin the DMA staging pool with MPF \n");
     }
+    return -1;
   }
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : Initializing FPGA -> HOST DMA after program bitstream \n");
-  }
-  if (dma_fpga_to_host) {
-    const int dma_ch1_interrupt_num = 2; // DMA channel 1 hardcoded to interrupt 2
-    dma_fpga_to_host =
-        new mmd_dma(mmio_handle, mmd_handle, mpf_handle, dma_ch1_dfh_offset,
-                    dma_ch1_interrupt_num, dma_mode::f2h);
-    if (!dma_fpga_to_host->initialized()) {
-      fprintf(stderr, "Error initializing MMD F2H DMA\n");
-      return false;
+  if (dma_was_initialized) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Initializing DMA after program bitstream \n");
+    }
+    // The new bitstream may place or count its DMA BBBs differently
+    if (!find_dma_dfh_offsets() || !create_dma_engines()) {
+      LOG_ERR("Error initializing mmd DMA\n");
+      destroy_dma_engines();
+      return -1;
+    }
+    if (config.dma_calibrate) {
+      calibrate_dma();
     }
   }
 
@@ -861,7 +1034,7 @@ int Device::program_bitstream(uint8_t *data, size_t data_size) {
 
 /** Calls kernel_interrupt_thread->yield() */
 int Device::yield() {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::yield() \n");
   }
   if (kernel_interrupt_thread) {
@@ -884,14 +1057,14 @@ bool Device::asp_loaded() {
 
   if (uuid_parse(PCI_ASP_AFU_ID, pci_guid) < 0) {
     LOG_ERR("Error parsing guid '%s'\n", PCI_ASP_AFU_ID);
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error parsing guid '%s' \n", PCI_ASP_AFU_ID);
     }
     return false;
   }
   if (uuid_parse(SVM_ASP_AFU_ID, svm_guid) < 0) {
     LOG_ERR("Error parsing guid '%s'\n", SVM_ASP_AFU_ID);
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error parsing guid '%s' \n", SVM_ASP_AFU_ID);
     }
     return false;
@@ -900,7 +1073,7 @@ bool Device::asp_loaded() {
   res = fpgaGetProperties(mmio_token, &prop);
   if (res != FPGA_OK) {
     LOG_ERR("Error reading properties: %s\n", fpgaErrStr(res));
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error reading properties: %s \n", fpgaErrStr(res));
     }
     fpgaDestroyProperties(&prop);
@@ -915,7 +1088,7 @@ bool Device::asp_loaded() {
   res = fpgaPropertiesGetGUID(prop, &afu_guid);
   if (res != FPGA_OK) {
     LOG_ERR("Error reading GUID\n");
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error reading GUID \n");
     }
     fpgaDestroyProperties(&prop);
@@ -925,12 +1098,12 @@ bool Device::asp_loaded() {
   fpgaDestroyProperties(&prop);
   if (uuid_compare(pci_guid, afu_guid) == 0 ||
       uuid_compare(svm_guid, afu_guid) == 0) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : asp loaded : true \n");
     } 
     return true;
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : asp loaded : false \n");
     }
     return false;
@@ -952,7 +1125,7 @@ std::string Device::get_bdf() {
  *  We will replace with OPAE APIs in future
  */
 float Device::get_temperature() {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Reading temperature ... \n");
   }
   float temp = 0;
@@ -967,7 +1140,7 @@ float Device::get_temperature() {
   fpga_result res;
   res = fpgaTokenGetObject(fme_token, name, &obj, FPGA_OBJECT_GLOB);
   if (res != FPGA_OK) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error reading temperature monitor from BMC :");
       DEBUG_LOG(" %s \n",fpgaErrStr(res));
     }
@@ -986,7 +1159,7 @@ float Device::get_temperature() {
  */
 void Device::set_kernel_interrupt(aocl_mmd_interrupt_handler_fn fn,
                                       void *user_data) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::set_kernel_interrupt() \n");
   }
   if (kernel_interrupt_thread) {
@@ -998,7 +1171,7 @@ void Device::set_kernel_interrupt(aocl_mmd_interrupt_handler_fn fn,
  */
 void Device::set_status_handler(aocl_mmd_status_handler_fn fn,
                                     void *user_data) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::set_status_handler() \n");
   }
   event_update = fn;
@@ -1012,18 +1185,43 @@ void Device::set_status_handler(aocl_mmd_status_handler_fn fn,
  *  under the hood those are used
  */
 void Device::event_update_fn(aocl_mmd_op_t op, int status) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::event_update_fn() \n");
   }
   event_update(mmd_handle, event_update_user_data, op, status);
 }
 
+/** set_transfer_priority() is used in aocl_mmd_set_transfer_priority() API
+ *  the priority applies to transfers the calling thread starts from now on,
+ *  other threads keep theirs
+ */
+void Device::set_transfer_priority(dma_priority priority) {
+  for (auto it = thread_priorities.begin(); it != thread_priorities.end(); ++it) {
+    if (it->first == mmd_handle) {
+      thread_priorities.erase(it);
+      break;
+    }
+  }
+  if (priority != dma_priority::normal) {
+    thread_priorities.emplace_back(mmd_handle, priority);
+  }
+}
+
+dma_priority Device::transfer_priority() {
+  for (const auto &entry : thread_priorities) {
+    if (entry.first == mmd_handle) {
+      return entry.second;
+    }
+  }
+  return dma_priority::normal;
+}
+
 /** read_block() is used in aocl_mmd_read() API
  *  as name suggests its used for fpga->host DMA and MMIO transfers
  */
 int Device::read_block(aocl_mmd_op_t op, int mmd_interface, void *host_addr,
                            size_t offset, size_t size) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::read_block()\n");
   }
   int res;
@@ -1032,14 +1230,14 @@ int Device::read_block(aocl_mmd_op_t op, int mmd_interface, void *host_addr,
   // to memory requires special functionality.  Otherwise do direct MMIO read of
   // base address + offset
   if (mmd_interface == AOCL_MMD_MEMORY) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using DMA to read block\n");
     }
     assert(offset >= ddr_offset);
     res = dma_fpga_to_host->fpga_to_host(op, host_addr, offset - ddr_offset,
-                                         size);
+                                         size, transfer_priority());
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using MMIO to read block\n");
     }
     res = read_mmio(host_addr, mmd_interface + offset, size);
@@ -1056,7 +1254,7 @@ int Device::read_block(aocl_mmd_op_t op, int mmd_interface, void *host_addr,
  */
 int Device::write_block(aocl_mmd_op_t op, int mmd_interface,
                             const void *host_addr, size_t offset, size_t size) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::write_block()\n");
   }
   int res;
@@ -1064,14 +1262,14 @@ int Device::write_block(aocl_mmd_op_t op, int mmd_interface,
   // The mmd_interface is defined as the base address of the MMIO write.  Access
   // to memory requires special functionality.  Otherwise do direct MMIO write
   if (mmd_interface == AOCL_MMD_MEMORY) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using DMA to write block\n");
     }
     assert(offset >= ddr_offset);
     res = dma_host_to_fpga->host_to_fpga(op, host_addr, offset - ddr_offset,
-                                         size);
+                                         size, transfer_priority());
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using MMIO to write block\n");
     }
     res = write_mmio(host_addr, mmd_interface + offset, size);
@@ -1083,55 +1281,105 @@ int Device::write_block(aocl_mmd_op_t op, int mmd_interface,
   return res;
 }
 
+/** read_blockv() is used in aocl_mmd_readv() API
+ *  it reads one contiguous device range into a list of host fragments
+ *  DMA transfers go to mmd_dma as a single vectored work item
+ */
+int Device::read_blockv(aocl_mmd_op_t op, int mmd_interface,
+                        const aocl_mmd_iovec_t *iov, size_t iovcnt, size_t offset) {
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : Device::read_blockv()\n");
+  }
+  int res = 0;
+
+  if (mmd_interface == AOCL_MMD_MEMORY) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Using DMA to read %zu fragments\n", iovcnt);
+    }
+    assert(offset >= ddr_offset);
+    res = dma_fpga_to_host->fpga_to_host_v(op, iov, iovcnt, offset - ddr_offset,
+                                           transfer_priority());
+  } else {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Using MMIO to read %zu fragments\n", iovcnt);
+    }
+    for (size_t i = 0; i < iovcnt && res == 0; i++) {
+      res = read_mmio(iov[i].base, mmd_interface + offset, iov[i].len);
+      offset += iov[i].len;
+    }
+    if (op) {
+      this->event_update_fn(op, res);
+    }
+  }
+  return res;
+}
+
+/** write_blockv() is used in aocl_mmd_writev() API
+ *  it writes a list of host fragments to one contiguous device range
+ *  DMA transfers go to mmd_dma as a single vectored work item
+ */
+int Device::write_blockv(aocl_mmd_op_t op, int mmd_interface,
+                         const aocl_mmd_iovec_t *iov, size_t iovcnt, size_t offset) {
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : Device::write_blockv()\n");
+  }
+  int res = 0;
+
+  if (mmd_interface == AOCL_MMD_MEMORY) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Using DMA to write %zu fragments\n", iovcnt);
+    }
+    assert(offset >= ddr_offset);
+    res = dma_host_to_fpga->host_to_fpga_v(op, iov, iovcnt, offset - ddr_offset,
+                                           transfer_priority());
+  } else {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Using MMIO to write %zu fragments\n", iovcnt);
+    }
+    for (size_t i = 0; i < iovcnt && res == 0; i++) {
+      res = write_mmio(iov[i].base, mmd_interface + offset, iov[i].len);
+      offset += iov[i].len;
+    }
+    if (op) {
+      this->event_update_fn(op, res);
+    }
+  }
+  return res;
+}
+
 /** copy_block() is used in aocl_mmd_copy() API
  *  as name suggests its used for copies from source to destination 
- *  currently we use intermediate buffer for copies
- *  implementation can be optimized to use direct copy in future
+ *  aligned copies stay on the card when the DMA has a copy channel, the rest
+ *  goes through host buffers, see copy_pipeline; with an op the
+ *  copy is queued and op completes through the status handler
  */
 int Device::copy_block(aocl_mmd_op_t op, int mmd_interface,
                            size_t src_offset, size_t dst_offset, size_t size) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::copy_block()\n");
   }
-  int status = -1;
+  if (mmd_interface == AOCL_MMD_MEMORY && dma_copies) {
+    assert(src_offset >= ddr_offset && dst_offset >= ddr_offset);
+    // With an op the copy completes through the status handler, also when
+    // it fails
+    return dma_copies->copy(op, src_offset - ddr_offset, dst_offset - ddr_offset, size);
+  }
 
   if (mmd_interface == AOCL_MMD_MEMORY) {
-    size_t bytes_left = size;
-    size_t read_offset = src_offset;
-    size_t write_offset = dst_offset;
-    while (bytes_left != 0) {
-      size_t chunk =
-          bytes_left > MMD_COPY_BUFFER_SIZE ? MMD_COPY_BUFFER_SIZE : bytes_left;
-
-      // for now, just to reads and writes to/from host to implement this
-      // DMA hw can support direct copy but we don't have time to verify
-      // that so close to the release.
-      // also this API is rarely used.
-      status = read_block(NULL, AOCL_MMD_MEMORY, mmd_copy_buffer, read_offset,
-                          chunk);
-      if (status != 0)
-        break;
-      status = write_block(NULL, AOCL_MMD_MEMORY, mmd_copy_buffer, write_offset,
-                           chunk);
-      if (status != 0)
-        break;
-      read_offset += chunk;
-      write_offset += chunk;
-      bytes_left -= chunk;
-    }
-    status = 0;
+    // DMA was never initialized, or reprogramming could not rebuild it
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : Error copy_block without an initialized DMA\n");
+    }
+    LOG_ERR("copy_block called without an initialized DMA\n");
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Error copy_block unsupported mmd_interface: %d\n", mmd_interface);
     }
     LOG_ERR("copy_block unsupported mmd_interface: %d\n", mmd_interface);
-    status = -1;
   }
-
+  int status = -1;
   if (op) {
-    // TODO: check what 'status' value should really be.  Right now just
-    // using 0 as was done in previous MMD.  Also handle case if op is NULL
-    this->event_update_fn(op, 0);
+    this->event_update_fn(op, status);
   }
 
   return status;
@@ -1145,7 +1393,7 @@ int Device::read_mmio(void *host_addr, size_t mmio_addr, size_t size) {
 
   DCP_DEBUG_MEM("read_mmio start: %p\t 0x%zx\t 0x%zx\n", host_addr, mmio_addr,
                 size);
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::read_mmio start: host_addr : %p\t mmio_addr : 0x%zx\t size : 0x%zx\n",host_addr, mmio_addr, size );
   }
 
@@ -1155,12 +1403,12 @@ int Device::read_mmio(void *host_addr, size_t mmio_addr, size_t size) {
 
   uint64_t *host_addr64 = static_cast<uint64_t *>(host_addr);
   while (size >= 8) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using fpgaReadMMIO64()       host_addr : %p\t mmio_addr : 0x%zx\t size : 0x8\n",host_addr,mmio_addr);
     }
     res = fpgaReadMMIO64(mmio_handle, 0, mmio_addr, host_addr64);
     if (res != FPGA_OK){
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Error in read_mmio() host_addr : %p\t mmio_addr : 0x%zx\t size : 0x8\n",host_addr,mmio_addr);
       }
       return -1;
@@ -1172,12 +1420,12 @@ int Device::read_mmio(void *host_addr, size_t mmio_addr, size_t size) {
 
   uint32_t *host_addr32 = reinterpret_cast<uint32_t *>(host_addr64);
   while (size >= 4) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using fpgaReadMMIO32()       host_addr : %p\t mmio_addr : 0x%zx\t size : 0x4\n",host_addr,mmio_addr);
     }
     res = fpgaReadMMIO32(mmio_handle, 0, mmio_addr, host_addr32);
     if (res != FPGA_OK){
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Error in read_mmio() host_addr : %p\t mmio_addr : 0x%zx\t size : 0x4\n",host_addr,mmio_addr);
       }
       return -1;
@@ -1189,12 +1437,12 @@ int Device::read_mmio(void *host_addr, size_t mmio_addr, size_t size) {
 
   if (size > 0) {
     uint32_t read_data;
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using fpgaReadMMIO32()       host_addr : %p\t mmio_addr : 0x%zx\t size : 0x%zx\n",host_addr,mmio_addr,size);
     }
     res = fpgaReadMMIO32(mmio_handle, 0, mmio_addr, &read_data);
     if (res != FPGA_OK){
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Error in read_mmio() host_addr : %p\t mmio_addr : 0x%zx\t size : 0x%zx\n",host_addr,mmio_addr,size);
       }
       return -1;
@@ -1213,7 +1461,7 @@ int Device::write_mmio(const void *host_addr, size_t mmio_addr,
   fpga_result res = FPGA_OK;
 
   DEBUG_PRINT("write_mmio\n");
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::write_mmio start: host_addr : %p\t mmio_addr : 0x%zx\t size : 0x%zx\n",host_addr, mmio_addr, size );
   }
 
@@ -1223,12 +1471,12 @@ int Device::write_mmio(const void *host_addr, size_t mmio_addr,
 
   const uint64_t *host_addr64 = static_cast<const uint64_t *>(host_addr);
   while (size >= 8) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using fpgaWriteMMIO64()       host_addr : %p\t mmio_addr : 0x%zx\t size : 0x8\n",host_addr,mmio_addr);
     }
     res = fpgaWriteMMIO64(mmio_handle, 0, mmio_addr, *host_addr64);
     if (res != FPGA_OK){
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Error in write_mmio() host_addr : %p\t mmio_addr : 0x%zx\t size : 0x8\n",host_addr,mmio_addr);
       }
       return -1;
@@ -1240,7 +1488,7 @@ int Device::write_mmio(const void *host_addr, size_t mmio_addr,
 
   const uint32_t *host_addr32 = reinterpret_cast<const uint32_t *>(host_addr64);
   while (size > 0) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Using fpgaWriteMMIO32()       host_addr : %p\t mmio_addr : 0x%zx\t size : 0x%zx\n",host_addr,mmio_addr,size);
     }
     uint32_t tmp_data32 = 0;
@@ -1248,7 +1496,7 @@ int Device::write_mmio(const void *host_addr, size_t mmio_addr,
     memcpy(&tmp_data32, host_addr32, chunk_size);
     res = fpgaWriteMMIO32(mmio_handle, 0, mmio_addr, tmp_data32);
     if (res != FPGA_OK){
-      if(std::getenv("MMD_ENABLE_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
         DEBUG_LOG("DEBUG LOG : Error in write_mmio() host_addr : %p\t mmio_addr : 0x%zx\t size : 0x%zx\n",host_addr,mmio_addr,size);
       }
       return -1;
@@ -1266,36 +1514,52 @@ int Device::write_mmio(const void *host_addr, size_t mmio_addr,
  *  it uses mpfVtpPrepareBuffer() API provied by MPF VTP
  */
 void *Device::pin_alloc(void **addr, size_t size) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::pin_alloc() : addr : %p, size : %ld\n",addr, size );
   }
   assert(mpf_handle);
   const int flags = FPGA_BUF_PREALLOCATED;
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::pin_allo()c Using mpfVtpPrepareBuffer()");
   }
   int rc = mpfVtpPrepareBuffer(mpf_handle, size, addr, flags);
   if (rc == FPGA_OK) {
+    prepinned_ranges.insert(*addr, size);
     return *addr;
   } else {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Device::pin_alloc() Error");
     }
     return nullptr;
   }
 }
 
+/** prefault_host_mem() function is used in aocl_mmd_host_alloc() API
+ *  it faults in a new allocation before it is pinned, with the DMA copy
+ *  workers when the ASP is initialized and on the calling thread otherwise
+ */
+void Device::prefault_host_mem(void *addr, size_t size, size_t page_len) {
+  if (dma_copy_engine) {
+    dma_copy_engine->prefault(addr, size, page_len);
+    return;
+  }
+  for (size_t offset = 0; offset < size; offset += page_len) {
+    static_cast<volatile char *>(addr)[offset] = 0;
+  }
+}
+
 /** free_prepinned_mem() function is used in aocl_mmd_free() API and unpin_all_mem_for_handle() function
  *  it uses mpfVtpReleaseBuffer() API provided by MPF VTP
  */
 int Device::free_prepinned_mem(void *mem) {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : Device::free_prepinned_mem() : addr : %p\n",mem );
   }
   assert(mpf_handle);
+  prepinned_ranges.erase(mem);
   int rc = mpfVtpReleaseBuffer(mpf_handle, mem);
   if (rc != FPGA_OK) {
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("DEBUG LOG : Device::free_prepinned_mem() Error");
     }
   }
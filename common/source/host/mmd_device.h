@@ -12,6 +12,7 @@
 #include <unistd.h>
 
 #include <string>
+#include <vector>
 
 #include <opae/fpga.h>
 #include <opae/mpf/mpf.h>
@@ -19,7 +20,14 @@
 
 #include "aocl_mmd.h"
 #include "kernel_interrupt.h"
+#include "mmd_config.h"
+#include "mmd_copy_pipeline.h"
 #include "mmd_dma.h"
+#include "mmd_device_mem.h"
+#include "mmd_dma_engines.h"
+#include "mmd_log.h"
+#include "mmd_pin_cache.h"
+#include "mmd_staging_pool.h"
 #include "pkg_editor.h"
 #include "mmd_iopipes.h"
 
@@ -56,8 +64,6 @@
 
 #define KERNEL_SW_RESET_BASE (AOCL_MMD_KERNEL + 0x30)
 
-#define MMD_COPY_BUFFER_SIZE (2 * 1024 * 1024)
-
 // Below is GUID for DMA
 #define DMA_BBB_GUID   "BC24AD4F-8738-F840-575F-BAB5B61A8DAE"
 #define IOPIPES_GUID "9c8560c5-729f-f873-966d-1f07871d4396"
@@ -90,7 +96,8 @@
 #define DCP_DEBUG_MEM(...)
 #endif
 
-#define DEBUG_LOG(...) fprintf(stderr, __VA_ARGS__)
+// Debug records go through the per-thread log rings, see mmd_log.h
+#define DEBUG_LOG(...) intel_opae_mmd::mmd_log_write(__VA_ARGS__)
 
 #define SVM_DDR_OFFSET 0x1000000000000
 #define PCI_DDR_OFFSET 0
@@ -116,7 +123,21 @@ public:
 
   int get_mmd_handle() { return mmd_handle; }
   int get_mem_capability_support() { return mem_capability_support; }
+  const intel_opae_mmd::mmd_config &get_config() { return config; }
+  // NULL when device allocations are not configured
+  intel_opae_mmd::device_mem_allocator *get_device_mem() { return device_mem; }
+  // Configuration plus the DMA settings in effect, for aocl_mmd_get_info
+  std::string get_effective_config();
+  // DMA engines per direction, reads are fpga->host and writes host->fpga
+  int get_num_read_engines() {
+    return dma_fpga_to_host ? static_cast<int>(dma_fpga_to_host->size()) : 0;
+  }
+  int get_num_write_engines() {
+    return dma_host_to_fpga ? static_cast<int>(dma_host_to_fpga->size()) : 0;
+  }
   uint64_t get_fpga_obj_id() { return fpga_obj_id; }
+  // NUMA node of the card, -1 when unknown or MMD_ENABLE_NUMA is off
+  int get_numa_node() { return enable_set_numa ? std::stoi(fpga_numa_node) : -1; }
   std::string get_dev_name() { return mmd_dev_name; }
   std::string get_bdf();
   float get_temperature();
@@ -129,17 +150,29 @@ public:
   void event_update_fn(aocl_mmd_op_t op, int status);
   bool asp_loaded();
 
+  // Priority class of the async DMA transfers the calling thread starts on
+  // this device, see aocl_mmd_set_transfer_priority()
+  void set_transfer_priority(intel_opae_mmd::dma_priority priority);
+  intel_opae_mmd::dma_priority transfer_priority();
+
   int read_block(aocl_mmd_op_t op, int mmd_interface, void *host_addr,
                  size_t dev_addr, size_t size);
 
   int write_block(aocl_mmd_op_t op, int mmd_interface, const void *host_addr,
                   size_t dev_addr, size_t size);
 
+  int read_blockv(aocl_mmd_op_t op, int mmd_interface,
+                  const aocl_mmd_iovec_t *iov, size_t iovcnt, size_t dev_addr);
+
+  int write_blockv(aocl_mmd_op_t op, int mmd_interface,
+                   const aocl_mmd_iovec_t *iov, size_t iovcnt, size_t dev_addr);
+
   int copy_block(aocl_mmd_op_t op, int mmd_interface, size_t src_offset,
                  size_t dst_offset, size_t size);
 
   void *pin_alloc(void **addr, size_t size);
   int free_prepinned_mem(void *mem);
+  void prefault_host_mem(void *addr, size_t size, size_t page_len);
 
   void shared_mem_prepare_buffer(size_t size, void *host_ptr);
 
@@ -158,6 +191,13 @@ private:
   intel_opae_mmd::KernelInterrupt *kernel_interrupt_thread;
   aocl_mmd_status_handler_fn event_update;
   void *event_update_user_data;
+  // Resolved once when the device is constructed, see mmd_config.h
+  intel_opae_mmd::mmd_config config;
+  // DMA calibration results, reapplied when the engines are rebuilt
+  bool h2f_calibrated;
+  bool f2h_calibrated;
+  intel_opae_mmd::dma_calibration h2f_calibration;
+  intel_opae_mmd::dma_calibration f2h_calibration;
 
   // HACK: use the sysfs path to read NUMA node
   // this should be replaced with OPAE call once that is
@@ -171,6 +211,10 @@ private:
 
   bool find_dma_dfh_offsets();
   bool find_iopipes_dfh_offsets();
+  bool create_dma_engines();
+  void destroy_dma_engines();
+  void release_asp_resources();
+  void calibrate_dma();
 
   uint8_t bus;
   uint8_t device;
@@ -195,14 +239,25 @@ private:
   fpga_guid guid;
   size_t ddr_offset;
   uint64_t mpf_mmio_offset;
-  uint64_t dma_ch0_dfh_offset;
-  uint64_t dma_ch1_dfh_offset;
+  // Every DMA BBB in the DFH list, one H2F and one F2H engine each
+  std::vector<uint64_t> dma_dfh_offsets;
   uint64_t iopipes_dfh_offset;
-  intel_opae_mmd::mmd_dma *dma_host_to_fpga;
-  intel_opae_mmd::mmd_dma *dma_fpga_to_host;
+  intel_opae_mmd::dma_engine_set *dma_host_to_fpga;
+  intel_opae_mmd::dma_engine_set *dma_fpga_to_host;
+  intel_opae_mmd::pin_cache *pinned_regions;
+  intel_opae_mmd::pinned_range_table prepinned_ranges;
+  // Staging slot copies of all DMA engines, kept across reprogramming
+  intel_opae_mmd::copy_engine *dma_copy_engine;
+  // Staging slots and copy buffers, pinned again after reprogramming
+  intel_opae_mmd::staging_pool *dma_staging_pool;
+  // Copy channel of the first DMA BBB, NULL when the bitstream has none
+  intel_opae_mmd::mmd_dma *dma_device_copy;
+  // aocl_mmd_copy(), rebuilt with the DMA engines
+  intel_opae_mmd::copy_pipeline *dma_copies;
   intel_opae_mmd::iopipes *io_pipes;
-
-  char *mmd_copy_buffer;
+  // aocl_mmd_device_alloc(), kept across reprogramming like the runtime's
+  // own buffers
+  intel_opae_mmd::device_mem_allocator *device_mem;
 
   // Helper functions
   int read_mmio(void *host_addr, size_t dev_addr, size_t size);
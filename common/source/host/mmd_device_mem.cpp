@@ -0,0 +1,237 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+#include "mmd_device.h"
+#include "mmd_device_mem.h"
+
+namespace intel_opae_mmd {
+
+buddy_arena::buddy_arena(uint64_t base, uint64_t len, uint64_t min_block)
+    : m_base(base), m_len(len - len % min_block), m_min_block(min_block),
+      m_free_bytes(0), m_stats() {
+  int max_order = 0;
+  while ((m_min_block << (max_order + 1)) <= m_len) {
+    max_order++;
+  }
+  m_free.resize(max_order + 1);
+
+  // Cover the range with the largest blocks that are aligned to their size
+  uint64_t offset = 0;
+  while (offset + m_min_block <= m_len) {
+    int order = max_order;
+    while (order > 0 && ((offset & ((m_min_block << order) - 1)) != 0 ||
+                         offset + (m_min_block << order) > m_len)) {
+      order--;
+    }
+    m_free[order].insert(offset);
+    offset += m_min_block << order;
+  }
+  m_free_bytes.store(m_len, std::memory_order_relaxed);
+  m_stats.len = m_len;
+}
+
+int buddy_arena::order_of(uint64_t bytes) const {
+  int order = 0;
+  while ((m_min_block << order) < bytes) {
+    order++;
+  }
+  return order;
+}
+
+bool buddy_arena::alloc(uint64_t size, uint64_t alignment, uint64_t *addr) {
+  uint64_t need = std::max(std::max(size, alignment), m_min_block);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // Checked before order_of(), whose shift would wrap for sizes near 2^64
+  if (need > m_len) {
+    m_stats.failed++;
+    return false;
+  }
+  int order = order_of(need);
+  // Blocks are aligned relative to the base only
+  if (order >= static_cast<int>(m_free.size()) ||
+      (alignment != 0 && (m_base & (alignment - 1)) != 0)) {
+    m_stats.failed++;
+    return false;
+  }
+  int from = order;
+  while (from < static_cast<int>(m_free.size()) && m_free[from].empty()) {
+    from++;
+  }
+  if (from == static_cast<int>(m_free.size())) {
+    m_stats.failed++;
+    return false;
+  }
+
+  uint64_t offset = *m_free[from].begin();
+  m_free[from].erase(m_free[from].begin());
+  // Keep the lower half, the upper half of each split stays free
+  while (from > order) {
+    from--;
+    m_free[from].insert(offset + (m_min_block << from));
+  }
+  live_block block = {order, size};
+  m_live[offset] = block;
+
+  uint64_t block_len = m_min_block << order;
+  m_free_bytes.fetch_sub(block_len, std::memory_order_relaxed);
+  m_stats.allocs++;
+  m_stats.requested_bytes += size;
+  m_stats.allocated_bytes += block_len;
+  *addr = m_base + offset;
+  return true;
+}
+
+bool buddy_arena::free(uint64_t addr) {
+  if (addr < m_base) {
+    return false;
+  }
+  uint64_t offset = addr - m_base;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_live.find(offset);
+  if (it == m_live.end()) {
+    return false;
+  }
+  int order = it->second.order;
+  uint64_t block_len = m_min_block << order;
+  m_stats.frees++;
+  m_stats.requested_bytes -= it->second.requested;
+  m_stats.allocated_bytes -= block_len;
+  m_live.erase(it);
+  m_free_bytes.fetch_add(block_len, std::memory_order_relaxed);
+
+  // Merge with the buddy for as long as it is free as a whole
+  while (order + 1 < static_cast<int>(m_free.size())) {
+    uint64_t buddy = offset ^ (m_min_block << order);
+    auto buddy_it = m_free[order].find(buddy);
+    if (buddy_it == m_free[order].end()) {
+      break;
+    }
+    m_free[order].erase(buddy_it);
+    offset = std::min(offset, buddy);
+    order++;
+  }
+  m_free[order].insert(offset);
+  return true;
+}
+
+bool buddy_arena::owns(uint64_t addr) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return addr >= m_base && m_live.count(addr - m_base) != 0;
+}
+
+buddy_arena::stats buddy_arena::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  stats s = m_stats;
+  s.free_bytes = m_free_bytes.load(std::memory_order_relaxed);
+  s.largest_free = 0;
+  for (int order = static_cast<int>(m_free.size()) - 1; order >= 0; order--) {
+    if (!m_free[order].empty()) {
+      s.largest_free = m_min_block << order;
+      break;
+    }
+  }
+  return s;
+}
+
+device_mem_allocator::device_mem_allocator(unsigned num_banks, uint64_t bank_bytes,
+                                           uint64_t managed_bytes)
+    : m_bank_bytes(bank_bytes), m_managed_bytes(std::min(managed_bytes, bank_bytes)) {
+  for (unsigned i = 0; i < num_banks; i++) {
+    uint64_t base = i * m_bank_bytes + m_bank_bytes - m_managed_bytes;
+    m_banks.push_back(new buddy_arena(base, m_managed_bytes, min_block));
+  }
+  // A null device pointer would read as a failed allocation
+  if (!m_banks.empty() && m_banks[0]->base() == 0) {
+    uint64_t addr;
+    m_banks[0]->alloc(min_block, min_block, &addr);
+  }
+}
+
+device_mem_allocator::~device_mem_allocator() {
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : device memory allocator : %s\n", stats_string().c_str());
+  }
+  for (buddy_arena *bank : m_banks) {
+    delete bank;
+  }
+}
+
+/** alloc() without a bank tries the banks from the most to the least free
+ *  memory, which spreads allocations and so the bandwidth over the banks.
+ */
+bool device_mem_allocator::alloc(uint64_t size, uint64_t alignment, int bank,
+                                 uint64_t *addr) {
+  if (bank >= static_cast<int>(m_banks.size())) {
+    return false;
+  }
+  if (bank >= 0) {
+    return m_banks[bank]->alloc(size, alignment, addr);
+  }
+
+  // Sort on a snapshot, other threads change the free bytes meanwhile
+  std::vector<std::pair<uint64_t, buddy_arena *>> order;
+  for (buddy_arena *candidate : m_banks) {
+    order.push_back(std::make_pair(candidate->free_bytes(), candidate));
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const std::pair<uint64_t, buddy_arena *> &a,
+                      const std::pair<uint64_t, buddy_arena *> &b) {
+                     return a.first > b.first;
+                   });
+  for (const auto &candidate : order) {
+    if (candidate.first < size) {
+      break;
+    }
+    if (candidate.second->alloc(size, alignment, addr)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+buddy_arena *device_mem_allocator::bank_of(uint64_t addr) {
+  if (m_bank_bytes == 0) {
+    return nullptr;
+  }
+  uint64_t bank = addr / m_bank_bytes;
+  if (bank >= m_banks.size() || addr < m_banks[bank]->base()) {
+    return nullptr;
+  }
+  return m_banks[bank];
+}
+
+bool device_mem_allocator::free(uint64_t addr) {
+  buddy_arena *bank = bank_of(addr);
+  return bank != nullptr && bank->free(addr);
+}
+
+bool device_mem_allocator::owns(uint64_t addr) {
+  buddy_arena *bank = bank_of(addr);
+  return bank != nullptr && bank->owns(addr);
+}
+
+std::string device_mem_allocator::stats_string() {
+  std::ostringstream out;
+  for (size_t i = 0; i < m_banks.size(); i++) {
+    buddy_arena::stats s = m_banks[i]->get_stats();
+    // Share of the free memory that is not part of the largest free block
+    unsigned fragmentation_pct =
+        s.free_bytes ? static_cast<unsigned>(100 - s.largest_free * 100 / s.free_bytes) : 0;
+    out << "bank" << i << "_free=" << s.free_bytes
+        << ";bank" << i << "_largest_free=" << s.largest_free
+        << ";bank" << i << "_allocated=" << s.allocated_bytes
+        << ";bank" << i << "_requested=" << s.requested_bytes
+        << ";bank" << i << "_allocs=" << s.allocs
+        << ";bank" << i << "_failed=" << s.failed
+        << ";bank" << i << "_fragmentation_pct=" << fragmentation_pct << ";";
+  }
+  return out.str();
+}
+
+}; // namespace intel_opae_mmd
@@ -0,0 +1,118 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_DEVICE_MEM_H_
+#define MMD_DEVICE_MEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace intel_opae_mmd {
+
+/** Binary buddy allocator over one range of device memory.
+ *
+ *  Blocks are min_block times a power of two and aligned to their own size
+ *  relative to base. Free blocks of each order are kept in an ordered set,
+ *  so alloc() splits and free() merges buddies in O(log n), and the lowest
+ *  free address is always handed out first. A range that is not a power of
+ *  two is covered with the largest aligned blocks that fit.
+ */
+class buddy_arena final {
+public:
+  struct stats {
+    uint64_t len;
+    uint64_t free_bytes;
+    uint64_t largest_free;    // largest block alloc() could hand out
+    uint64_t requested_bytes; // asked for by the live allocations
+    uint64_t allocated_bytes; // blocks of the live allocations
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failed;
+  };
+
+  buddy_arena(uint64_t base, uint64_t len, uint64_t min_block);
+
+  // Returns false if there is no free block of size and alignment
+  bool alloc(uint64_t size, uint64_t alignment, uint64_t *addr);
+  // Returns false if addr is not the start of a live allocation
+  bool free(uint64_t addr);
+  bool owns(uint64_t addr);
+
+  uint64_t base() const { return m_base; }
+  uint64_t free_bytes() const { return m_free_bytes.load(std::memory_order_relaxed); }
+  stats get_stats();
+
+  buddy_arena(const buddy_arena &) = delete;
+  buddy_arena &operator=(const buddy_arena &) = delete;
+
+private:
+  struct live_block {
+    int order;
+    uint64_t requested;
+  };
+
+  int order_of(uint64_t bytes) const;
+
+  uint64_t m_base;
+  uint64_t m_len;
+  uint64_t m_min_block;
+
+  std::mutex m_mutex;
+  std::vector<std::set<uint64_t>> m_free; // per order, offsets from m_base
+  std::unordered_map<uint64_t, live_block> m_live; // keyed by offset
+  std::atomic<uint64_t> m_free_bytes;
+  stats m_stats;
+};
+
+/** Device memory allocator behind aocl_mmd_device_alloc(), one buddy arena
+ *  per memory bank.
+ *
+ *  Banks are bank_bytes apart in the device address space, which is how the
+ *  kernel addresses them when interleaving is off. The allocator manages
+ *  the top managed_bytes of every bank; the runtime places its own buffers
+ *  without asking the MMD, so the range has to be kept clear of them.
+ *  Device address 0 is never handed out, since the API reports failure with
+ *  a null pointer. Each bank has its own lock, so threads allocating from
+ *  different banks do not wait for each other.
+ */
+class device_mem_allocator final {
+public:
+  // Smallest block, the interleaving granularity of the memory banks
+  static const uint64_t min_block = 4096;
+
+  device_mem_allocator(unsigned num_banks, uint64_t bank_bytes,
+                       uint64_t managed_bytes);
+  ~device_mem_allocator();
+
+  // bank < 0 picks the bank with the most free memory. Returns false when
+  // no bank has a free block of size and alignment.
+  bool alloc(uint64_t size, uint64_t alignment, int bank, uint64_t *addr);
+  bool free(uint64_t addr);
+  bool owns(uint64_t addr);
+
+  unsigned num_banks() const { return static_cast<unsigned>(m_banks.size()); }
+  // Per bank free, largest free and allocated bytes and the fragmentation of
+  // the free memory, as "key=value" pairs separated by ';'
+  std::string stats_string();
+
+  device_mem_allocator(const device_mem_allocator &) = delete;
+  device_mem_allocator &operator=(const device_mem_allocator &) = delete;
+
+private:
+  buddy_arena *bank_of(uint64_t addr);
+
+  uint64_t m_bank_bytes;
+  uint64_t m_managed_bytes;
+  std::vector<buddy_arena *> m_banks;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_DEVICE_MEM_H_
@@ -1,9 +1,16 @@
 // Copyright 2022 Intel Corporation
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cpuid.h>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <immintrin.h>
+#include <x86intrin.h>
+#include <numa.h>
 #include <sys/mman.h>
 #include <chrono>
 #include <iostream>
@@ -11,6 +18,8 @@
 
 #include "mmd_device.h"
 #include "mmd_dma.h"
+#include "mmd_dma_engines.h"
+#include "mmd_pin_cache.h"
 
 namespace intel_opae_mmd {
 const uint64_t KB = 2 << 9;
@@ -19,20 +28,90 @@ const uint64_t MB = 2 << 20;
 std::mutex pinning_mutex;
 std::unordered_map<uint64_t, int> address_mpfprepare_count ={};
 
-// The ASE simulation often runs on systems that do not have permission
-// for allocating 2M pages. This results in a lot of extra time spent pinning
-// thousands of 4K pages if 2M is used for DMA buffer size. Solution is to
-// reduce size to 4K in simuation.
-#ifdef SIM
-const uint64_t dma_buffer_sz = 4 * KB;
-const uint64_t dma_copy_threshold = 4 * KB;
-#else
-const uint64_t dma_buffer_sz = 2 * MB;
-//const uint64_t dma_copy_threshold = 1 * MB;
-const uint64_t dma_copy_threshold = 0 * MB;
-#endif
-static_assert(dma_copy_threshold <= dma_buffer_sz,
-              "DMA copy can overflow buffer");
+// Staging slot size, slot count and copy threshold come from the device
+// configuration (dma_staging_slot_bytes, dma_staging_slots and
+// dma_copy_threshold in mmd_config.h). Transfers that go through the staging
+// buffers are split into slot sized chunks so that the memcpy of one chunk
+// overlaps the hardware transfer of its neighbour.
+
+// Value returned by the ASP for CSR addresses it does not decode, i.e. the
+// completion counters on bitstreams built before they were added.
+const uint64_t dma_bad_register_value = 0x0BAD0ADD0BAD0ADDULL;
+
+// Upper bound of a single umwait, the OS may cap it lower through
+// IA32_UMWAIT_CONTROL
+const uint64_t dma_umwait_tsc_ticks = 100000;
+
+// Async work items the submission ring holds before producers have to wait
+const size_t dma_work_ring_slots = 1024;
+
+// Slices of normal priority items the work thread keeps in flight. Enough
+// to keep the link busy, while a high priority item only ever queues behind
+// this much normal traffic in the hardware.
+const uint32_t dma_slices_inflight = 2;
+
+// Longest the work thread sleeps on a bandwidth cap before it looks at the
+// rings again
+const uint64_t dma_throttle_sleep_max_ns = 1000000;
+
+static inline uint64_t steady_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static bool cpu_has_waitpkg() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ecx & (1 << 5)) != 0;
+}
+
+// Sleep in C0.1 until the cache line of addr is written or the deadline passes.
+// umonitor %rax and umwait %ecx are spelled out as bytes since compilers and
+// assemblers older than GCC 9 know neither; only called once cpu_has_waitpkg()
+static void umwait_on(volatile uint64_t *addr, uint64_t tsc_ticks) {
+  uint64_t observed = *addr;
+  __asm__ volatile(".byte 0xf3, 0x0f, 0xae, 0xf0" : : "a"(addr) : "memory");
+  if (*addr == observed) {
+    uint64_t deadline = __rdtsc() + tsc_ticks;
+    __asm__ volatile(".byte 0xf2, 0x0f, 0xae, 0xf1"
+                     :
+                     : "c"(1), "a"(static_cast<uint32_t>(deadline)),
+                       "d"(static_cast<uint32_t>(deadline >> 32))
+                     : "memory", "cc");
+  }
+}
+
+static const char *wait_policy_name(dma_wait_policy policy) {
+  switch (policy) {
+  case dma_wait_policy::spin:
+    return "spin";
+  case dma_wait_policy::umwait:
+    return "umwait";
+  case dma_wait_policy::hybrid:
+    return "hybrid";
+  case dma_wait_policy::interrupt:
+    return "interrupt";
+  }
+  return "unknown";
+}
+
+// Wait policy for one direction, from dma_wait_h2f or dma_wait_f2h of the
+// device configuration: spin, umwait, hybrid or interrupt
+static dma_wait_policy wait_policy_from_name(const std::string &name,
+                                             dma_wait_policy default_policy) {
+  const dma_wait_policy policies[] = {dma_wait_policy::spin, dma_wait_policy::umwait,
+                                      dma_wait_policy::hybrid, dma_wait_policy::interrupt};
+  for (dma_wait_policy policy : policies) {
+    if (name == wait_policy_name(policy)) {
+      return policy;
+    }
+  }
+  fprintf(stderr, "Ignoring unknown DMA wait policy '%s'\n", name.c_str());
+  return default_policy;
+}
 
 static inline void check_result(fpga_result res, const char *err_str) {
   if (res == FPGA_OK) {
@@ -53,19 +132,46 @@ static inline void check_result(fpga_result res, const char *err_str) {
  */
 mmd_dma::mmd_dma(fpga_handle fpga_handle_arg, int mmd_handle,
                  mpf_handle_t mpf_handle_in, uint64_t dfh_offset_arg,
-                 int interrupt_num_arg, dma_mode mode)
+                 int interrupt_num_arg, dma_mode mode,
+                 pin_cache *pin_cache_arg, pinned_range_table *prepinned_arg,
+                 copy_engine *copy_engine_arg, staging_pool *staging_pool_arg,
+                 const mmd_config &config)
     : m_initialized(false), m_mode(mode), m_status_handler_fn(nullptr),
       m_status_handler_user_data(nullptr), m_fpga_handle(fpga_handle_arg),
       m_mmd_handle(mmd_handle), mpf_handle(mpf_handle_in),
+      m_pin_cache(pin_cache_arg), m_prepinned(prepinned_arg),
+      m_copy_engine(copy_engine_arg), m_staging_pool(staging_pool_arg),
       dfh_offset(dfh_offset_arg), interrupt_num(interrupt_num_arg),
-      m_thread(nullptr), m_work_queue(), m_work_thread_active(true),
-      threshold(dma_copy_threshold), mmio_num(0), dma_buffer(nullptr), transaction_id(-1){
+      m_thread(nullptr), m_completions(nullptr), m_work_ring(dma_work_ring_slots), m_high_ring(dma_work_ring_slots),
+      m_worker_parked(false),
+      m_worker_spin_ns(config.dma_worker_spin_us * 1000), m_queue_stats(),
+      m_queue_full_waits(0), m_coalesce_max_bytes(config.dma_coalesce_bytes),
+      m_slice_bytes(config.dma_slice_kb * KB), m_slice_len(0), m_slicing_active(false),
+      m_slicing(), m_last_slice_ns(0), m_slices_inflight(0), m_slice_status(0),
+      m_normal_deadline_ns(config.dma_normal_deadline_us * 1000), m_rate_limits(),
+      m_pending_bytes(0), m_async_outstanding(0),
+      m_inline_max_bytes(config.dma_inline_bytes), m_inline_transfers(0),
+      m_work_thread_active(true),
+      threshold(config.dma_copy_threshold),
+      m_pin_window(config.dma_pin_window_mb * 1024 * 1024), m_max_inflight(1),
+      m_count_completions(false), m_done_cnt_csr(0), m_done_cnt_base(0),
+      m_submitted(0), m_completed(0),
+      m_spin_budget_ns(config.dma_spin_us * 1000), m_wait_stats(), mmio_num(0),
+      staging_slot_len(config.dma_staging_slot_bytes),
+      staging_slot_bytes(config.dma_staging_slot_bytes), transaction_id(-1){
 
   const uint64_t dma_src_offset = 0x0;
   const uint64_t dma_dst_offset = 0x8;
   const uint64_t dma_len_offset = 0x10;
+  const uint64_t dma_config_offset = 0x28;
   const uint64_t h2f_offset = 0x80;
   const uint64_t f2h_offset = 0x100;
+  const uint64_t d2d_offset = 0x180;
+  const uint64_t num_dma_chan_csr = 0x38;
+  const uint64_t h2f_done_cnt_csr = 0x40;
+  const uint64_t d2d_done_cnt_csr = 0x50;
+  const uint64_t f2h_magic_cnt_csr = 0x58;
+  const uint64_t config_magic_num_is_count = 1ULL << 2;
 
   switch (m_mode) {
   case dma_mode::f2h:
@@ -79,6 +185,23 @@ mmd_dma::mmd_dma(fpga_handle fpga_handle_arg, int mmd_handle,
     wait_fpga_write = false;
     wait_interrupt = true;
     op_mode = "HOST -> FPGA";
+    break;
+  case dma_mode::d2d:
+    dma_csr_base = dfh_offset + d2d_offset;
+    wait_fpga_write = false;
+    wait_interrupt = false;
+    op_mode = "FPGA -> FPGA";
+  }
+
+  // host->fpga used to always sleep on the interrupt and fpga->host to spin
+  // on the magic number, keep that unless told otherwise
+  if (m_mode == dma_mode::h2f) {
+    m_wait_policy = wait_policy_from_name(config.dma_wait_h2f, dma_wait_policy::interrupt);
+  } else {
+    m_wait_policy = wait_policy_from_name(config.dma_wait_f2h, dma_wait_policy::spin);
+  }
+  if (m_wait_policy == dma_wait_policy::umwait && !cpu_has_waitpkg()) {
+    m_wait_policy = dma_wait_policy::spin;
   }
 
   dma_csr_src = dma_csr_base + dma_src_offset;
@@ -87,26 +210,66 @@ mmd_dma::mmd_dma(fpga_handle fpga_handle_arg, int mmd_handle,
   fpga_result res;
 
 
-  char *max_len_env_var = getenv("OFS_OCL_ENV_DMA_MAX_LEN");
-  if(max_len_env_var != nullptr && m_mode == dma_mode::f2h) {
-    max_dma_len = std::stoull(std::string(max_len_env_var));
-    // Require 64 byte alignment
-    if ((max_dma_len % 64) != 0) {
-      max_dma_len = 0;
+  // Only fpga->host descriptors are split, the configuration already
+  // requires 64 byte alignment
+  max_dma_len = m_mode == dma_mode::f2h ? config.dma_max_len : 0;
+
+  // Newer ASPs count completed descriptors per direction, which is what lets
+  // more than one descriptor be outstanding. With several DMA channels the
+  // dispatcher restarts its completion tracking on every new command, so
+  // those bitstreams stay at one descriptor at a time.
+  // Copies run on a single channel whatever the number of DMA channels, and
+  // their counter is the only way to see them complete.
+  // fpga->host completions arrive as the count channel 0 writes to host
+  // memory, so its counter is read here rather than the dispatcher's done
+  // count, which is reset on a different schedule.
+  m_done_cnt_csr = dfh_offset + (m_mode == dma_mode::h2f ? h2f_done_cnt_csr :
+                                 m_mode == dma_mode::f2h ? f2h_magic_cnt_csr : d2d_done_cnt_csr);
+  uint64_t num_dma_chan = 0;
+  res = fpgaReadMMIO64(m_fpga_handle, mmio_num, dfh_offset + num_dma_chan_csr, &num_dma_chan);
+  if (res == FPGA_OK) {
+    res = fpgaReadMMIO64(m_fpga_handle, mmio_num, m_done_cnt_csr, &m_done_cnt_base);
+  }
+  bool has_done_cnt = res == FPGA_OK && m_done_cnt_base != dma_bad_register_value;
+  if (has_done_cnt && (num_dma_chan == 1 || m_mode == dma_mode::d2d)) {
+    m_max_inflight = std::min<uint64_t>(dma_max_inflight, config.dma_max_inflight);
+  }
+  m_count_completions = m_max_inflight > 1 || m_mode == dma_mode::d2d;
+  if (m_mode == dma_mode::d2d && !has_done_cnt) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA)){
+      DEBUG_LOG("DEBUG LOG : DMA %s : not supported by this bitstream\n", op_mode);
     }
-  } else {
-    max_dma_len = 0;
+    return;
   }
 
 
-  if (wait_interrupt) {
+  // Only the first DMA engine has interrupt lines (interrupt_num < 0 for the
+  // others), its host->fpga completions have to come from the counter.
+  if (interrupt_num < 0) {
+    if (wait_interrupt && !m_count_completions) {
+      fprintf(stderr, "DMA %s : engine without interrupt needs the completion counters\n", op_mode);
+      return;
+    }
+    m_wait_policy = dma_wait_policy::spin;
+  }
+  // fpga->host only needs its interrupt to sleep, it only fires on
+  // bitstreams built with USE_F2H_IRQ
+  bool sleeps = m_wait_policy == dma_wait_policy::hybrid ||
+                m_wait_policy == dma_wait_policy::interrupt;
+  if (interrupt_num >= 0 && (wait_interrupt || sleeps)) {
     res = fpgaCreateEventHandle(&event_handle);
     check_result(res, "error fpgaCreateEventHandle");
     res = fpgaRegisterEvent(m_fpga_handle, FPGA_EVENT_INTERRUPT, event_handle,
                             interrupt_num);
     check_result(res, "error fpgaRegisterEvent");
-    res = fpgaGetOSObjectFromEventHandle(event_handle, &int_event_fd.fd);
-    check_result(res, "error fpgaGetOSObjectFromEventHandle");
+    if (res == FPGA_OK) {
+      res = fpgaGetOSObjectFromEventHandle(event_handle, &int_event_fd.fd);
+      check_result(res, "error fpgaGetOSObjectFromEventHandle");
+    }
+    if (res != FPGA_OK && !wait_interrupt) {
+      fprintf(stderr, "DMA %s : no interrupt available, using spin wait policy\n", op_mode);
+      m_wait_policy = dma_wait_policy::spin;
+    }
   } else {
     event_handle = nullptr;
   }
@@ -120,17 +283,55 @@ mmd_dma::mmd_dma(fpga_handle fpga_handle_arg, int mmd_handle,
     if(res != FPGA_OK) {
       printf("Error allocating write_fence buffer\n");
     }
+    // In count mode the hardware writes the low 16 bits of its completion
+    // count instead of the magic number, seed the word with the current count
+    if (res == FPGA_OK && m_count_completions) {
+      *fpga_write_addr = m_done_cnt_base & 0xFFFF;
+    }
     fpgaWriteMMIO64(
         m_fpga_handle, mmio_num, dfh_offset + wait_fpga_write_csr,
         reinterpret_cast<uint64_t>(const_cast<uint64_t *>(fpga_write_addr)));
+    if (has_done_cnt) {
+      fpgaWriteMMIO64(m_fpga_handle, mmio_num, dma_csr_base + dma_config_offset,
+                      m_count_completions ? config_magic_num_is_count : 0);
+    }
   } else {
     fpga_write_addr = nullptr;
   }
 
-  res = mpfVtpPrepareBuffer(mpf_handle, dma_buffer_sz, &dma_buffer, 0);
-  if(res != FPGA_OK) {
-    printf("Error allocating DMA buffer\n");
+  // Each staging chunk is sent as a single descriptor, so keep the slots no
+  // larger than the maximum descriptor length when one is configured.
+  if (max_dma_len > 0 && max_dma_len < staging_slot_len) {
+    staging_slot_len = max_dma_len;
+  }
+  update_slice_len();
+  m_rate_limits[static_cast<int>(dma_priority::normal)].bytes_per_sec = config.dma_normal_mbps * 1024 * 1024;
+  m_rate_limits[static_cast<int>(dma_priority::high)].bytes_per_sec = config.dma_high_mbps * 1024 * 1024;
+  // Only the work thread enforces the caps, nothing may go around it
+  if (config.dma_normal_mbps || config.dma_high_mbps) {
+    m_inline_max_bytes = 0;
   }
+  // Copies never touch host memory and are run on the caller's thread
+  if (m_mode == dma_mode::d2d) {
+    m_initialized = true;
+    if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA)){
+      DEBUG_LOG("DEBUG LOG : Constructing DMA %s , max descriptors in flight : %u\n", op_mode, m_max_inflight);
+    }
+    return;
+  }
+
+  for (uint64_t i = 0; i < config.dma_staging_slots; i++) {
+    void *slot = m_staging_pool->get(staging_slot_bytes);
+    if (slot == nullptr) {
+      printf("Error allocating DMA buffer\n");
+      break;
+    }
+    staging_slots.push_back(slot);
+  }
+
+  m_completions = new completion_dispatcher(
+      op_mode, [this](aocl_mmd_op_t op, int status) { this->event_update_fn(op, status); },
+      &m_async_outstanding);
 
   /** launch of new thread, creating new thread object
    *  using lambda and calling work_thread()
@@ -138,8 +339,8 @@ mmd_dma::mmd_dma(fpga_handle fpga_handle_arg, int mmd_handle,
   m_thread = new std::thread([this] { this->work_thread(); });
   m_initialized = true;
 
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG")){
-    DEBUG_LOG("DEBUG LOG : Constructing DMA %s \n",op_mode);
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : Constructing DMA %s , max descriptors in flight : %u , wait policy : %s \n",op_mode, m_max_inflight, wait_policy_name(m_wait_policy));
   }
 }
 
@@ -148,68 +349,446 @@ mmd_dma::mmd_dma(fpga_handle fpga_handle_arg, int mmd_handle,
  *  it helps with system stability and reduces code bugs
  */
 mmd_dma::~mmd_dma() {
-  if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA)){
     DEBUG_LOG("DEBUG LOG : Destructing DMA %s\n", op_mode);
   }
-  m_work_thread_active = false;
+  {
+    // Flip the flag under the park mutex so the work thread can't miss the wakeup
+    std::lock_guard<std::mutex> lock(m_park_mutex);
+    m_work_thread_active = false;
+  }
   m_dma_notify.notify_one();
-  m_thread->join();
-  delete m_thread;
-  mpfVtpReleaseBuffer(mpf_handle, dma_buffer);
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+  }
+  // After the work thread, which may still have been pushing completions
+  delete m_completions;
+  for (void *slot : staging_slots) {
+    m_staging_pool->put(slot, staging_slot_bytes);
+  }
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : DMA %s wait policy %s : waits %ld , completed spinning %ld , completed blocking %ld , wakeups %ld , spin time %ld us , block time %ld us\n",
+              op_mode, wait_policy_name(m_wait_policy), m_wait_stats.waits, m_wait_stats.spin_completions,
+              m_wait_stats.block_completions, m_wait_stats.wakeups, m_wait_stats.spin_ns / 1000, m_wait_stats.block_ns / 1000);
+    DEBUG_LOG("DEBUG LOG : DMA %s queue : worker parks %ld , ring full waits %ld , run on caller thread %ld\n",
+              op_mode, m_queue_stats.parks, m_queue_full_waits.load(), m_inline_transfers.load());
+    const char *class_names[dma_num_priorities] = {"normal", "high"};
+    for (int i = 0; i < dma_num_priorities; i++) {
+      const dma_class_stats &stats = m_queue_stats.classes[i];
+      DEBUG_LOG("DEBUG LOG : DMA %s %s priority : started %ld , bytes %ld , slices %ld , avg submit to start %ld ns , max submit to start %ld ns , throttled %ld\n",
+                op_mode, class_names[i], stats.started, stats.bytes, stats.slices,
+                stats.started ? stats.total_latency_ns / stats.started : 0,
+                stats.max_latency_ns, stats.throttled);
+    }
+    if (m_coalesce_max_bytes > 0) {
+      DEBUG_LOG("DEBUG LOG : DMA %s coalescing : %ld items sent as %ld transfers\n",
+                op_mode, m_queue_stats.coalesced_items, m_queue_stats.coalesced_batches);
+    }
+  }
   m_initialized = false;
 }
 
 /** work_thread() called while creating new threads in mmd_dma 
- *  We check m_work_queue to check if it has queued any DMA transactions 
- *  if not we use 'wait()' which comes with 'condition_variable' m_dma_notify
- *  basically if queue is empty we block current thread 
- *  and unlock other threads which share the mutex to proceed
- *  when this thread is notified and woekn up again it locks the mutex and does same check again
- *  once queue has work enqueued we pop an item of work and do_dma() on it.
+ *  We pop DMA transactions from the lock free submission rings, one per
+ *  priority class, and start_dma() on them, see next_work_item().
+ *  The work thread does not wait for a transfer before starting the next one,
+ *  transfers in flight are kept in m_inflight and retired in order. Only when
+ *  there is nothing new to submit does it block on the oldest one, and once
+ *  nothing is in flight either it sits out the bandwidth cap or waits for new
+ *  work, see wait_for_work().
  */
 void mmd_dma::work_thread() {
-  while (m_work_thread_active) {
-    std::unique_lock<std::mutex> lock(m_work_queue_mutex);
-    while (m_work_queue.empty()) {
-      m_dma_notify.wait(lock);
-      if (!m_work_thread_active) {
+  // Only the MMD's own threads run next to the card, the application's
+  // threads keep whatever placement they have
+  int numa_node = m_staging_pool->numa_node();
+  if (numa_node >= 0 && numa_run_on_node(numa_node) != 0) {
+    fprintf(stderr, "DMA %s could not bind its work thread to NUMA node %d\n", op_mode, numa_node);
+  }
+  while (true) {
+    dma_work_item item;
+    uint64_t throttle_ns = 0;
+    if (!next_work_item(item, throttle_ns)) {
+      if (!m_inflight.empty()) {
+        retire_inflight(true);
+      } else if (throttle_ns > 0) {
+        throttle_ns = std::min(throttle_ns, dma_throttle_sleep_max_ns);
+        std::this_thread::sleep_for(std::chrono::nanoseconds(throttle_ns));
+      } else if (!wait_for_work()) {
         return;
       }
+      continue;
+    }
+
+    m_inflight.emplace_back();
+    dma_inflight_item &inflight = m_inflight.back();
+    dma_work_item next;
+    if (coalescable(item) && work_ring(item.priority).peek(next) && coalescable(next) &&
+        next.dev_addr == item.dev_addr + item.size) {
+      inflight.status = start_coalesced_dma(item, inflight);
+    } else {
+      inflight.status = start_dma(item, inflight);
+    }
+    charge_rate_limit(item.priority, inflight.item.size);
+    retire_inflight(false);
+  }
+}
+
+/** next_work_item() picks what the work thread starts next.
+ *  High priority items go first. The normal class still gets a turn once it
+ *  has waited m_normal_deadline_ns, so a steady stream of high priority work
+ *  can't starve it, and whenever the high class is over its bandwidth cap.
+ *  A class over its cap is skipped; when that leaves nothing to start,
+ *  throttle_ns is how long until the first one is allowed again.
+ */
+bool mmd_dma::next_work_item(dma_work_item &item, uint64_t &throttle_ns) {
+  uint64_t now = steady_now_ns();
+  uint64_t high_wait_ns = 0;
+  uint64_t normal_wait_ns = 0;
+  bool high_allowed = under_rate_limit(dma_priority::high, now, high_wait_ns);
+  bool normal_allowed = under_rate_limit(dma_priority::normal, now, normal_wait_ns);
+  bool high_pending = !m_high_ring.empty();
+
+  if (normal_allowed && high_pending && m_normal_deadline_ns > 0) {
+    dma_work_item head;
+    uint64_t waiting_since = m_slicing_active ? m_last_slice_ns :
+                             m_work_ring.peek(head) ? head.enqueue_ns : now;
+    if (now - waiting_since >= m_normal_deadline_ns && normal_work_item(item)) {
+      return true;
+    }
+  }
+  if (high_allowed && m_high_ring.try_pop(item)) {
+    record_start(item);
+    return true;
+  }
+  if (normal_allowed && normal_work_item(item)) {
+    return true;
+  }
+
+  // Only wait out a cap that holds back queued work
+  if (!high_allowed && high_pending) {
+    m_queue_stats.classes[static_cast<int>(dma_priority::high)].throttled++;
+    throttle_ns = high_wait_ns;
+  }
+  if (!normal_allowed && (m_slicing_active || !m_work_ring.empty())) {
+    m_queue_stats.classes[static_cast<int>(dma_priority::normal)].throttled++;
+    if (throttle_ns == 0 || normal_wait_ns < throttle_ns) {
+      throttle_ns = normal_wait_ns;
+    }
+  }
+  return false;
+}
+
+/** normal_work_item() takes the next normal priority item, or the next slice
+ *  of the one being sliced. Items longer than m_slice_len are sliced, except
+ *  vectored ones which are submitted as one batch. Returns false when the
+ *  class has nothing to start, or already has dma_slices_inflight slices in
+ *  flight.
+ */
+bool mmd_dma::normal_work_item(dma_work_item &item) {
+  if (!m_slicing_active) {
+    if (!m_work_ring.try_pop(item)) {
+      return false;
+    }
+    record_start(item);
+    if (m_slice_len == 0 || item.size <= m_slice_len || item.frags != nullptr) {
+      return true;
+    }
+    m_slicing = item;
+    m_slicing.slice_total = item.size;
+    m_slicing_active = true;
+  } else if (m_slices_inflight >= dma_slices_inflight) {
+    return false;
+  }
+  next_slice(item);
+  return true;
+}
+
+/** next_slice() cuts the next slice off m_slicing. The op and completion
+ *  group of the item go with the last slice, retire_inflight() folds the
+ *  status of the earlier ones into it.
+ */
+void mmd_dma::next_slice(dma_work_item &item) {
+  item = m_slicing;
+  // Slices of a direct transfer are pinned one at a time, keep them on
+  // pages of their own. Staged slices stay whole staging chunks.
+  if (m_slicing.slice_total > threshold) {
+    item.size = host_page_split(m_slicing.host_addr, m_slice_len, m_slicing.size);
+  } else {
+    item.size = std::min<uint64_t>(m_slice_len, m_slicing.size);
+  }
+  item.last_slice = item.size == m_slicing.size;
+  if (item.last_slice) {
+    m_slicing_active = false;
+  } else {
+    item.op = nullptr;
+    item.group = nullptr;
+    m_slicing.host_addr = static_cast<char *>(m_slicing.host_addr) + item.size;
+    m_slicing.dev_addr += item.size;
+    m_slicing.size -= item.size;
+  }
+  m_last_slice_ns = steady_now_ns();
+  m_slices_inflight++;
+  m_queue_stats.classes[static_cast<int>(dma_priority::normal)].slices++;
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Slice of a 0x%zx byte transfer , host_addr : %p , device_addr : %ld , slice size : 0x%zx \n", transaction_id, op_mode, item.slice_total, item.host_addr, item.dev_addr, item.size);
+  }
+}
+
+/** under_rate_limit() tells whether a priority class is within its
+ *  bandwidth cap. The credit it earned since the last check is added first,
+ *  at most one slice worth of it, so an idle class can't save up for a
+ *  burst. Otherwise wait_ns is how long until it is allowed again.
+ */
+bool mmd_dma::under_rate_limit(dma_priority priority, uint64_t now_ns, uint64_t &wait_ns) {
+  dma_rate_limit &limit = m_rate_limits[static_cast<int>(priority)];
+  if (limit.bytes_per_sec == 0) {
+    return true;
+  }
+  if (limit.last_ns != 0) {
+    double earned = static_cast<double>(now_ns - limit.last_ns) * limit.bytes_per_sec / 1e9;
+    double burst = static_cast<double>(std::max<uint64_t>(m_slice_len, staging_slot_len));
+    limit.credit = static_cast<int64_t>(std::min(limit.credit + earned, burst));
+  }
+  limit.last_ns = now_ns;
+  if (limit.credit >= 0) {
+    return true;
+  }
+  wait_ns = static_cast<uint64_t>(-limit.credit * 1e9 / limit.bytes_per_sec) + 1;
+  return false;
+}
+
+/** charge_rate_limit() takes the bytes just started from the credit of their
+ *  priority class
+ */
+void mmd_dma::charge_rate_limit(dma_priority priority, uint64_t bytes) {
+  m_queue_stats.classes[static_cast<int>(priority)].bytes += bytes;
+  dma_rate_limit &limit = m_rate_limits[static_cast<int>(priority)];
+  if (limit.bytes_per_sec != 0) {
+    limit.credit -= static_cast<int64_t>(bytes);
+  }
+}
+
+/** update_slice_len() keeps the slice length a whole number of staging
+ *  chunks, so slicing a staged transfer never adds a descriptor
+ */
+void mmd_dma::update_slice_len() {
+  if (m_slice_bytes == 0 || staging_slot_len == 0) {
+    m_slice_len = 0;
+    return;
+  }
+  m_slice_len = std::max(m_slice_bytes - m_slice_bytes % staging_slot_len, staging_slot_len);
+}
+
+/** record_start() updates the submit to start latency counters of the
+ *  item's priority class once the work thread picks it up
+ */
+void mmd_dma::record_start(const dma_work_item &item) {
+  dma_class_stats &stats = m_queue_stats.classes[static_cast<int>(item.priority)];
+  uint64_t latency_ns = steady_now_ns() - item.enqueue_ns;
+  stats.started++;
+  stats.total_latency_ns += latency_ns;
+  stats.max_latency_ns = std::max(stats.max_latency_ns, latency_ns);
+}
+
+/** coalescable() tells whether a queued item may be merged with its
+ *  neighbours, see start_coalesced_dma()
+ */
+bool mmd_dma::coalescable(const dma_work_item &item) {
+  return m_coalesce_max_bytes > 0 && item.frags == nullptr && item.group == nullptr &&
+         item.slice_total == 0 && item.size > 0 &&
+         item.size <= m_coalesce_max_bytes && item.size <= staging_slot_len &&
+         staging_slots.size() >= 2;
+}
+
+/** start_coalesced_dma() merges item with the queued items that follow it
+ *  back to back on the device into one staged transfer. The host data of all
+ *  of them is packed into one staging slot and sent with a single descriptor;
+ *  their ops are completed together when the transfer is retired.
+ *  Only enabled with OFS_OCL_ENV_DMA_COALESCE_BYTES, which sets the largest
+ *  item that is merged.
+ */
+int mmd_dma::start_coalesced_dma(dma_work_item &item, dma_inflight_item &inflight) {
+  inflight.item = item;
+  inflight.last_seq = 0;
+  inflight.pin = dma_host_pin{item.host_addr, false, nullptr};
+  inflight.status = 0;
+  inflight.merged_ops.clear();
+
+  m_coalesce_frags.clear();
+  m_coalesce_frags.push_back(dma_fragment{item.host_addr, item.size});
+  uint64_t size = item.size;
+  dma_work_item next;
+  mpsc_ring<dma_work_item> &ring = work_ring(item.priority);
+  while (ring.peek(next) && coalescable(next) &&
+         next.dev_addr == item.dev_addr + size &&
+         size + next.size <= staging_slot_len) {
+    ring.try_pop(next);
+    record_start(next);
+    m_coalesce_frags.push_back(dma_fragment{next.host_addr, next.size});
+    inflight.merged_ops.push_back(next.op);
+    size += next.size;
+  }
+  // Retired as one transfer, pending bytes drop by the merged size
+  inflight.item.size = size;
+  m_queue_stats.coalesced_items += m_coalesce_frags.size();
+  m_queue_stats.coalesced_batches++;
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Coalesced %zu queued transfers , device_addr : %ld , transaction size : 0x%lx \n", transaction_id, op_mode, m_coalesce_frags.size(), item.dev_addr, size);
+  }
+
+  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+  int dma_res = stage_fragments(m_coalesce_frags.data(), m_coalesce_frags.size(), item.dev_addr);
+  inflight.last_seq = m_submitted;
+  return dma_res;
+}
+
+/** wait_for_work() returns true once a submission ring has work, or false when the
+ *  work thread should exit. It spins for m_worker_spin_ns first, since async
+ *  transfers tend to come in bursts, and then parks on m_dma_notify.
+ *  m_worker_parked tells enqueue_dma() that it has to take m_park_mutex and
+ *  notify, the seq_cst fences on both sides make sure either the producer
+ *  sees the flag or the worker sees the new item.
+ */
+bool mmd_dma::wait_for_work() {
+  uint64_t spin_start = steady_now_ns();
+  while (steady_now_ns() - spin_start < m_worker_spin_ns) {
+    if (!m_work_ring.empty() || !m_high_ring.empty()) {
+      return true;
+    }
+    _mm_pause();
+  }
+
+  std::unique_lock<std::mutex> lock(m_park_mutex);
+  m_worker_parked.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  m_queue_stats.parks++;
+  while (m_work_ring.empty() && m_high_ring.empty()) {
+    if (!m_work_thread_active) {
+      m_worker_parked.store(false, std::memory_order_relaxed);
+      return false;
+    }
+    m_dma_notify.wait(lock);
+  }
+  m_worker_parked.store(false, std::memory_order_relaxed);
+  return true;
+}
+
+/** retire_inflight() completes every transfer at the head of m_inflight whose
+ *  descriptors have all finished: it releases the host pin and hands the
+ *  status to m_completions, which reports it to the runtime. Slices report
+ *  only with the last one of their item, carrying the first error of any of
+ *  them. With wait_for_oldest it first blocks until the oldest transfer is
+ *  done.
+ */
+void mmd_dma::retire_inflight(bool wait_for_oldest) {
+  std::unique_lock<std::mutex> lock(m_dma_op_mutex);
+  if (wait_for_oldest && !m_inflight.empty()) {
+    uint64_t completed = m_completed;
+    if (wait_for_completions(m_inflight.front().last_seq) != 0) {
+      // Nothing is known about descriptors that were still outstanding
+      for (dma_inflight_item &inflight : m_inflight) {
+        if (inflight.last_seq > completed) {
+          inflight.status = -1;
+        }
+      }
     }
-    dma_work_item item = m_work_queue.front();
-    m_work_queue.pop();
+  }
+  while (!m_inflight.empty() && m_inflight.front().last_seq <= m_completed) {
+    dma_inflight_item inflight = std::move(m_inflight.front());
+    m_inflight.pop_front();
     lock.unlock();
-    int res = do_dma(item);
-    if (item.op != nullptr) {
-      event_update_fn(item.op, res);
+    finish_dma(inflight);
+    m_pending_bytes.fetch_sub(inflight.item.size, std::memory_order_relaxed);
+    if (inflight.item.slice_total != 0) {
+      // Items are sliced one after the other and retire in order
+      m_slices_inflight--;
+      if (m_slice_status == 0) {
+        m_slice_status = inflight.status;
+      }
+      if (!inflight.item.last_slice) {
+        lock.lock();
+        continue;
+      }
+      inflight.status = m_slice_status;
+      m_slice_status = 0;
+    }
+    // The dispatcher reports the ops and only then takes them off
+    // m_async_outstanding, so no transfer runs inline ahead of them
+    dma_completion_group *group = inflight.item.group;
+    if (group != nullptr) {
+      int group_status = 0;
+      if (group->piece_done(inflight.status, group_status)) {
+        m_completions->push(group->op(), group_status);
+        delete group;
+      } else {
+        m_async_outstanding.fetch_sub(1, std::memory_order_release);
+      }
+    } else {
+      m_completions->push(inflight.item.op, inflight.status);
     }
+    for (aocl_mmd_op_t op : inflight.merged_ops) {
+      m_completions->push(op, inflight.status);
+    }
+    lock.lock();
   }
 }
 
-/** We create an unique_lock using m_work_queue_mutex
- *  same mutex we used in work_thread()
- *  once we acquire lock we push DMA work item to m_work_queue, which is DMA work queue
- *  and release the lock
- *  we use condition_variable m_dma_notify to unblock thread waiting 
- *  eventually we call do_dma() function which performs dma
- *  work item has all data needed to perform DMA
- */  
+/** enqueue_dma() hands non-blocking DMA work items to the work thread
+ *  through the ring of their priority class, a bounded ring of preallocated
+ *  slots, so submission takes no lock and allocates nothing. Only when the
+ *  work thread is parked do we take m_park_mutex and use condition_variable
+ *  m_dma_notify to wake it. If the ring is full we yield until the work
+ *  thread makes room.
+ *  Normal priority non-blocking transfers up to m_inline_max_bytes skip the
+ *  hand off when no bandwidth cap is set and this direction has no async
+ *  work queued or in flight: the caller runs them with do_dma() and reports
+ *  the status itself. Waiting for a small transfer costs less than waking
+ *  the work thread, and with nothing outstanding there is nothing it could
+ *  overtake.
+ *  Blocking transfers call do_dma() directly. The work item has all the data
+ *  needed to perform the DMA.
+ */
 int mmd_dma::enqueue_dma(dma_work_item &item) {
 
-  // When item.op is not null DMA is non-blocking and queued to worked thread
-  if (item.op != nullptr) {
-    std::unique_lock<std::mutex> lv(m_work_queue_mutex);
-    m_work_queue.push(item);
-    lv.unlock();
-    m_dma_notify.notify_one();
-    if(std::getenv("MMD_DMA_DEBUG")){
+  m_pending_bytes.fetch_add(item.size, std::memory_order_relaxed);
+
+  if (item.op != nullptr && item.group == nullptr && item.priority == dma_priority::normal &&
+      m_inline_max_bytes > 0 && item.size <= m_inline_max_bytes &&
+      m_async_outstanding.load(std::memory_order_acquire) == 0) {
+    m_inline_transfers.fetch_add(1, std::memory_order_relaxed);
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Running idle queue transfer on the caller thread , host addr : %p , device addr : %ld , transaction size : 0x%zx \n", transaction_id, op_mode, item.host_addr, item.dev_addr, item.size);
+    }
+    event_update_fn(item.op, do_dma(item));
+    return 0;
+  }
+
+  // When item.op is not null DMA is non-blocking and queued to worked thread,
+  // so are the pieces of a striped transfer
+  if (item.op != nullptr || item.group != nullptr) {
+    m_async_outstanding.fetch_add(1, std::memory_order_relaxed);
+    item.enqueue_ns = steady_now_ns();
+    mpsc_ring<dma_work_item> &ring = work_ring(item.priority);
+    while (!ring.try_push(item)) {
+      m_queue_full_waits.fetch_add(1, std::memory_order_relaxed);
+      std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_worker_parked.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(m_park_mutex);
+      m_dma_notify.notify_one();
+    }
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
       DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Pushing DMA transaction to queue:\nDEBUG LOG : TID : %ld DMA ----          Operation        - %s \nDEBUG LOG : TID : %ld DMA ----          host addr        - %p  \nDEBUG LOG : TID : %ld DMA ----         device addr      - %ld \nDEBUG LOG : TID : %ld DMA ----         Transaction size - 0x%zx \n", transaction_id, transaction_id, op_mode, transaction_id, item.host_addr, transaction_id, item.dev_addr,transaction_id,item.size);
     }
     return 0;
   }
 
   if (item.op == nullptr) {
-    if(std::getenv("MMD_DMA_DEBUG")) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)) {
       DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- item op is null ptr, which means you are most probably programming bitstream\n",transaction_id);
     }
   }
@@ -224,6 +803,11 @@ void mmd_dma::set_status_handler(aocl_mmd_status_handler_fn fn,
   m_status_handler_user_data = user_data;
 }
 
+dma_wait_stats mmd_dma::get_wait_stats() {
+  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+  return m_wait_stats;
+}
+
 void mmd_dma::event_update_fn(aocl_mmd_op_t op, int status) {
   m_status_handler_fn(m_mmd_handle, m_status_handler_user_data, op, status);
 }
@@ -255,21 +839,24 @@ void mmd_dma::read_register(uint64_t offset, const char* name)
   }
 }
 
-/** send_descriptors() function is called by do_dma() function
+/** submit_descriptor() function is called by start_dma() and do_staged_dma()
  *  we use OPAE API fpgaWriteMMIO64() to write dma source, destination addresses to CSRs
  *  and also to write dma transaction length to CSR
- *  for host->fpga DMA we wait for interrupt and 
- *  for fpga->host DMA we use 'magic number' methodology which is known as polling method, instead of using interrupt
- *  in future we plan to enable interrupts for fpga->host direction as well
- *  we can do without lock_guard it seems, there is no shared variable , but not tested yet, will remove in future release
- *  it won't affect performance or functionality
+ *  it does not wait for the transfer, the descriptor gets the next sequence
+ *  number (m_submitted after the call) and wait_for_completions() is used to
+ *  wait for it. If m_max_inflight descriptors are already outstanding it first
+ *  waits for the oldest one to complete.
+ *  Caller must hold m_dma_op_mutex, which serializes descriptors between the
+ *  work thread and blocking callers which run do_dma() on their own thread
  */  
-int mmd_dma::send_descriptors(uint64_t dma_src_addr, uint64_t dma_dst_addr, uint64_t dma_len) {
-
-  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+int mmd_dma::submit_descriptor(uint64_t dma_src_addr, uint64_t dma_dst_addr, uint64_t dma_len) {
 
+  if (m_submitted - m_completed >= m_max_inflight &&
+      wait_for_completions(m_submitted - m_max_inflight + 1) != 0) {
+    return -1;
+  }
 #if 0
-  printf("send_descriptors: dma_src_addr 0x%lx\t dma_dst_addr 0x%lx\t dma_len "
+  printf("submit_descriptor: dma_src_addr 0x%lx\t dma_dst_addr 0x%lx\t dma_len "
          "0x%lx\n",
          dma_src_addr, dma_dst_addr, dma_len);
 #endif
@@ -300,221 +887,719 @@ int mmd_dma::send_descriptors(uint64_t dma_src_addr, uint64_t dma_dst_addr, uint
   if(res != FPGA_OK) {
     return -1;
   }
+  m_submitted++;
+  return 0;
+}
+
+/** wait_for_completions() blocks until descriptor number seq and everything
+ *  submitted before it has completed. On an error the outstanding descriptors
+ *  are in an unknown state, see resync_completions(). Caller must hold
+ *  m_dma_op_mutex.
+ */
+int mmd_dma::wait_for_completions(uint64_t seq) {
+  while (m_completed < seq) {
+    if (wait_for_notification() != 0) {
+      resync_completions();
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** resync_completions() is called after a failed wait so the window can be
+ *  reused. With the completion counters the hardware count is read back:
+ *  descriptors it shows as done complete normally, the rest are given up and
+ *  the count base moves so that the next descriptor is expected at count + 1,
+ *  which also covers the counter having been reset by the hardware.
+ *  Without counters there is nothing to read, all outstanding descriptors
+ *  are treated as done. Caller must hold m_dma_op_mutex.
+ */
+void mmd_dma::resync_completions() {
+  uint64_t count = 0;
+  if (m_count_completions &&
+      fpgaReadMMIO64(m_fpga_handle, mmio_num, m_done_cnt_csr, &count) == FPGA_OK) {
+    uint64_t done = count - m_done_cnt_base;
+    if (done > m_completed && done <= m_submitted) {
+      m_completed = done;
+    }
+    if (m_completed != m_submitted) {
+      fprintf(stderr, "TID : %ld DMA ---- %s , giving up on %ld outstanding descriptors\n",
+              transaction_id, op_mode, m_submitted - m_completed);
+    }
+    m_done_cnt_base = count - m_submitted;
+    if (fpga_write_addr != nullptr) {
+      *fpga_write_addr = count & 0xFFFF;
+    }
+  }
+  m_completed = m_submitted;
+}
+
+/** read_completion_count() reads the hardware completion counter and moves
+ *  m_completed forward. Reads that do not fit the window are ignored.
+ */
+void mmd_dma::read_completion_count() {
+  uint64_t count = 0;
+  if (fpgaReadMMIO64(m_fpga_handle, mmio_num, m_done_cnt_csr, &count) != FPGA_OK) {
+    return;
+  }
+  uint64_t done = count - m_done_cnt_base;
+  if (done > m_completed && done <= m_submitted) {
+    m_completed = done;
+  }
+}
+
+/** check_completion() looks for completions without blocking and returns true
+ *  if m_completed moved forward
+ *  for host->fpga DMA and device copies the completion counter is read, or on
+ *  older bitstreams the host->fpga interrupt eventfd is polled with a zero timeout
+ *  for fpga->host DMA we use 'magic number' methodology: the hardware writes
+ *  the magic number, or the low 16 bits of its completion count, to host memory
+ *  after the data. Caller must hold m_dma_op_mutex.
+ */
+bool mmd_dma::check_completion() {
+  const uint64_t FPGA_DMA_WF_MAGIC_NO = 0x5772745F53796E63ULL;
+  uint64_t completed = m_completed;
+
+  if (m_mode == dma_mode::d2d) {
+    read_completion_count();
+  } else if (wait_interrupt) {
+    if (m_count_completions) {
+      read_completion_count();
+    } else {
+      int_event_fd.events = POLLIN;
+      if (poll(&int_event_fd, 1, 0) > 0 && clear_interrupt() == 0) {
+        m_completed++;
+      }
+    }
+  } else if (m_count_completions) {
+    uint16_t last = static_cast<uint16_t>(m_done_cnt_base + m_completed);
+    uint16_t done = static_cast<uint16_t>(*fpga_write_addr - last);
+    if (done != 0 && done <= m_submitted - m_completed) {
+      m_completed += done;
+    }
+  } else if (*fpga_write_addr == FPGA_DMA_WF_MAGIC_NO) {
+    *fpga_write_addr = 0;
+    m_completed++;
+  }
+  return m_completed != completed;
+}
+
+/** clear_interrupt() consumes the pending interrupt count from the eventfd
+ */
+int mmd_dma::clear_interrupt() {
+  uint64_t count;
+  ssize_t bytes_read = read(int_event_fd.fd, &count, sizeof(count));
+  if (bytes_read < 0) {
+    fprintf(stderr, "TID : %ld DMA ---- %s Error: poll failed %s\n", transaction_id, op_mode, strerror(errno));
+    return -1;
+  }
+  if (bytes_read == 0) {
+    fprintf(stderr, "TID : %ld DMA ---- %s Error: poll failed zero bytes read\n",transaction_id, op_mode);
+    return -1;
+  }
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s Interrupt received\n",transaction_id, op_mode);
+  }
+  return 0;
+}
+
+/** cpu_relax() is called between two checks of the spin phase
+ *  with the umwait policy the core waits on the fpga->host completion word in
+ *  a light sleep state until the hardware writes it, everywhere else it just
+ *  executes a pause instruction
+ */
+void mmd_dma::cpu_relax() {
+  if (m_wait_policy == dma_wait_policy::umwait && fpga_write_addr != nullptr) {
+    umwait_on(fpga_write_addr, dma_umwait_tsc_ticks);
+  } else {
+    _mm_pause();
+  }
+}
+
+/** wait_for_notification() blocks until at least one more outstanding descriptor
+ *  has completed and advances m_completed accordingly
+ *  How it waits depends on the policy of this direction:
+ *  spin and umwait keep checking for completion on this core,
+ *  interrupt sleeps in poll() on the DMA interrupt right away and
+ *  hybrid spins for m_spin_budget_ns before sleeping on the interrupt.
+ *  fpga->host completion is always confirmed through the magic number since
+ *  the interrupt may reach the host ahead of the data, so the blocking phase
+ *  wakes up every millisecond to check it.
+ *  Time spent spinning and blocking is accumulated in m_wait_stats.
+ *  Caller must hold m_dma_op_mutex.
+ */
+int mmd_dma::wait_for_notification() {
 
   // Simulation is much slower than real hardware so never timeout. On hardware
-  // even largest transfer should complete within 10 seconds
+  // even largest transfer should complete within 10 seconds. fpga->host DMA
+  // has never timed out.
 #ifdef SIM
   const int TIMEOUT = -1;
 #else
-  const int TIMEOUT = 10000;
+  const int TIMEOUT = wait_interrupt ? 10000 : -1;
 #endif
-  if (wait_interrupt) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
+  const int F2H_BLOCK_SLICE = 1;
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_PROGRAM | MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    if (wait_interrupt) {
       DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s Waiting for Interrupt\n",transaction_id, op_mode);
+    } else if (m_mode == dma_mode::d2d) {
+      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s Waiting for the copy completion count\n",transaction_id, op_mode);
+    } else {
+      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s Waiting for Magic Number to be written to host memory , which confirms completion of %s\n",transaction_id, op_mode, op_mode);
+    }
+  }
+
+  typedef std::chrono::steady_clock clock;
+  const clock::time_point start = clock::now();
+  auto elapsed_ns = [&]() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+  };
+  auto timed_out = [&](uint64_t ns) {
+    return TIMEOUT >= 0 && ns >= static_cast<uint64_t>(TIMEOUT) * 1000000;
+  };
+  m_wait_stats.waits++;
+
+  // Spin phase
+  uint64_t spin_ns = 0;
+  if (m_wait_policy != dma_wait_policy::interrupt) {
+    uint64_t budget = m_wait_policy == dma_wait_policy::hybrid ? m_spin_budget_ns : UINT64_MAX;
+    while (true) {
+      if (check_completion()) {
+        m_wait_stats.spin_completions++;
+        m_wait_stats.spin_ns += elapsed_ns();
+        return 0;
+      }
+      spin_ns = elapsed_ns();
+      if (spin_ns >= budget || timed_out(spin_ns)) {
+        break;
+      }
+      cpu_relax();
+    }
+    m_wait_stats.spin_ns += spin_ns;
+  }
+
+  // Blocking phase
+  while (!timed_out(elapsed_ns())) {
+    if (check_completion()) {
+      m_wait_stats.block_completions++;
+      m_wait_stats.block_ns += elapsed_ns() - spin_ns;
+      return 0;
     }
     int_event_fd.events = POLLIN;
-    int poll_res = poll(&int_event_fd, 1, TIMEOUT);
-    if (poll_res < 0) {
+    int poll_res = poll(&int_event_fd, 1, wait_interrupt ? TIMEOUT : F2H_BLOCK_SLICE);
+    if (poll_res < 0 && errno != EINTR) {
       fprintf(stderr, "TID : %ld DMA ---- %s Poll error\n",transaction_id, op_mode);
-    } else if (poll_res == 0) {
-      fprintf(stderr, "TID : %ld DMA ---- %s Poll timeout\n",transaction_id, op_mode);
-      read_status_registers();
+      m_wait_stats.block_ns += elapsed_ns() - spin_ns;
+      return -1;
+    }
+    if (poll_res > 0) {
+      m_wait_stats.wakeups++;
+      // Without the completion counter the host->fpga interrupt is the
+      // completion itself, check_completion() consumes it
+      if (!wait_interrupt || m_count_completions) {
+        clear_interrupt();
+      }
+    }
+  }
+  m_wait_stats.block_ns += elapsed_ns() - spin_ns;
+
+  fprintf(stderr, "TID : %ld DMA ---- %s Poll timeout\n",transaction_id, op_mode);
+  read_status_registers();
+  {
+      fprintf(stderr, "TID : %ld DMA ---- %s Print some mpf stats\n",transaction_id, op_mode);
+      
+      mpf_vtp_stats vtp_stats;
+      mpfVtpGetStats(mpf_handle, &vtp_stats);
+    
+      printf("TID : %ld DMA ---- %s #   VTP failed:            %ld\n", transaction_id, op_mode, vtp_stats.numFailedTranslations);
+      if (vtp_stats.numFailedTranslations)
       {
-          fprintf(stderr, "TID : %ld DMA ---- %s Print some mpf stats\n",transaction_id, op_mode);
-          
-          mpf_vtp_stats vtp_stats;
-          mpfVtpGetStats(mpf_handle, &vtp_stats);
-        
-          printf("TID : %ld DMA ---- %s #   VTP failed:            %ld\n", transaction_id, op_mode, vtp_stats.numFailedTranslations);
-          if (vtp_stats.numFailedTranslations)
-          {
-              printf("TID : %ld DMA ---- %s #   VTP failed addr:       0x%lx\n", transaction_id, op_mode, (uint64_t)vtp_stats.ptWalkLastVAddr);
-          }
-          printf("TID : %ld DMA ---- %s #   VTP PT walk cycles:    %ld\n", transaction_id, op_mode, vtp_stats.numPTWalkBusyCycles);
-          printf("TID : %ld DMA ---- %s #   VTP L2 4KB hit / miss: %ld / %ld\n",
-              transaction_id, op_mode, vtp_stats.numTLBHits4KB, vtp_stats.numTLBMisses4KB);
-          printf("TID : %ld DMA ---- %s #   VTP L2 2MB hit / miss: %ld / %ld\n",
-              transaction_id, op_mode, vtp_stats.numTLBHits2MB, vtp_stats.numTLBMisses2MB);
-        
-          //double cycles_per_pt = (double)vtp_stats.numPTWalkBusyCycles /
-          //                    (double)(vtp_stats.numTLBMisses4KB + vtp_stats.numTLBMisses2MB);
-          //
-          //double usec_per_cycle = 0;
-          //if (s_afu_mhz) usec_per_cycle = 1.0 / (double)s_afu_mhz;
-          //printf("#   VTP usec / PT walk:    %f\n\n", cycles_per_pt * usec_per_cycle);
+          printf("TID : %ld DMA ---- %s #   VTP failed addr:       0x%lx\n", transaction_id, op_mode, (uint64_t)vtp_stats.ptWalkLastVAddr);
       }
-      printf("\n");
-      return -1;
-    } else {
-      uint64_t count;
-      ssize_t bytes_read = read(int_event_fd.fd, &count, sizeof(count));
-      if (bytes_read < 0) {
-        fprintf(stderr, "TID : %ld DMA ---- %s Error: poll failed %s\n", transaction_id, op_mode, strerror(errno));
-        return -1;
+      printf("TID : %ld DMA ---- %s #   VTP PT walk cycles:    %ld\n", transaction_id, op_mode, vtp_stats.numPTWalkBusyCycles);
+      printf("TID : %ld DMA ---- %s #   VTP L2 4KB hit / miss: %ld / %ld\n",
+          transaction_id, op_mode, vtp_stats.numTLBHits4KB, vtp_stats.numTLBMisses4KB);
+      printf("TID : %ld DMA ---- %s #   VTP L2 2MB hit / miss: %ld / %ld\n",
+          transaction_id, op_mode, vtp_stats.numTLBHits2MB, vtp_stats.numTLBMisses2MB);
+    
+      //double cycles_per_pt = (double)vtp_stats.numPTWalkBusyCycles /
+      //                    (double)(vtp_stats.numTLBMisses4KB + vtp_stats.numTLBMisses2MB);
+      //
+      //double usec_per_cycle = 0;
+      //if (s_afu_mhz) usec_per_cycle = 1.0 / (double)s_afu_mhz;
+      //printf("#   VTP usec / PT walk:    %f\n\n", cycles_per_pt * usec_per_cycle);
+  }
+  printf("\n");
+  return -1;
+}
+
+/** fragment_cursor walks the host fragments of a staged transfer in order,
+ *  copying between them and the staging slots. A scalar transfer is a single
+ *  fragment.
+ */
+namespace {
+struct fragment_cursor {
+  const dma_fragment *frag;
+  uint64_t offset;
+  copy_engine *copier;
+
+  void copy(char *slot, uint64_t len, bool to_slot) {
+    while (len > 0) {
+      uint64_t n = std::min<uint64_t>(len, frag->size - offset);
+      char *host = static_cast<char *>(frag->host_addr) + offset;
+      if (to_slot) {
+        copier->copy(slot, host, n);
+      } else {
+        copier->copy(host, slot, n);
       }
-      if (bytes_read == 0) {
-        fprintf(stderr, "TID : %ld DMA ---- %s Error: poll failed zero bytes read\n",transaction_id, op_mode);
+      slot += n;
+      len -= n;
+      offset += n;
+      if (offset == frag->size) {
+        frag++;
+        offset = 0;
+      }
+    }
+  }
+};
+} // namespace
+
+/** do_staged_dma() moves a transfer through the ring of pinned staging slots
+ *  instead of pinning the user buffer, see stage_fragments().
+ *  The whole transfer holds m_dma_op_mutex since the slots are shared with
+ *  blocking callers.
+ */
+int mmd_dma::do_staged_dma(dma_work_item &item) {
+  dma_fragment frag = {item.host_addr, item.size};
+  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+  return stage_fragments(&frag, 1, item.dev_addr);
+}
+
+/** stage_fragments() moves host fragments that are contiguous on the device
+ *  through the staging slots. The fragments are packed back to back into the
+ *  slots, which are split into slot sized chunks and pipelined so the CPU copy
+ *  and the DMA run at the same time:
+ *  for host -> fpga the memcpy into slot k+1 happens while earlier slots are on the wire,
+ *  for fpga -> host every slot is kept queued and slot k is refilled as soon as
+ *  it has been copied out.
+ *  All descriptors have completed when it returns. Caller must hold m_dma_op_mutex.
+ */
+int mmd_dma::stage_fragments(const dma_fragment *frags, size_t num_frags, uint64_t dev_addr) {
+  if (staging_slots.size() < 2) {
+    fprintf(stderr, "TID : %ld DMA ---- %s , Error: DMA staging buffers not allocated\n", transaction_id, op_mode);
+    return -1;
+  }
+
+  uint64_t size = 0;
+  for (size_t i = 0; i < num_frags; i++) {
+    size += frags[i].size;
+  }
+  // Skip leading empty fragments so the cursor always points at data
+  while (num_frags > 0 && frags->size == 0) {
+    frags++;
+    num_frags--;
+  }
+  fragment_cursor cursor = {frags, 0, m_copy_engine};
+
+  const uint64_t num_slots = staging_slots.size();
+  const uint64_t num_chunks = (size + staging_slot_len - 1) / staging_slot_len;
+
+  auto chunk_len = [&](uint64_t k) {
+    return std::min<uint64_t>(staging_slot_len, size - k * staging_slot_len);
+  };
+  auto slot_addr = [&](uint64_t k) {
+    return reinterpret_cast<uint64_t>(staging_slots[k % num_slots]);
+  };
+  auto slot_ptr = [&](uint64_t k) {
+    return static_cast<char *>(staging_slots[k % num_slots]);
+  };
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Using intermediate DMA buffer (no pin mode) for %s DMA , host fragments : %zu , transaction size : 0x%lx , chunks : %ld \n", transaction_id, op_mode, num_frags, size, num_chunks);
+  }
+
+  // Chunk k completes at sequence number base + k + 1, slot k % num_slots can
+  // be reused once that chunk has completed
+  const uint64_t base = m_submitted;
+
+  if (m_mode == dma_mode::h2f) {
+    for (uint64_t k = 0; k < num_chunks; k++) {
+      // Fill the next slot while the previous chunks are being transferred
+      if (k >= num_slots && wait_for_completions(base + k - num_slots + 1) != 0) {
         return -1;
       }
-      if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-        DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s Interrupt received\n",transaction_id, op_mode);
+      cursor.copy(slot_ptr(k), chunk_len(k), true);
+      if (submit_descriptor(slot_addr(k), dev_addr + k * staging_slot_len, chunk_len(k)) != 0) {
+        wait_for_completions(m_submitted);
+        return -1;
       }
     }
+    return wait_for_completions(m_submitted);
   }
 
-  const uint64_t FPGA_DMA_WF_MAGIC_NO = 0x5772745F53796E63ULL;
-  if (wait_fpga_write) {
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s Waiting for Magic Number to be written to host memory , which confirms completion of %s\n",transaction_id, op_mode, op_mode);
+  uint64_t next = 0;
+  for (; next < num_chunks && next < num_slots; next++) {
+    if (submit_descriptor(dev_addr + next * staging_slot_len, slot_addr(next), chunk_len(next)) != 0) {
+      wait_for_completions(m_submitted);
+      return -1;
     }
-    while (*fpga_write_addr != FPGA_DMA_WF_MAGIC_NO) {
-#if 0
-      printf("\n");
-      read_status_registers();
-      sleep(1);
-#endif
-      std::this_thread::yield();
+  }
+  for (uint64_t k = 0; k < num_chunks; k++) {
+    if (wait_for_completions(base + k + 1) != 0) {
+      return -1;
     }
-    if(std::getenv("MMD_PROGRAM_DEBUG") || std::getenv("MMD_DMA_DEBUG") || std::getenv("MMD_ENABLE_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s Magic Number written to host memory , which confirms completion of %s\n",transaction_id, op_mode, op_mode);
+    cursor.copy(slot_ptr(k), chunk_len(k), false);
+    // Slot k is free again, queue the chunk that goes into it
+    if (next < num_chunks) {
+      if (submit_descriptor(dev_addr + next * staging_slot_len, slot_addr(next), chunk_len(next)) != 0) {
+        wait_for_completions(m_submitted);
+        return -1;
+      }
+      next++;
     }
-    *fpga_write_addr = 0;
+  }
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Copied from intermediate dma buffer(no pin mode) to host addr, host fragments : %zu , transaction size : 0x%lx \n\n", transaction_id, op_mode, num_frags, size);
   }
   return 0;
 }
 
-/** do_dma() function is called by enqueue_dma() function
- *  it determines the dma host, src addresses from work item
- *  it pins host memory to improve performance
- *  if transfer size is less than 'threshold' which can be tuned,
- *  it uses intermediate buffer to perforam DMA,
- *  because performance won't be affected a lot at small transfer size
- *  if transfer size > 'threshold' it pins the host memory and unpins when done with DMA
- *  it determines appropriate dma src, dst, len and calles send_descriptors() function  
+/** do_windowed_dma() sends a large host buffer that is not pinned yet
+ *  through a sliding window of m_pin_window bytes instead of pinning all of
+ *  it up front: window k+1 is pinned while window k is on the wire, and
+ *  window k is released as soon as it has completed, while k+1 is still
+ *  transferring. The first descriptor goes out after one window has been
+ *  pinned, and no more than two windows are locked at any time whatever the
+ *  size of the transfer. Windows end on host page boundaries, the first one
+ *  is stretched to the next one, so releasing a window never unpins a page
+ *  the next window still uses.
+ *  All descriptors have completed when it returns.
  */
-int mmd_dma::do_dma(dma_work_item &item) {
-// adding the following mutex will disable double buffering  
-// const std::lock_guard<std::mutex> lock(pinning_mutex);
-#if 0 
-  printf("do_dma\t");
-  if (m_mode == dma_mode::f2h) {
-    printf("f2h\t");
-  } else {
-    printf("h2f\t");
+int mmd_dma::do_windowed_dma(dma_work_item &item) {
+  char *host = static_cast<char *>(item.host_addr);
+  const uint64_t first_len = host_page_split(host, m_pin_window, item.size);
+  const uint64_t num_windows = 1 + (item.size - first_len + m_pin_window - 1) / m_pin_window;
+  dma_host_pin pins[2] = {dma_host_pin{nullptr, false, nullptr}, dma_host_pin{nullptr, false, nullptr}};
+  uint64_t window_seq[2] = {0, 0};
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Pinning host memory a window at a time , host_addr : %p , transaction size : 0x%zx , windows : %ld \n", transaction_id, op_mode, item.host_addr, item.size, num_windows);
   }
-  printf("host: %p\t dev: 0x%lx\t len: 0x%lx\n", item.host_addr, item.dev_addr,
-         item.size);
-#endif
 
-  static_assert(sizeof(void *) == 8, "Error pointer size not equal to 8 bytes");
-  uint64_t host_addr = 0;
-
-  // If host address is already managed by VTP then use it directly, otherwise
-  // pin the host memory so that it is managed by VTP if it is larger than
-  // threshold (2MB as of when comment was first written, could be tuned). If
-  // transfer is smaller than threshold use prepinned DMA buffer and memcpy
-  // to/from host to DMA buffer
-  bool use_dma_buffer;
-  if(item.size > threshold) {
-    use_dma_buffer = false;
-    fpga_result res;
-    res = mpfVtpPrepareBuffer(mpf_handle, item.size, &item.host_addr, FPGA_BUF_PREALLOCATED);
-    if(res != FPGA_OK) { 
-      fprintf(stderr,"TID : %ld DMA ---- %s Error mpfVtpPrepareBuffer %s\n", transaction_id, op_mode, fpgaErrStr(res));
-      return -1;
+  int dma_res = 0;
+  uint64_t k = 0;
+  uint64_t offset = 0;
+  for (; k < num_windows && dma_res == 0; k++) {
+    uint64_t len = host_page_split(host + offset, m_pin_window, item.size - offset);
+    // Pinning takes no DMA lock, blocking callers and the other window keep going
+    if (pin_host(host + offset, len, false, pins[k % 2]) != 0) {
+      dma_res = -1;
+      break;
     }
-    if(std::getenv("MMD_DMA_DEBUG")){	    
-      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Pinned host memory for %s DMA , host_addr : %p , transaction size : 0x%zx \n",transaction_id, op_mode, item.host_addr, item.size);
+    {
+      std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+      dma_res = submit_range(reinterpret_cast<uint64_t>(host + offset), item.dev_addr + offset, len);
+      window_seq[k % 2] = m_submitted;
+      if (k > 0 && wait_for_completions(window_seq[(k - 1) % 2]) != 0) {
+        dma_res = -1;
+      }
     }
-    host_addr = reinterpret_cast<uint64_t>(item.host_addr);
-  } else {
-    use_dma_buffer = true;
-    host_addr = reinterpret_cast<uint64_t>(dma_buffer);
-    if(m_mode == dma_mode::h2f) {
-      memcpy(dma_buffer, item.host_addr, item.size);
+    if (k > 0) {
+      unpin_host(pins[(k - 1) % 2]);
     }
-    if(std::getenv("MMD_DMA_DEBUG")){	    
-      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Using intermediate DMA buffer (no pin mode) for %s DMA , host_addr : %p , transaction size : 0x%zx \n", transaction_id, op_mode, item.host_addr, item.size);
-      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Using intermediate DMA buffer (no pin mode) is slow , so expect performance impact \n", transaction_id);
+    offset += len;
+  }
+
+  // Only the window submitted last is still pinned
+  {
+    std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+    if (wait_for_completions(m_submitted) != 0) {
+      dma_res = -1;
     }
   }
-  assert(host_addr != 0);
-  
+  if (k > 0) {
+    unpin_host(pins[(k - 1) % 2]);
+  }
+  return dma_res;
+}
+
+/** do_dma() function is called by enqueue_dma() for blocking transfers
+ *  it starts the transfer with start_dma(), waits for its last descriptor
+ *  and releases the host memory with finish_dma()
+ */
+int mmd_dma::do_dma(dma_work_item &item) {
+  dma_inflight_item inflight;
+  int dma_res = start_dma(item, inflight);
+  {
+    std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+    if (wait_for_completions(inflight.last_seq) != 0) {
+      dma_res = -1;
+    }
+  }
+  finish_dma(inflight);
+  m_pending_bytes.fetch_sub(item.size, std::memory_order_relaxed);
+  return dma_res;
+}
+
+/** direct_dma() tells whether a host buffer is sent straight from its own
+ *  pages, or goes through the staging slots
+ *  If host address is already managed by VTP then use it directly, otherwise
+ *  pin the host memory so that it is managed by VTP if it is larger than
+ *  threshold (2MB as of when comment was first written, could be tuned). If
+ *  transfer is smaller than threshold use the prepinned staging slots and
+ *  memcpy to/from host to DMA buffer.
+ *  Memory from aocl_mmd_host_alloc is pinned for its whole lifetime, so it
+ *  is sent directly whatever the size.
+ */
+bool mmd_dma::direct_dma(void *host_addr, size_t size, bool &prepinned) {
+  prepinned = m_prepinned && m_prepinned->contains(host_addr, size);
+  return prepinned || size > threshold;
+}
+
+/** pin_host() makes a host buffer visible to VTP for a direct transfer
+ *  Buffers that are reused across transfers stay pinned in the pin cache,
+ *  only pin and unpin around this transfer if the cache can't take it
+ */
+int mmd_dma::pin_host(void *host_addr, size_t size, bool prepinned, dma_host_pin &pin) {
+  pin.addr = host_addr;
+  pin.pinned = false;
+  pin.cached_pin = nullptr;
+
+  if (prepinned) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Using MMD allocated host memory for %s DMA , host_addr : %p , transaction size : 0x%zx \n",transaction_id, op_mode, host_addr, size);
+    }
+    return 0;
+  }
+  if (m_pin_cache) {
+    pin.cached_pin = m_pin_cache->acquire(host_addr, size);
+  }
+  if (pin.cached_pin != nullptr) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Using cached pinned host memory for %s DMA , host_addr : %p , transaction size : 0x%zx \n",transaction_id, op_mode, host_addr, size);
+    }
+    return 0;
+  }
+  fpga_result res = mpfVtpPrepareBuffer(mpf_handle, size, &pin.addr, FPGA_BUF_PREALLOCATED);
+  if(res != FPGA_OK) { 
+    fprintf(stderr,"TID : %ld DMA ---- %s Error mpfVtpPrepareBuffer %s\n", transaction_id, op_mode, fpgaErrStr(res));
+    return -1;
+  }
+  pin.pinned = true;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){	    
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- Pinned host memory for %s DMA , host_addr : %p , transaction size : 0x%zx \n",transaction_id, op_mode, host_addr, size);
+  }
+  return 0;
+}
+
+/** unpin_host() undoes pin_host() once all descriptors using the buffer
+ *  have completed
+ */
+void mmd_dma::unpin_host(dma_host_pin &pin) {
+  if (pin.cached_pin) {
+    m_pin_cache->release(pin.cached_pin);
+    pin.cached_pin = nullptr;
+    return;
+  }
+  if (!pin.pinned) {
+    return;
+  }
+
+  fpga_result res = mpfVtpReleaseBuffer(mpf_handle, pin.addr);
+  pin.pinned = false;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Releasing pinned host memory after DMA transaction, host_addr : %p \n\n", transaction_id, op_mode, pin.addr);
+  }
+  if(res != FPGA_OK) {
+    fprintf(stderr,"e TID : %ld DMA ---- %s ,Error mpfVtpReleaseBuffer %s \n", transaction_id, op_mode, fpgaErrStr(res));
+  }  
+}
+
+/** submit_range() sends a pinned host buffer to the hardware
+ *  it determines appropriate dma src, dst, len and calls submit_descriptor() function,
+ *  splitting the range at max_dma_len when that is set.
+ *  Caller must hold m_dma_op_mutex.
+ */
+int mmd_dma::submit_range(uint64_t host_addr, uint64_t dev_addr, uint64_t dma_len) {
   uint64_t dma_src_addr = 0;
   uint64_t dma_dst_addr = 0;
-  uint64_t dma_len = item.size;
 
   switch (m_mode) {
   case dma_mode::h2f:
     dma_src_addr = host_addr;
-    dma_dst_addr = item.dev_addr;
+    dma_dst_addr = dev_addr;
     break;
   case dma_mode::f2h:
-    dma_src_addr = item.dev_addr;
+    dma_src_addr = dev_addr;
     dma_dst_addr = host_addr;
     break;
   default:
     fprintf(stderr, "TID : %ld DMA ---- %s , Error: invalid mode\n",transaction_id, op_mode);
   }
 
-  int dma_res = 0;
-
   // Note: If max_dma_len is greater than 63*1024 for FPGA to host then the DMA
   // block hangs running on FPGA hardware. Error does not occur in simulation.
   while(max_dma_len > 0 && dma_len > max_dma_len) {
-    if(std::getenv("MMD_DMA_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
       DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Sending descriptors to DMA hardware controller, dma_src_addr : %ld , dma_dst_addr : %ld, max_dma_len : %ld \n", transaction_id, op_mode, dma_src_addr, dma_dst_addr, max_dma_len);
     }
-    dma_res = send_descriptors(dma_src_addr, dma_dst_addr, max_dma_len);
-    if (dma_res != 0) {
-      return dma_res;
+    if (submit_descriptor(dma_src_addr, dma_dst_addr, max_dma_len) != 0) {
+      return -1;
     }
     dma_src_addr += max_dma_len;
     dma_dst_addr += max_dma_len;
     dma_len -= max_dma_len;
   }
   if(dma_len > 0) {
-      if(std::getenv("MMD_DMA_DEBUG")){
+      if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
         DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Sent descriptors to DMA hardware controller, dma_src_addr : %ld , dma_dst_addr : %ld, max_dma_len : %ld \n", transaction_id, op_mode, dma_src_addr, dma_dst_addr, max_dma_len);
       }
-      dma_res = send_descriptors(dma_src_addr, dma_dst_addr, dma_len);
+      return submit_descriptor(dma_src_addr, dma_dst_addr, dma_len);
   }
+  return 0;
+}
 
-  // Copy data from DMA buffer to host buffer if necessary
-  if (use_dma_buffer && m_mode == dma_mode::f2h) {
-    memcpy(item.host_addr, dma_buffer, item.size);
-    if(std::getenv("MMD_DMA_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Copying from intermediate dma buffer(no pin mode) to host addr, host_addr : %p , transaction size : 0x%zx \n\n", transaction_id, op_mode, item.host_addr, item.size );
-    }
+/** start_dma() function is called by do_dma() and work_thread()
+ *  it determines the dma host, src addresses from work item
+ *  it pins host memory to improve performance
+ *  if transfer size is less than 'threshold' which can be tuned,
+ *  it goes through the pinned staging slots instead, see do_staged_dma()
+ *  if transfer size > 'threshold' it pins the host memory, finish_dma() unpins it when done with DMA
+ *  buffers larger than m_pin_window are pinned a window at a time instead, see do_windowed_dma()
+ *  it returns once the descriptors are queued, inflight records the sequence
+ *  number of the last one and how the host memory was pinned
+ */
+int mmd_dma::start_dma(dma_work_item &item, dma_inflight_item &inflight) {
+// adding the following mutex will disable double buffering  
+// const std::lock_guard<std::mutex> lock(pinning_mutex);
+#if 0 
+  printf("start_dma\t");
+  if (m_mode == dma_mode::f2h) {
+    printf("f2h\t");
+  } else {
+    printf("h2f\t");
   }
+  printf("host: %p\t dev: 0x%lx\t len: 0x%lx\n", item.host_addr, item.dev_addr,
+         item.size);
+#endif
 
-  if(!use_dma_buffer){
-    fpga_result res = mpfVtpReleaseBuffer(mpf_handle, item.host_addr);
-    if(std::getenv("MMD_DMA_DEBUG")){
-      DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Releasing pinned host memory after DMA transaction, host_addr : %p \n\n", transaction_id, op_mode, item.host_addr);
+  static_assert(sizeof(void *) == 8, "Error pointer size not equal to 8 bytes");
+
+  inflight.item = item;
+  inflight.last_seq = 0;
+  inflight.pin = dma_host_pin{item.host_addr, false, nullptr};
+  inflight.status = 0;
+
+  if (item.frags != nullptr) {
+    return start_vectored_dma(item, inflight);
+  }
+
+  // Slices go the same way as the whole item would
+  bool prepinned = false;
+  bool direct = direct_dma(item.host_addr, item.size, prepinned) || item.slice_total > threshold;
+  if(!direct) {
+    // Staged transfers have completed by the time do_staged_dma() returns
+    return do_staged_dma(item);
+  }
+  if (!prepinned && m_pin_window > 0 && item.size > m_pin_window) {
+    // So have windowed ones
+    return do_windowed_dma(item);
+  }
+
+  if (pin_host(item.host_addr, item.size, prepinned, inflight.pin) != 0) {
+    return -1;
+  }
+  uint64_t host_addr = reinterpret_cast<uint64_t>(item.host_addr);
+  assert(host_addr != 0);
+
+  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+  int dma_res = submit_range(host_addr, item.dev_addr, item.size);
+  // Whatever made it to the hardware must complete before the memory is released
+  inflight.last_seq = m_submitted;
+  return dma_res;
+}
+
+/** start_vectored_dma() starts a transfer between a list of host fragments and
+ *  one contiguous device range as a single batch. Fragments that go direct are
+ *  pinned first, then all descriptors are submitted under one hold of
+ *  m_dma_op_mutex. Neighbouring fragments that go through the staging slots
+ *  are packed into the slots together, so a run of small fragments costs one
+ *  descriptor per slot instead of one per fragment.
+ */
+int mmd_dma::start_vectored_dma(dma_work_item &item, dma_inflight_item &inflight) {
+  const dma_fragment *frags = item.frags;
+  const size_t num_frags = item.num_frags;
+
+  std::vector<bool> direct(num_frags);
+  inflight.fragment_pins.assign(num_frags, dma_host_pin{nullptr, false, nullptr});
+  for (size_t i = 0; i < num_frags; i++) {
+    bool prepinned = false;
+    direct[i] = frags[i].size > 0 && direct_dma(frags[i].host_addr, frags[i].size, prepinned);
+    if (direct[i] && pin_host(frags[i].host_addr, frags[i].size, prepinned, inflight.fragment_pins[i]) != 0) {
+      return -1;
     }
-    if(res != FPGA_OK) {
-      fprintf(stderr,"e TID : %ld DMA ---- %s ,Error mpfVtpReleaseBuffer %s \n", transaction_id, op_mode, fpgaErrStr(res));
-    }  
   }
 
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : TID : %ld DMA ---- %s , Vectored transfer , host fragments : %zu , device_addr : %ld , transaction size : 0x%zx \n", transaction_id, op_mode, num_frags, item.dev_addr, item.size);
+  }
+
+  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+  int dma_res = 0;
+  uint64_t dev_addr = item.dev_addr;
+  size_t i = 0;
+  while (dma_res == 0 && i < num_frags) {
+    if (direct[i]) {
+      dma_res = submit_range(reinterpret_cast<uint64_t>(frags[i].host_addr), dev_addr, frags[i].size);
+      dev_addr += frags[i].size;
+      i++;
+      continue;
+    }
+    size_t run_end = i;
+    uint64_t run_size = 0;
+    while (run_end < num_frags && !direct[run_end]) {
+      run_size += frags[run_end].size;
+      run_end++;
+    }
+    if (run_size > 0) {
+      dma_res = stage_fragments(frags + i, run_end - i, dev_addr);
+    }
+    dev_addr += run_size;
+    i = run_end;
+  }
+  inflight.last_seq = m_submitted;
   return dma_res;
 }
 
+/** finish_dma() releases the host memory of a transfer once all of its
+ *  descriptors have completed
+ */
+void mmd_dma::finish_dma(dma_inflight_item &inflight) {
+  unpin_host(inflight.pin);
+  for (dma_host_pin &pin : inflight.fragment_pins) {
+    unpin_host(pin);
+  }
+  inflight.fragment_pins.clear();
+  delete[] inflight.item.frags;
+  inflight.item.frags = nullptr;
+}
+
 /** fpga_to_host() function as name suggests for fpga -> host DMA
  *  it constructs a dma work item and adds it to a queue
  *  DMA uses two queues, one for host to fpga and one for fpga to host DMA
  */
 int mmd_dma::fpga_to_host(aocl_mmd_op_t op, void *host_addr,
-                                  size_t dev_addr, size_t size) {
+                                  size_t dev_addr, size_t size, dma_priority priority) {
   transaction_id++;
   assert(host_addr);
   assert(m_mode == dma_mode::f2h);
 
   dma_work_item item = {
       .op = op, .host_addr = host_addr, .dev_addr = dev_addr, .size = size};
+  item.priority = priority;
 
-  if(std::getenv("MMD_DMA_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
     DEBUG_LOG("\nDEBUG LOG : TID : %ld DMA ---- %s TRANSACTION , host_addr = %p, device_addr = %ld, transaction size = 0x%zx\n", transaction_id, op_mode,host_addr, dev_addr, size);
   }
   return enqueue_dma(item);
@@ -525,7 +1610,7 @@ int mmd_dma::fpga_to_host(aocl_mmd_op_t op, void *host_addr,
  *  DMA uses two queues, one for host to fpga and one for fpga to host DMA
  */
 int mmd_dma::host_to_fpga(aocl_mmd_op_t op, const void *host_addr,
-                                  size_t dev_addr, size_t size) {
+                                  size_t dev_addr, size_t size, dma_priority priority) {
   transaction_id++;
   assert(host_addr);
   assert(m_mode == dma_mode::h2f);
@@ -534,9 +1619,257 @@ int mmd_dma::host_to_fpga(aocl_mmd_op_t op, const void *host_addr,
                         .host_addr = const_cast<void *>(host_addr),
                         .dev_addr = dev_addr,
                         .size = size};
-  if(std::getenv("MMD_DMA_DEBUG")){
+  item.priority = priority;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
     DEBUG_LOG("\nDEBUG LOG : TID : %ld DMA ---- %s TRANSACTION , host_addr = %p, device_addr = %ld, transaction size = 0x%zx\n", transaction_id, op_mode, host_addr, dev_addr, size);
   }
   return enqueue_dma(item);
 }
+
+/** transfer_piece() queues one piece of a transfer striped over several DMA
+ *  engines. The piece reports to group instead of calling the status handler,
+ *  see dma_engine_set.
+ */
+int mmd_dma::transfer_piece(dma_completion_group *group, void *host_addr,
+                            size_t dev_addr, size_t size, dma_priority priority) {
+  transaction_id++;
+  assert(host_addr);
+  assert(group);
+
+  dma_work_item item = {.op = nullptr, .host_addr = host_addr, .dev_addr = dev_addr, .size = size};
+  item.group = group;
+  item.priority = priority;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("\nDEBUG LOG : TID : %ld DMA ---- %s STRIPED TRANSACTION , host_addr = %p, device_addr = %ld, transaction size = 0x%zx\n", transaction_id, op_mode, host_addr, dev_addr, size);
+  }
+  return enqueue_dma(item);
+}
+
+/** device_copy() copies within device memory with the copy channel of the
+ *  DMA, the data never crosses PCIe. Each descriptor is read ahead into the
+ *  controller's data buffer before it is written, and descriptors run one
+ *  after the other, so a range that overlaps its destination is sent in
+ *  pieces no longer than the distance between them, back to front when the
+ *  destination is above the source; a piece then never writes data that a
+ *  later piece still has to read.
+ *  Blocks until every descriptor has completed.
+ */
+int mmd_dma::device_copy(size_t src_addr, size_t dst_addr, size_t size) {
+  if (m_mode != dma_mode::d2d || ((src_addr | dst_addr | size) % device_copy_align) != 0) {
+    return -1;
+  }
+  transaction_id++;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("\nDEBUG LOG : TID : %ld DMA ---- %s src_addr = 0x%zx, dst_addr = 0x%zx, transaction size = 0x%zx\n", transaction_id, op_mode, src_addr, dst_addr, size);
+  }
+  if (size == 0 || src_addr == dst_addr) {
+    return 0;
+  }
+
+  const bool overlap = src_addr < dst_addr + size && dst_addr < src_addr + size;
+  const bool backwards = overlap && dst_addr > src_addr;
+  const uint64_t piece_len = overlap ? (backwards ? dst_addr - src_addr : src_addr - dst_addr) : size;
+
+  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+  uint64_t done = 0;
+  while (done < size) {
+    uint64_t len = std::min<uint64_t>(piece_len, size - done);
+    uint64_t offset = backwards ? size - done - len : done;
+    if (submit_descriptor(src_addr + offset, dst_addr + offset, len) != 0) {
+      wait_for_completions(m_submitted);
+      return -1;
+    }
+    done += len;
+  }
+  return wait_for_completions(m_submitted);
+}
+
+/** make_vectored_item() builds the work item of a vectored transfer, the
+ *  fragment list is copied since the caller may release it before an async
+ *  transfer has finished. finish_dma() frees it.
+ */
+dma_work_item mmd_dma::make_vectored_item(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                                          size_t iovcnt, size_t dev_addr) {
+  dma_work_item item = {.op = op, .host_addr = nullptr, .dev_addr = dev_addr, .size = 0};
+  item.frags = new dma_fragment[iovcnt > 0 ? iovcnt : 1];
+  item.num_frags = iovcnt;
+  for (size_t i = 0; i < iovcnt; i++) {
+    assert(iov[i].base || iov[i].len == 0);
+    item.frags[i].host_addr = iov[i].base;
+    item.frags[i].size = iov[i].len;
+    item.size += iov[i].len;
+  }
+  return item;
+}
+
+/** fpga_to_host_v() scatters one contiguous device range into a list of
+ *  host fragments with a single completion
+ */
+int mmd_dma::fpga_to_host_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                            size_t iovcnt, size_t dev_addr, dma_priority priority) {
+  transaction_id++;
+  assert(iov || iovcnt == 0);
+  assert(m_mode == dma_mode::f2h);
+
+  dma_work_item item = make_vectored_item(op, iov, iovcnt, dev_addr);
+  item.priority = priority;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("\nDEBUG LOG : TID : %ld DMA ---- %s VECTORED TRANSACTION , host fragments = %zu, device_addr = %ld, transaction size = 0x%zx\n", transaction_id, op_mode, iovcnt, dev_addr, item.size);
+  }
+  return enqueue_dma(item);
+}
+
+/** host_to_fpga_v() gathers a list of host fragments into one contiguous
+ *  device range with a single completion
+ */
+int mmd_dma::host_to_fpga_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                            size_t iovcnt, size_t dev_addr, dma_priority priority) {
+  transaction_id++;
+  assert(iov || iovcnt == 0);
+  assert(m_mode == dma_mode::h2f);
+
+  dma_work_item item = make_vectored_item(op, iov, iovcnt, dev_addr);
+  item.priority = priority;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("\nDEBUG LOG : TID : %ld DMA ---- %s VECTORED TRANSACTION , host fragments = %zu, device_addr = %ld, transaction size = 0x%zx\n", transaction_id, op_mode, iovcnt, dev_addr, item.size);
+  }
+  return enqueue_dma(item);
+}
+/** time_descriptor() returns how long one transfer of len bytes between a
+ *  staging slot and the device takes from submit to completion, in ns, or
+ *  UINT64_MAX if it failed
+ */
+uint64_t mmd_dma::time_descriptor(uint64_t host_addr, uint64_t dev_addr, uint64_t len) {
+  std::lock_guard<std::mutex> lock(m_dma_op_mutex);
+  uint64_t start_ns = steady_now_ns();
+  if (submit_range(host_addr, dev_addr, len) != 0) {
+    wait_for_completions(m_submitted);
+    return UINT64_MAX;
+  }
+  if (wait_for_completions(m_submitted) != 0) {
+    return UINT64_MAX;
+  }
+  return steady_now_ns() - start_ns;
+}
+
+/** calibrate() measures what the bounce-vs-pin decision and the staging
+ *  chunk size depend on: the copy into a staging slot, pinning a fresh host
+ *  buffer with VTP, and the setup and per byte cost of one descriptor.
+ *  Each measurement is the best of a few runs. From these it picks
+ *
+ *  copy_threshold: staged transfers overlap the memcpy with the DMA, so they
+ *  cost about setup + max(copy, dma) per byte, while direct ones cost
+ *  pin + setup + dma per byte. The threshold is the size where both meet; if
+ *  copying is never slower it is capped at dma_calibration_max_threshold.
+ *  Pins served by the pin cache are cheaper than measured here, which only
+ *  makes the threshold err towards staging.
+ *
+ *  chunk_len: the smallest power of two whose descriptor setup stays under
+ *  1/dma_calibration_setup_ratio of its transfer time, so staged transfers
+ *  pipeline in chunks as small as is still efficient.
+ *
+ *  The device memory at dev_addr is overwritten by host->fpga calibration.
+ */
+int mmd_dma::calibrate(uint64_t dev_addr, dma_calibration &result) {
+  const int reps = 5;
+  const uint64_t dma_calibration_max_threshold = 64 * 1024 * KB;
+  const uint64_t dma_calibration_setup_ratio = 10;
+
+  if (staging_slots.size() < 2) {
+    return -1;
+  }
+  const uint64_t big = staging_slot_bytes;
+  const uint64_t small = std::min<uint64_t>(4 * KB, big);
+  void *host = nullptr;
+  if (posix_memalign(&host, 4 * KB, big) != 0) {
+    return -1;
+  }
+  memset(host, 0, big);
+
+  uint64_t copy_ns = UINT64_MAX;
+  uint64_t pin_small_ns = UINT64_MAX;
+  uint64_t pin_big_ns = UINT64_MAX;
+  uint64_t dma_small_ns = UINT64_MAX;
+  uint64_t dma_big_ns = UINT64_MAX;
+  uint64_t slot = reinterpret_cast<uint64_t>(staging_slots[1]);
+  int res = 0;
+  for (int i = 0; i < reps && res == 0; i++) {
+    uint64_t start_ns = steady_now_ns();
+    if (m_mode == dma_mode::h2f) {
+      m_copy_engine->copy(staging_slots[0], host, big);
+    } else {
+      m_copy_engine->copy(host, staging_slots[0], big);
+    }
+    copy_ns = std::min(copy_ns, steady_now_ns() - start_ns);
+
+    const uint64_t pin_sizes[] = {small, big};
+    for (uint64_t len : pin_sizes) {
+      void *addr = host;
+      start_ns = steady_now_ns();
+      if (mpfVtpPrepareBuffer(mpf_handle, len, &addr, FPGA_BUF_PREALLOCATED) != FPGA_OK) {
+        res = -1;
+        break;
+      }
+      mpfVtpReleaseBuffer(mpf_handle, addr);
+      uint64_t &best = len == small ? pin_small_ns : pin_big_ns;
+      best = std::min(best, steady_now_ns() - start_ns);
+    }
+
+    dma_small_ns = std::min(dma_small_ns, time_descriptor(slot, dev_addr, small));
+    dma_big_ns = std::min(dma_big_ns, time_descriptor(slot, dev_addr, big));
+  }
+  free(host);
+  if (res != 0 || dma_small_ns == UINT64_MAX || dma_big_ns == UINT64_MAX || big <= small) {
+    return -1;
+  }
+
+  // Everything below in ns per byte
+  double copy = static_cast<double>(copy_ns) / big;
+  double pin_per_byte = std::max(0.0, (static_cast<double>(pin_big_ns) - pin_small_ns) / (big - small));
+  double pin_fixed = std::max(0.0, pin_small_ns - pin_per_byte * small);
+  double dma = std::max(0.0, (static_cast<double>(dma_big_ns) - dma_small_ns) / (big - small));
+  double setup = std::max(0.0, dma_small_ns - dma * small);
+
+  // staged costs max(copy, dma) per byte, direct pin_fixed + (pin + dma) per byte
+  double extra_per_byte = std::max(copy, dma) - dma - pin_per_byte;
+  uint64_t copy_threshold = dma_calibration_max_threshold;
+  if (extra_per_byte > 0 && pin_fixed / extra_per_byte < dma_calibration_max_threshold) {
+    copy_threshold = static_cast<uint64_t>(pin_fixed / extra_per_byte) & ~(4 * KB - 1);
+  }
+
+  uint64_t chunk = 4 * KB;
+  while (chunk < big && setup * dma_calibration_setup_ratio > dma * chunk) {
+    chunk *= 2;
+  }
+
+  result.copy_ns_per_kb = copy * KB;
+  result.pin_ns = pin_fixed;
+  result.pin_ns_per_kb = pin_per_byte * KB;
+  result.dma_setup_ns = setup;
+  result.dma_ns_per_kb = dma * KB;
+  result.copy_threshold = copy_threshold;
+  result.chunk_len = std::min(chunk, big);
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA | MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : DMA ---- %s calibration : memcpy %.1f ns/KB , pin %.0f ns + %.1f ns/KB , descriptor %.0f ns + %.1f ns/KB -> copy threshold 0x%lx , chunk 0x%lx\n",
+              op_mode, result.copy_ns_per_kb, result.pin_ns, result.pin_ns_per_kb,
+              result.dma_setup_ns, result.dma_ns_per_kb, result.copy_threshold, result.chunk_len);
+  }
+  return 0;
+}
+
+/** set_tuning() replaces the bounce-vs-pin threshold and the staging chunk
+ *  size. The chunk is kept within the staging slots and, for fpga->host, the
+ *  maximum descriptor length. Only call it while no transfer is queued.
+ */
+void mmd_dma::set_tuning(uint64_t copy_threshold, uint64_t chunk_len) {
+  uint64_t limit = staging_slot_bytes;
+  if (max_dma_len > 0 && max_dma_len < limit) {
+    limit = max_dma_len;
+  }
+  threshold = copy_threshold;
+  chunk_len = chunk_len & ~uint64_t(63);
+  staging_slot_len = chunk_len == 0 ? limit : std::min(chunk_len, limit);
+  update_slice_len();
+}
 }// namespace intel_opae_mmd
@@ -8,41 +8,198 @@
 #include <opae/mpf/mpf.h>
 #include <poll.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "aocl_mmd.h"
+#include "mmd_completion.h"
+#include "mmd_config.h"
+#include "mmd_copy.h"
+#include "mmd_mpsc_ring.h"
+#include "mmd_pin_cache.h"
+#include "mmd_staging_pool.h"
 
 namespace intel_opae_mmd {
 
-enum class dma_mode { f2h, h2f };
+// d2d is the device-to-device copy channel of the DMA, see mmd_dma::device_copy()
+enum class dma_mode { f2h, h2f, d2d };
+
+// How a DMA direction waits for descriptor completion
+enum class dma_wait_policy {
+  spin,      // busy poll with a pause between checks
+  umwait,    // fpga->host: umonitor/umwait on the completion word
+  hybrid,    // spin for a while, then sleep on the interrupt
+  interrupt  // sleep on the interrupt straight away
+};
+
+// Host buffers are pinned in whole pages of this size
+const uint64_t host_page_len = 4096;
+
+// The dispatcher accepts up to 16 descriptors per direction in its command
+// queue. Leave some headroom below that so a full window never back-pressures
+// the MMIO writes. Can be lowered with dma_max_inflight, a value of 1
+// restores the wait-per-descriptor behaviour.
+const uint32_t dma_cmdq_depth = 16;
+const uint32_t dma_max_inflight = dma_cmdq_depth - 2;
+
+/** host_page_split() is the length of the next piece of a host range, about
+ *  nominal bytes long but stretched to end on a host page boundary. Pieces
+ *  that are pinned and released on their own then never share a page.
+ *  With nominal a multiple of host_page_len only the first piece of a range
+ *  is stretched.
+ */
+inline uint64_t host_page_split(const void *host, uint64_t nominal, uint64_t remaining) {
+  uint64_t start = reinterpret_cast<uint64_t>(host);
+  uint64_t end = (start + nominal + host_page_len - 1) & ~(host_page_len - 1);
+  return std::min(end - start, remaining);
+}
+
+// Priority class of an async transfer, see mmd_dma::next_work_item()
+enum class dma_priority { normal, high };
+const int dma_num_priorities = 2;
+
+// Counters of one priority class, only updated by the work thread
+struct dma_class_stats {
+  uint64_t started;          // async items picked up by the work thread
+  uint64_t total_latency_ns; // enqueue to start, summed over started items
+  uint64_t max_latency_ns;
+  uint64_t bytes;            // bytes started
+  uint64_t slices;           // slices of items larger than the slice length
+  uint64_t throttled;        // times queued work was held back by the bandwidth cap
+};
+
+// Submission queue counters, only updated by the work thread
+struct dma_queue_stats {
+  dma_class_stats classes[dma_num_priorities];
+  uint64_t parks;            // times the work thread went to sleep
+  uint64_t coalesced_items;   // items sent as part of a coalesced transfer
+  uint64_t coalesced_batches; // coalesced transfers
+};
+
+struct dma_wait_stats {
+  uint64_t waits;
+  uint64_t spin_completions;  // completions seen while spinning
+  uint64_t block_completions; // completions seen after going to sleep
+  uint64_t wakeups;           // interrupts that woke the waiter
+  uint64_t spin_ns;
+  uint64_t block_ns;
+};
+
+// Measurements of one DMA direction and the settings derived from them,
+// see mmd_dma::calibrate()
+struct dma_calibration {
+  double copy_ns_per_kb;  // memcpy between host memory and a staging slot
+  double pin_ns;          // pinning cost: pin_ns + pin_ns_per_kb * KB
+  double pin_ns_per_kb;
+  double dma_setup_ns;    // one descriptor: dma_setup_ns + dma_ns_per_kb * KB
+  double dma_ns_per_kb;
+  uint64_t copy_threshold; // chosen bounce-vs-pin crossover
+  uint64_t chunk_len;      // chosen staging chunk size
+};
+
+class dma_completion_group;
+
+// One host piece of a vectored transfer
+struct dma_fragment {
+  void *host_addr;
+  size_t size;
+};
 
 struct dma_work_item {
   aocl_mmd_op_t op;
   void *host_addr;
   uint64_t dev_addr;
   size_t size;
+  uint64_t enqueue_ns; // steady clock time the item was queued
+  // Vectored transfers: host fragments in device order, owned by the item.
+  // host_addr is unused and size is the total.
+  dma_fragment *frags;
+  size_t num_frags;
+  // Piece of a transfer striped over several engines, reports here instead
+  // of calling the status handler
+  dma_completion_group *group;
+  dma_priority priority;
+  // Slice of a larger item: size of the whole item, 0 when not sliced. Only
+  // the last slice carries op and group, see mmd_dma::next_slice().
+  size_t slice_total;
+  bool last_slice;
+};
+
+// Bandwidth cap of one priority class. credit is what the class may still
+// send, it goes negative after a transfer and the class waits until it has
+// been paid back at bytes_per_sec.
+struct dma_rate_limit {
+  uint64_t bytes_per_sec; // 0 for no cap
+  int64_t credit;
+  uint64_t last_ns;
+};
+
+// How the host memory of a transfer, or of one fragment, was made visible to VTP
+struct dma_host_pin {
+  void *addr;
+  bool pinned;                   // pinned just for this transfer
+  pin_cache::region *cached_pin; // pinned through the pin cache
+};
+
+// A work item whose descriptors have been handed to the hardware. The host
+// buffer has to stay pinned until the completion count reaches last_seq.
+struct dma_inflight_item {
+  dma_work_item item;
+  uint64_t last_seq;
+  dma_host_pin pin;
+  std::vector<dma_host_pin> fragment_pins; // vectored transfers only
+  std::vector<aocl_mmd_op_t> merged_ops;   // coalesced items completed with this one
+  int status;
 };
 
 class mmd_dma final {
 public:
   mmd_dma(fpga_handle fpga_handle_arg, int mmd_handle, mpf_handle_t mpf_handle,
-          uint64_t dfh_offset_arg, int interrupt_num_arg, dma_mode mode);
+          uint64_t dfh_offset_arg, int interrupt_num_arg, dma_mode mode,
+          pin_cache *pin_cache_arg, pinned_range_table *prepinned_arg,
+          copy_engine *copy_engine_arg, staging_pool *staging_pool_arg,
+          const mmd_config &config);
   ~mmd_dma();
 
   bool initialized() { return m_initialized; }
 
+  // priority only matters for async transfers, blocking ones run on the
+  // caller's thread
   int fpga_to_host(aocl_mmd_op_t op, void *host_addr, size_t dev_addr,
-                           size_t size);
+                           size_t size, dma_priority priority);
   int host_to_fpga(aocl_mmd_op_t op, const void *host_addr,
-                           size_t dev_addr, size_t size);
+                           size_t dev_addr, size_t size, dma_priority priority);
+  int fpga_to_host_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                     size_t iovcnt, size_t dev_addr, dma_priority priority);
+  int host_to_fpga_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                     size_t iovcnt, size_t dev_addr, dma_priority priority);
+
+  int transfer_piece(dma_completion_group *group, void *host_addr,
+                     size_t dev_addr, size_t size, dma_priority priority);
+  // d2d engines only: blocking copy within device memory, addresses and size
+  // must be multiples of device_copy_align
+  int device_copy(size_t src_addr, size_t dst_addr, size_t size);
+  static const uint64_t device_copy_align = 64;
 
   void set_status_handler(aocl_mmd_status_handler_fn fn, void *user_data);
+  void event_update_fn(aocl_mmd_op_t op, int status);
+  // Measures this direction using device memory at dev_addr, must run before
+  // any transfer is queued. The caller applies the result with set_tuning().
+  int calibrate(uint64_t dev_addr, dma_calibration &result);
+  void set_tuning(uint64_t copy_threshold, uint64_t chunk_len);
+  uint64_t copy_threshold() const { return threshold; }
+  uint64_t chunk_len() const { return staging_slot_len; }
+  // Bytes queued or in flight, used to balance work between engines
+  uint64_t pending_bytes() const { return m_pending_bytes.load(std::memory_order_relaxed); }
+  dma_wait_policy wait_policy() const { return m_wait_policy; }
+  dma_wait_stats get_wait_stats();
 
   mmd_dma(mmd_dma &other) = delete;
   mmd_dma &operator=(const mmd_dma &other) = delete;
@@ -51,12 +208,45 @@ private:
   // Helper functions
   int enqueue_dma(dma_work_item &item);
   int do_dma(dma_work_item &item);
+  int start_dma(dma_work_item &item, dma_inflight_item &inflight);
+  int start_vectored_dma(dma_work_item &item, dma_inflight_item &inflight);
+  dma_work_item make_vectored_item(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                                   size_t iovcnt, size_t dev_addr);
+  bool direct_dma(void *host_addr, size_t size, bool &prepinned);
+  int pin_host(void *host_addr, size_t size, bool prepinned, dma_host_pin &pin);
+  void unpin_host(dma_host_pin &pin);
+  int submit_range(uint64_t host_addr, uint64_t dev_addr, uint64_t dma_len);
+  void finish_dma(dma_inflight_item &inflight);
+  void retire_inflight(bool wait_for_oldest);
   void work_thread();
-  void event_update_fn(aocl_mmd_op_t op, int status);
-  int send_descriptors(uint64_t dma_src_addr, uint64_t dma_dst_addr, uint64_t dma_len);
+  bool wait_for_work();
+  mpsc_ring<dma_work_item> &work_ring(dma_priority priority) {
+    return priority == dma_priority::high ? m_high_ring : m_work_ring;
+  }
+  bool next_work_item(dma_work_item &item, uint64_t &throttle_ns);
+  bool normal_work_item(dma_work_item &item);
+  void next_slice(dma_work_item &item);
+  bool under_rate_limit(dma_priority priority, uint64_t now_ns, uint64_t &wait_ns);
+  void charge_rate_limit(dma_priority priority, uint64_t bytes);
+  void update_slice_len();
+  void record_start(const dma_work_item &item);
+  bool coalescable(const dma_work_item &item);
+  int start_coalesced_dma(dma_work_item &item, dma_inflight_item &inflight);
+  int submit_descriptor(uint64_t dma_src_addr, uint64_t dma_dst_addr, uint64_t dma_len);
+  int wait_for_completions(uint64_t seq);
+  void resync_completions();
+  int wait_for_notification();
+  bool check_completion();
+  int clear_interrupt();
+  void cpu_relax();
+  void read_completion_count();
+  int do_staged_dma(dma_work_item &item);
+  int do_windowed_dma(dma_work_item &item);
+  int stage_fragments(const dma_fragment *frags, size_t num_frags, uint64_t dev_addr);
   void read_status_registers();
   void read_register(uint64_t offset, const char* name);
   int pin_memory(void *addr, size_t len); 
+  uint64_t time_descriptor(uint64_t host_addr, uint64_t dev_addr, uint64_t len);
   
   // Member variables
   bool m_initialized;
@@ -67,15 +257,72 @@ private:
   fpga_handle m_fpga_handle;
   int m_mmd_handle;
   mpf_handle_t mpf_handle;
+  pin_cache *m_pin_cache;
+  pinned_range_table *m_prepinned;
+  copy_engine *m_copy_engine; // staging slot copies, shared with other engines
+  staging_pool *m_staging_pool; // owns the memory of staging_slots
   uint64_t dfh_offset;
   int interrupt_num;
   uint64_t max_dma_len;
   std::condition_variable m_dma_notify;
   std::thread *m_thread;
-  std::mutex m_work_queue_mutex;
-  std::queue<dma_work_item> m_work_queue;
+  // Reports async completions to the runtime off the work thread
+  completion_dispatcher *m_completions;
+  // Async submissions per priority class, normal and high
+  mpsc_ring<dma_work_item> m_work_ring;
+  mpsc_ring<dma_work_item> m_high_ring;
+  std::mutex m_park_mutex;
+  std::atomic<bool> m_worker_parked;
+  uint64_t m_worker_spin_ns;
+  dma_queue_stats m_queue_stats;
+  std::atomic<uint64_t> m_queue_full_waits;
+  // Largest async item merged with its neighbours, 0 disables coalescing
+  uint64_t m_coalesce_max_bytes;
+  std::vector<dma_fragment> m_coalesce_frags; // work thread only
+
+  // Scheduling between the priority classes, only touched by the work thread.
+  // Normal items longer than m_slice_len are started a slice at a time so
+  // high priority items can go in between, m_slicing is what is left of the
+  // item being sliced.
+  uint64_t m_slice_bytes; // configured slice length, 0 disables slicing
+  uint64_t m_slice_len;   // m_slice_bytes in whole staging chunks
+  bool m_slicing_active;
+  dma_work_item m_slicing;
+  uint64_t m_last_slice_ns;
+  uint32_t m_slices_inflight;
+  int m_slice_status; // first error of the slices retired so far
+  // Longest the normal class is held back by the high one
+  uint64_t m_normal_deadline_ns;
+  dma_rate_limit m_rate_limits[dma_num_priorities];
+  std::atomic<uint64_t> m_pending_bytes;
+  // Async items queued or in flight, until their op has been reported
+  std::atomic<uint64_t> m_async_outstanding;
+  // Largest async transfer the caller runs itself on an idle direction, see
+  // enqueue_dma()
+  uint64_t m_inline_max_bytes;
+  std::atomic<uint64_t> m_inline_transfers;
   std::atomic<bool> m_work_thread_active;
   uint64_t threshold;
+  // Largest piece of an unpinned host buffer pinned at once, 0 for no limit
+  uint64_t m_pin_window;
+
+  // Descriptor window, protected by m_dma_op_mutex. Every descriptor written
+  // to the CSRs gets the next sequence number, completions retire in order.
+  uint32_t m_max_inflight;
+  bool m_count_completions; // hardware reports a running completion count
+  uint64_t m_done_cnt_csr;
+  uint64_t m_done_cnt_base;  // counter value matching m_submitted == 0
+  uint64_t m_submitted;
+  uint64_t m_completed;
+  // Transfers submitted by the work thread that still await completion,
+  // oldest first. Only touched by the work thread.
+  std::deque<dma_inflight_item> m_inflight;
+
+  // Completion wait policy and time spent in each phase, m_wait_stats is
+  // protected by m_dma_op_mutex
+  dma_wait_policy m_wait_policy;
+  uint64_t m_spin_budget_ns;
+  dma_wait_stats m_wait_stats;
 
   std::unordered_map<void *, uint64_t> pinned_mem;
   // CSR variables
@@ -93,8 +340,11 @@ private:
   pollfd int_event_fd{0};
   fpga_event_handle event_handle;
 
-  // Buffer
-  void *dma_buffer;
+  // Ring of pinned staging slots used when the host buffer is not pinned,
+  // taken from m_staging_pool
+  std::vector<void *> staging_slots;
+  uint64_t staging_slot_len;
+  uint64_t staging_slot_bytes; // allocated size, staging_slot_len may be less
   uint64_t transaction_id;
 };
 
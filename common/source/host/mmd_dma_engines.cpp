@@ -0,0 +1,171 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+#include "mmd_device.h"
+#include "mmd_dma_engines.h"
+
+namespace intel_opae_mmd {
+
+bool dma_completion_group::piece_done(int piece_status, int &status) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (piece_status != 0 && m_status == 0) {
+    m_status = piece_status;
+  }
+  if (--m_remaining > 0) {
+    return false;
+  }
+  if (m_op == nullptr) {
+    // Blocking transfer, the caller owns the group and is waiting in wait()
+    m_done.notify_all();
+    return false;
+  }
+  status = m_status;
+  return true;
+}
+
+int dma_completion_group::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this] { return m_remaining == 0; });
+  return m_status;
+}
+
+dma_engine_set::dma_engine_set(dma_mode mode, const mmd_config &config)
+    : m_mode(mode), m_stripe_min(config.dma_stripe_mb * 1024 * 1024) {}
+
+/** Engines are destroyed in order, each one drains its own queue first */
+dma_engine_set::~dma_engine_set() {
+  for (mmd_dma *engine : m_engines) {
+    delete engine;
+  }
+  m_engines.clear();
+}
+
+void dma_engine_set::add(mmd_dma *engine) {
+  assert(engine);
+  m_engines.push_back(engine);
+}
+
+void dma_engine_set::set_status_handler(aocl_mmd_status_handler_fn fn,
+                                        void *user_data) {
+  for (mmd_dma *engine : m_engines) {
+    engine->set_status_handler(fn, user_data);
+  }
+}
+
+int dma_engine_set::calibrate(uint64_t dev_addr, dma_calibration &result) {
+  if (m_engines.empty() || m_engines[0]->calibrate(dev_addr, result) != 0) {
+    return -1;
+  }
+  apply_calibration(result);
+  return 0;
+}
+
+void dma_engine_set::apply_calibration(const dma_calibration &result) {
+  for (mmd_dma *engine : m_engines) {
+    engine->set_tuning(result.copy_threshold, result.chunk_len);
+  }
+}
+
+/** least_loaded() picks the engine with the fewest bytes queued or in flight.
+ *  The load is sampled without locking, so two callers may pick the same
+ *  engine; that only costs balance, never correctness.
+ */
+mmd_dma *dma_engine_set::least_loaded() {
+  assert(!m_engines.empty());
+  mmd_dma *best = m_engines[0];
+  uint64_t best_load = best->pending_bytes();
+  for (size_t i = 1; i < m_engines.size() && best_load > 0; i++) {
+    uint64_t load = m_engines[i]->pending_bytes();
+    if (load < best_load) {
+      best = m_engines[i];
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+/** striped_transfer() splits one transfer in pieces, one per engine, that
+ *  all report to a shared completion group. For async transfers op completes
+ *  after the last piece; blocking transfers wait here.
+ *  Each engine pins its piece on its own, so pieces end on host page
+ *  boundaries and two engines never pin and release the same page.
+ */
+int dma_engine_set::striped_transfer(aocl_mmd_op_t op, void *host_addr,
+                                     size_t dev_addr, size_t size,
+                                     dma_priority priority) {
+  uint64_t num_engines = m_engines.size();
+  char *host = static_cast<char *>(host_addr);
+  uint64_t piece_len = (size + num_engines - 1) / num_engines;
+  piece_len = (piece_len + host_page_len - 1) & ~(host_page_len - 1);
+  uint64_t first_len = host_page_split(host, piece_len, size);
+  int pieces = static_cast<int>(1 + (size - first_len + piece_len - 1) / piece_len);
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : DMA ---- striping 0x%zx bytes over %d engines, piece size 0x%lx\n", size, pieces, piece_len);
+  }
+
+  dma_completion_group blocking_group(nullptr, pieces);
+  dma_completion_group *group =
+      op != nullptr ? new dma_completion_group(op, pieces) : &blocking_group;
+
+  uint64_t offset = 0;
+  for (int i = 0; i < pieces; i++) {
+    uint64_t len = host_page_split(host + offset, piece_len, size - offset);
+    // Queued pieces always succeed, failures are reported through the group
+    m_engines[i]->transfer_piece(group, host + offset, dev_addr + offset, len, priority);
+    offset += len;
+  }
+
+  if (op != nullptr) {
+    return 0;
+  }
+  return blocking_group.wait();
+}
+
+int dma_engine_set::fpga_to_host(aocl_mmd_op_t op, void *host_addr,
+                                 size_t dev_addr, size_t size,
+                                 dma_priority priority) {
+  assert(m_mode == dma_mode::f2h);
+  if (m_engines.size() > 1 && m_stripe_min > 0 && size >= m_stripe_min) {
+    return striped_transfer(op, host_addr, dev_addr, size, priority);
+  }
+  return least_loaded()->fpga_to_host(op, host_addr, dev_addr, size, priority);
+}
+
+int dma_engine_set::host_to_fpga(aocl_mmd_op_t op, const void *host_addr,
+                                 size_t dev_addr, size_t size,
+                                 dma_priority priority) {
+  assert(m_mode == dma_mode::h2f);
+  if (m_engines.size() > 1 && m_stripe_min > 0 && size >= m_stripe_min) {
+    return striped_transfer(op, const_cast<void *>(host_addr), dev_addr, size, priority);
+  }
+  return least_loaded()->host_to_fpga(op, host_addr, dev_addr, size, priority);
+}
+
+int dma_engine_set::transfer_piece(dma_completion_group *group, void *host_addr,
+                                   size_t dev_addr, size_t size,
+                                   dma_priority priority) {
+  return least_loaded()->transfer_piece(group, host_addr, dev_addr, size, priority);
+}
+
+/** Vectored transfers keep their single completion on one engine */
+int dma_engine_set::fpga_to_host_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                                   size_t iovcnt, size_t dev_addr,
+                                   dma_priority priority) {
+  assert(m_mode == dma_mode::f2h);
+  return least_loaded()->fpga_to_host_v(op, iov, iovcnt, dev_addr, priority);
+}
+
+int dma_engine_set::host_to_fpga_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                                   size_t iovcnt, size_t dev_addr,
+                                   dma_priority priority) {
+  assert(m_mode == dma_mode::h2f);
+  return least_loaded()->host_to_fpga_v(op, iov, iovcnt, dev_addr, priority);
+}
+
+}; // namespace intel_opae_mmd
@@ -0,0 +1,103 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_DMA_ENGINES_H_
+#define MMD_DMA_ENGINES_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "aocl_mmd.h"
+#include "mmd_config.h"
+#include "mmd_dma.h"
+
+namespace intel_opae_mmd {
+
+/** Completion shared by the pieces of a transfer striped over several DMA
+ *  engines. Every piece reports to piece_done() when it retires; the op of
+ *  the transfer completes once, with the first error seen, after the last one.
+ *  Async groups are deleted by the engine that retires the last piece,
+ *  blocking groups live on the caller's stack and are waited on with wait().
+ */
+class dma_completion_group final {
+public:
+  dma_completion_group(aocl_mmd_op_t op, int pieces)
+      : m_op(op), m_remaining(pieces), m_status(0) {}
+
+  aocl_mmd_op_t op() const { return m_op; }
+
+  // Returns true when the last piece of an async transfer is done, the caller
+  // then reports status for op() and deletes the group
+  bool piece_done(int piece_status, int &status);
+  // Blocking transfers: waits for all pieces and returns the combined status
+  int wait();
+
+  dma_completion_group(const dma_completion_group &) = delete;
+  dma_completion_group &operator=(const dma_completion_group &) = delete;
+
+private:
+  aocl_mmd_op_t m_op;
+  std::mutex m_mutex;
+  std::condition_variable m_done;
+  int m_remaining;
+  int m_status;
+};
+
+/** All DMA engines of one direction.
+ *
+ *  The ASP may instantiate more than one DMA BBB, each with its own H2F and
+ *  F2H mmd_dma. Transfers of at least dma_stripe_mb are split in equal,
+ *  page aligned pieces over all engines. Smaller transfers go to the engine
+ *  with the fewest bytes queued or in flight, so a busy engine sheds new
+ *  work to idle ones. With a single engine everything goes straight to it.
+ */
+class dma_engine_set final {
+public:
+  dma_engine_set(dma_mode mode, const mmd_config &config);
+  ~dma_engine_set();
+
+  // Takes ownership of engine
+  void add(mmd_dma *engine);
+  size_t size() const { return m_engines.size(); }
+
+  int fpga_to_host(aocl_mmd_op_t op, void *host_addr, size_t dev_addr,
+                   size_t size, dma_priority priority);
+  int host_to_fpga(aocl_mmd_op_t op, const void *host_addr, size_t dev_addr,
+                   size_t size, dma_priority priority);
+  int fpga_to_host_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                     size_t iovcnt, size_t dev_addr, dma_priority priority);
+  int host_to_fpga_v(aocl_mmd_op_t op, const aocl_mmd_iovec_t *iov,
+                     size_t iovcnt, size_t dev_addr, dma_priority priority);
+
+  // Queues one transfer on the least loaded engine, it reports to group
+  // instead of the status handler
+  int transfer_piece(dma_completion_group *group, void *host_addr,
+                     size_t dev_addr, size_t size, dma_priority priority);
+
+  void set_status_handler(aocl_mmd_status_handler_fn fn, void *user_data);
+
+  // Calibrates the first engine and applies the result to all of them, see
+  // mmd_dma::calibrate()
+  int calibrate(uint64_t dev_addr, dma_calibration &result);
+  void apply_calibration(const dma_calibration &result);
+  // Effective settings of the engines
+  uint64_t copy_threshold() const { return m_engines.empty() ? 0 : m_engines[0]->copy_threshold(); }
+  uint64_t chunk_len() const { return m_engines.empty() ? 0 : m_engines[0]->chunk_len(); }
+
+  dma_engine_set(const dma_engine_set &) = delete;
+  dma_engine_set &operator=(const dma_engine_set &) = delete;
+
+private:
+  mmd_dma *least_loaded();
+  int striped_transfer(aocl_mmd_op_t op, void *host_addr, size_t dev_addr,
+                       size_t size, dma_priority priority);
+
+  dma_mode m_mode;
+  std::vector<mmd_dma *> m_engines;
+  uint64_t m_stripe_min;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_DMA_ENGINES_H_
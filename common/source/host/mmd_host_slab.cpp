@@ -0,0 +1,287 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <numaif.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "mmd_device.h"
+#include "mmd_host_slab.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace intel_opae_mmd {
+
+static const size_t small_page_len = 4096;
+static const size_t huge_2m_len = 2 * 1024 * 1024;
+static const size_t min_block_len = 64;
+
+const size_t host_slab::arena_len;
+
+static size_t round_up_pow2(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+host_slab::host_slab(const std::vector<int> &handles, size_t max_block,
+                     int numa_node, pin_fn pin, unpin_fn unpin,
+                     alloc_registry &registry)
+    : m_handles(handles), m_max_block(0), m_numa_node(numa_node), m_pin(pin),
+      m_unpin(unpin), m_registry(registry), m_stats(), m_retired(false) {
+  // Clamped before rounding, round_up_pow2() never ends above the top bit
+  max_block = round_up_pow2(std::min(std::max(max_block, min_block_len), arena_len));
+  // Powers of two up to a page, then four classes per power of two so a
+  // request wastes at most a fifth of its block
+  size_t len = min_block_len;
+  while (len <= max_block) {
+    size_class c;
+    c.block_len = len;
+    c.carving = -1;
+    m_classes.push_back(c);
+    len += len < small_page_len ? len : round_up_pow2(len + 1) / 8;
+  }
+  m_max_block = max_block;
+}
+
+host_slab::~host_slab() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : host slab : allocs %ld , reused %ld , frees %ld , arenas %ld , arena bytes 0x%lx , live blocks %zu\n",
+              m_stats.allocs, m_stats.reused, m_stats.frees, m_stats.arenas,
+              m_stats.arena_bytes, m_live.size());
+  }
+  for (arena &a : m_arenas) {
+    unmap_arena(a);
+  }
+}
+
+bool host_slab::uses(int handle) const {
+  return std::find(m_handles.begin(), m_handles.end(), handle) != m_handles.end();
+}
+
+/** class_of() picks the smallest class whose blocks hold size bytes at the
+ *  requested alignment. Blocks sit at multiples of their length from an
+ *  arena_len aligned base, so a block is aligned to the lowest set bit of
+ *  its length; the power of two classes serve any alignment up to their size.
+ */
+int host_slab::class_of(size_t size, size_t alignment) const {
+  if (size > m_max_block || alignment > m_max_block) {
+    return -1;
+  }
+  for (size_t c = 0; c < m_classes.size(); c++) {
+    size_t block_len = m_classes[c].block_len;
+    if (block_len >= size && (block_len & (~block_len + 1)) >= alignment) {
+      return static_cast<int>(c);
+    }
+  }
+  return -1;
+}
+
+bool host_slab::serves(size_t size, size_t alignment) const {
+  return size > 0 && class_of(size, alignment) >= 0;
+}
+
+/** map_arena() maps one arena, a 2MB hugepage if the system has one left and
+ *  normal pages otherwise, places it on m_numa_node before faulting it in,
+ *  and pins it with every device of the set. Normal page arenas are aligned
+ *  to arena_len like a hugepage, blocks carved from an arena are then
+ *  aligned to their size either way.
+ *  Returns the index of the arena or -1. Called with m_mutex held.
+ */
+int host_slab::map_arena() {
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+  size_t page_len = huge_2m_len;
+  void *addr = mmap(nullptr, arena_len, prot, flags | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+  if (addr == MAP_FAILED) {
+    page_len = small_page_len;
+    addr = map_aligned_arena(prot, flags);
+  }
+  if (addr == MAP_FAILED) {
+    LOG_ERR("host slab: mapping arena failed: %s\n", strerror(errno));
+    return -1;
+  }
+  if (m_numa_node >= 0) {
+    unsigned long nodemask = 1UL << m_numa_node;
+    if (m_numa_node >= static_cast<int>(sizeof(nodemask) * 8) ||
+        mbind(addr, arena_len, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+      fprintf(stderr, "Could not place host slab arena on NUMA node %d\n", m_numa_node);
+    }
+  }
+  memset(addr, 0, arena_len);
+#ifndef SIM
+  mlock(addr, arena_len);
+#endif
+  if (!m_pin(addr, arena_len)) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : host slab : pinning arena %p failed\n", addr);
+    }
+    munmap(addr, arena_len);
+    return -1;
+  }
+
+  arena a = {static_cast<char *>(addr), arena_len, page_len, -1, 0};
+  m_arenas.push_back(a);
+  host_allocation registered;
+  registered.addr = addr;
+  registered.size = arena_len;
+  registered.page_len = page_len;
+  registered.slab = this;
+  m_registry.insert(registered);
+  m_stats.arenas++;
+  m_stats.arena_bytes += arena_len;
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
+    DEBUG_LOG("DEBUG LOG : host slab : mapped arena %p of %zu KB pages\n",
+              addr, page_len / 1024);
+  }
+  return static_cast<int>(m_arenas.size() - 1);
+}
+
+/** map_aligned_arena() maps arena_len bytes of normal pages at an arena_len
+ *  aligned address: it maps twice that and trims the head and the tail,
+ *  which are its own mapping so nothing else can take them in between.
+ */
+void *host_slab::map_aligned_arena(int prot, int flags) {
+  char *raw = static_cast<char *>(mmap(nullptr, 2 * arena_len, prot, flags, -1, 0));
+  if (raw == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  char *aligned = reinterpret_cast<char *>(
+      (reinterpret_cast<uintptr_t>(raw) + arena_len - 1) & ~(arena_len - 1));
+  if (aligned > raw) {
+    munmap(raw, aligned - raw);
+  }
+  munmap(aligned + arena_len, raw + 2 * arena_len - (aligned + arena_len));
+  return aligned;
+}
+
+void host_slab::unmap_arena(arena &a) {
+  host_allocation registered;
+  m_registry.erase(a.addr, &registered);
+  m_unpin(a.addr);
+  munmap(a.addr, a.len);
+}
+
+void *host_slab::alloc(size_t size, size_t alignment) {
+  int c = class_of(size, alignment);
+  if (size == 0 || c < 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_retired) {
+    return nullptr;
+  }
+  size_class &sc = m_classes[c];
+  void *block = nullptr;
+  if (!sc.free_blocks.empty()) {
+    block = sc.free_blocks.back();
+    sc.free_blocks.pop_back();
+    m_stats.reused++;
+  } else {
+    if (sc.carving < 0 || m_arenas[sc.carving].len - m_arenas[sc.carving].used < sc.block_len) {
+      int next;
+      if (!m_spare_arenas.empty()) {
+        next = m_spare_arenas.back();
+        m_spare_arenas.pop_back();
+      } else {
+        next = map_arena();
+        if (next < 0) {
+          return nullptr;
+        }
+      }
+      m_arenas[next].size_class = c;
+      sc.carving = next;
+    }
+    arena &a = m_arenas[sc.carving];
+    block = a.addr + a.used;
+    a.used += sc.block_len;
+  }
+  m_live[block] = c;
+  m_stats.allocs++;
+  return block;
+}
+
+bool host_slab::free(void *block) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_live.find(block);
+  if (it == m_live.end()) {
+    return false;
+  }
+  // The mmap() path hands out zeroed pages, reused blocks have to match it
+  memset(block, 0, m_classes[it->second].block_len);
+  m_classes[it->second].free_blocks.push_back(block);
+  m_live.erase(it);
+  m_stats.frees++;
+  return true;
+}
+
+bool host_slab::owns(void *block) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_live.count(block) != 0;
+}
+
+size_t host_slab::page_len(void *block) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_live.count(block) == 0) {
+    return 0;
+  }
+  char *p = static_cast<char *>(block);
+  for (const arena &a : m_arenas) {
+    if (p >= a.addr && p < a.addr + a.len) {
+      return a.page_len;
+    }
+  }
+  return 0;
+}
+
+bool host_slab::prewarm(size_t bytes) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  while (!m_retired && m_stats.arena_bytes < bytes) {
+    int a = map_arena();
+    if (a < 0) {
+      return false;
+    }
+    m_spare_arenas.push_back(a);
+  }
+  return true;
+}
+
+uint64_t host_slab::live_blocks() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_live.size();
+}
+
+bool host_slab::retire() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_live.empty()) {
+    return false;
+  }
+  m_retired = true;
+  return true;
+}
+
+bool host_slab::for_each_arena(const arena_fn &fn) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (arena &a : m_arenas) {
+    if (!fn(a.addr, a.len)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+host_slab::stats host_slab::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+}; // namespace intel_opae_mmd
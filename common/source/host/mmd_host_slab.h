@@ -0,0 +1,137 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_HOST_SLAB_H_
+#define MMD_HOST_SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mmd_alloc_registry.h"
+
+namespace intel_opae_mmd {
+
+/** Sub-allocator for small host and shared allocations of one set of devices.
+ *
+ *  Mapping and pinning every small USM allocation on its own costs a whole
+ *  hugepage, a VTP entry per device and a couple of syscalls. The slab
+ *  instead maps arenas of one 2MB hugepage (normal pages when none are
+ *  reserved), pins each arena once with every device of the set, and carves
+ *  it into blocks of a single size class. Classes are the powers of two from
+ *  64 bytes to 4KB, then four per power of two up to max_block. Freed blocks
+ *  are zeroed, like the fresh pages the mmap() path returns, and go back on
+ *  the free list of their class, to be handed out again without touching
+ *  the mapping or the pins; arenas are only unmapped with the slab.
+ *
+ *  Every class carves from its own arena, so each class in use keeps at
+ *  least one 2MB arena pinned with every device, whatever its blocks add
+ *  up to. Mixed sizes up to a 256KB max_block can pin around 60MB per set
+ *  of devices; a smaller max_block keeps fewer classes.
+ *
+ *  Arenas of normal pages are mapped 2MB aligned like hugepages, so a block
+ *  is aligned to the lowest set bit of its length, and to its whole length
+ *  in the power of two classes. Every arena is registered in the alloc_registry
+ *  given to the slab while it is mapped, so the slab of any pointer into an
+ *  arena is found from the arena_len aligned address below it with one
+ *  lookup. All methods are thread safe.
+ */
+class host_slab final {
+public:
+  // Every arena is one 2MB hugepage, or the same length of normal pages
+  static const size_t arena_len = 2 * 1024 * 1024;
+
+  // Pins [addr, addr + len) with every device of the set, false on failure
+  typedef std::function<bool(void *addr, size_t len)> pin_fn;
+  // Releases the pins of the arena at addr
+  typedef std::function<void(void *addr)> unpin_fn;
+  // Called for each arena, returning false stops the walk
+  typedef std::function<bool(void *addr, size_t len)> arena_fn;
+
+  struct stats {
+    uint64_t allocs;
+    uint64_t reused;  // allocations served from a free list
+    uint64_t frees;
+    uint64_t arenas;
+    uint64_t arena_bytes;
+  };
+
+  // handles must be sorted, max_block is rounded up to a power of two.
+  // Arenas are placed on numa_node, a negative node leaves them unplaced,
+  // and registered in registry.
+  host_slab(const std::vector<int> &handles, size_t max_block, int numa_node,
+            pin_fn pin, unpin_fn unpin, alloc_registry &registry);
+  // Unpins and unmaps every arena, blocks still handed out become invalid
+  ~host_slab();
+
+  const std::vector<int> &handles() const { return m_handles; }
+  bool uses(int handle) const;
+  // True if a request of size and alignment fits one of the size classes
+  bool serves(size_t size, size_t alignment) const;
+
+  // Returns a block of at least size bytes, nullptr when no arena could be
+  // mapped or pinned or the slab is retired
+  void *alloc(size_t size, size_t alignment);
+  // Returns false if block was not handed out by this slab
+  bool free(void *block);
+  bool owns(void *block);
+  // Page size of the arena holding block, 0 if block is not handed out
+  size_t page_len(void *block);
+  // Maps and pins arenas until at least bytes are mapped
+  bool prewarm(size_t bytes);
+  uint64_t live_blocks();
+  // Stops handing out blocks if none are live, the slab can then be deleted
+  // once the last user lets go of it. Returns false if blocks are live.
+  bool retire();
+
+  // Used to unpin the arenas before reprogramming and pin them again after
+  bool for_each_arena(const arena_fn &fn);
+
+  stats get_stats();
+
+  host_slab(const host_slab &) = delete;
+  host_slab &operator=(const host_slab &) = delete;
+
+private:
+  struct arena {
+    char *addr;
+    size_t len;
+    size_t page_len;
+    int size_class; // -1 until the arena is given to a class
+    size_t used;
+  };
+
+  struct size_class {
+    size_t block_len;
+    int carving; // arena blocks are carved from, -1 for none
+    std::vector<void *> free_blocks;
+  };
+
+  int class_of(size_t size, size_t alignment) const;
+  int map_arena();
+  static void *map_aligned_arena(int prot, int flags);
+  void unmap_arena(arena &a);
+
+  std::vector<int> m_handles;
+  size_t m_max_block;
+  int m_numa_node;
+  pin_fn m_pin;
+  unpin_fn m_unpin;
+  alloc_registry &m_registry;
+
+  std::mutex m_mutex;
+  std::vector<arena> m_arenas;
+  std::vector<size_class> m_classes;
+  std::vector<int> m_spare_arenas; // prewarmed arenas not given to a class
+  std::unordered_map<void *, int> m_live; // handed out block -> size class
+  stats m_stats;
+  bool m_retired;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_HOST_SLAB_H_
@@ -71,7 +71,7 @@ iopipes::~iopipes(){}
 // function to setup io pipes CSR space
 bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
 {
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : Inside setup-iopipes_asp function");
   }
   printf("** Inside setup-iopipes_asp function **\n");
@@ -95,7 +95,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
 
   std::string local_ip_addr = local_ip_address_;
 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("local ip address= %s\n", local_ip_addr.c_str());
   }
  
@@ -104,23 +104,23 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("Invalid Local MAC address. Please provide MAC address in 'aa:bb:cc:dd:ee:ff' format\n");
     return false;
   } else{
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("local mac address= %ld\n", local_mac_addr);
     }
   }
 
   std::string local_netmask = local_netmask_;
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("local netmask = %s\n", local_netmask.c_str());
   }
 
   uint64_t local_udp_port = (unsigned long)local_udp_port_;
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("local udp port= %ld\n", local_udp_port);
   }
 
   std::string remote_ip_addr = remote_ip_address_;
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("remote ip address= %s\n", remote_ip_addr.c_str());
   }
  
@@ -129,17 +129,17 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("Invalid Remote MAC address. Please provide MAC address in 'aa:bb:cc:dd:ee:ff' format\n");
     return false;
   } else{
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("remote mac address= %ld\n", remote_mac_addr);
     }
   }
 
   uint64_t remote_udp_port = (unsigned long)remote_udp_port_;
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("remote udp port= %ld\n", remote_udp_port);
   }
 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : \n local ip address= %s\n local mac address= %ld\n" 
                "local netmask = %s\n local udp port= %ld\n remote ip address= %s\n" 
                "remote mac address= %ld\n remote udp port= %ld\n", local_ip_addr.c_str(), local_mac_addr,
@@ -149,7 +149,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
   fpga_result res = FPGA_OK;
   
   // MAC reset
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : MAC reset\n");
   }
   res = fpgaWriteMMIO64(afc_handle, mmio_num_, REG_UDPOE_BASE_ADDR, 0x7);
@@ -173,13 +173,13 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   } 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : Reading number of channels CSR : Number of Channels : %ld\n", number_of_channels);
   }
 
 // Setting CSRs needed for UDP offload Engine
 // Setting CSRs which will be common on all pipes, if we have instantiated multiple pipes
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : Setting common CSRs for all IO Pipes\n");
   }
 
@@ -245,7 +245,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
   }
 
 // Setting CSRs for each IO Pipe instantiated 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : Setting CSRs specific for each IO Pipe\n");
   }
   int i = 0x00;
@@ -278,7 +278,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: Scratchpad:%ld\n", debug_scratchpad_csr);
   }
 
@@ -287,7 +287,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: Number of IO Channels/Pipes:%ld\n", debug_num_iopipes_csr);
   }
 
@@ -296,7 +296,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: FPGA_MAC_ADDR:%ld\n", debug_fpga_mac_addr_csr);
   }
 
@@ -305,7 +305,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: FPGA_IP_ADDR:%ld\n", debug_fpga_ip_addr_csr);
   }
 
@@ -314,7 +314,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }   
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: FPGA_UDP_PORT:%ld\n", debug_fpga_udp_port_csr);
   }
 
@@ -323,7 +323,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: FPGA_NETMASK:%ld\n", debug_fpga_netmask_csr);
   }
 
@@ -332,7 +332,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: HOST_MAC_ADDR:%ld\n", debug_host_mac_addr_csr);
   }
 
@@ -341,7 +341,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: HOST_IP_ADDR:%ld\n", debug_host_ip_addr_csr);
   }
 
@@ -350,7 +350,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: HOST_UDP_PORT:%ld\n", debug_host_udp_port_csr);
   }
 
@@ -359,7 +359,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false;
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: PAYLOAD_PER_PACKET:%ld\n", debug_payload_per_packet_csr);
   }
 
@@ -368,11 +368,11 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
     printf("%s \n",fpgaErrStr(res));
     return false; 
   }
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("Read CSR: CHECKSUM_IP:%ld\n", debug_checksum_ip_csr);
   }
 
-  if(std::getenv("MMD_ENABLE_DEBUG")){
+  if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : \n CSR: Scratchpad:%ld\n CSR: Number of IO Channels/Pipes:%ld\n"
               "CSR: FPGA_MAC_ADDR:%ld\n CSR: FPGA_IP_ADDR:%ld\n CSR: FPGA_UDP_PORT:%ld\n"
               "CSR: FPGA_NETMASK:%ld\n CSR: HOST_MAC_ADDR:%ld\n CSR: HOST_IP_ADDR:%ld\n"
@@ -388,7 +388,7 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
            debug_tx_status_csr, debug_rx_status_csr;
   i = 0x00;
   for(uint64_t loop=0; loop<number_of_channels; loop++) { 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Looping on channel %ld, Reading CSRs for channel %ld\n", loop, loop);
       DEBUG_LOG("Reading CSR_IOPIPE_INFO_REG_ADDR for IO pipe %ld\n", loop);
     }
@@ -398,11 +398,11 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
       printf("%s \n",fpgaErrStr(res));
       return false;
     }
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Read CSR_IOPIPE_INFO_REG_ADDR:%ld\n", debug_iopipe_info_csr);
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Reading CSR_RESET_REG_ADDR for IO pipe %ld\n", loop);
     }
     if ((res = fpgaReadMMIO64(afc_handle, mmio_num_, (IOPIPES_CSR_START_ADDR + (i++*0x8)), &debug_reset_csr)) != FPGA_OK) {
@@ -411,11 +411,11 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
       return false;
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Read CSR_RESET_REG_ADDR:%ld\n", debug_reset_csr);
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Reading CSR_STATUS_REG_ADDR for IO Pipe %ld\n", loop);
     }
     if ((res = fpgaReadMMIO64(afc_handle, mmio_num_, (IOPIPES_CSR_START_ADDR + (i++*0x8)), &debug_status_csr)) != FPGA_OK) {
@@ -424,11 +424,11 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
       return false;
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Read CSR_STATUS_REG_ADDR:%ld\n", debug_status_csr);
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Reading CSR_MISC_CTRL_REG_ADDR for IO Pipe %ld\n", loop);
     }
     if ((res = fpgaReadMMIO64(afc_handle, mmio_num_, (IOPIPES_CSR_START_ADDR + (i++*0x8)), &debug_misc_ctrl_csr)) != FPGA_OK) {
@@ -437,11 +437,11 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
       return false;
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Read CSR_MISC_CTRL_REG_ADDR:%ld\n", debug_misc_ctrl_csr);
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Reading CSR_TX_STATUS_REG_ADDR for IO Pipe %ld\n", loop);
     }
 
@@ -450,11 +450,11 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
       printf("%s \n",fpgaErrStr(res));
       return false;
     }
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Read CSR_TX_STATUS_REG_ADDR:%ld\n", debug_tx_status_csr);
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Reading CSR_RX_STATUS_REG_ADDR for IO Pipe %ld\n", loop);
     }
     if ((res = fpgaReadMMIO64(afc_handle, mmio_num_, (IOPIPES_CSR_START_ADDR + (i++*0x8)), &debug_rx_status_csr)) != FPGA_OK) {
@@ -462,11 +462,11 @@ bool iopipes::setup_iopipes_asp(fpga_handle afc_handle)
       printf("%s \n",fpgaErrStr(res));
       return false;
     }
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
       DEBUG_LOG("Read CSR_RX_STATUS_REG_ADDR:%ld\n", debug_rx_status_csr);
     }
 
-    if(std::getenv("MMD_ENABLE_DEBUG")){
+    if(MMD_DEBUG_ENABLED(MMD_LOG_ENABLE)){
     DEBUG_LOG("DEBUG LOG : IO-PIPES : \n CSR_IOPIPE_INFO_REG_ADDR:%ld\n CSR_RESET_REG_ADDR:%ld\n"
               "CSR_STATUS_REG_ADDR:%ld\n CSR_MISC_CTRL_REG_ADDR:%ld\n CSR_TX_STATUS_REG_ADDR:%ld\n"
               "CSR_RX_STATUS_REG_ADDR:%ld\n", debug_iopipe_info_csr, debug_reset_csr, debug_status_csr,
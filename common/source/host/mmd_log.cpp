@@ -0,0 +1,199 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mmd_log.h"
+
+namespace intel_opae_mmd {
+
+static unsigned log_mask_from_env() {
+  unsigned mask = 0;
+  if (getenv("MMD_ENABLE_DEBUG"))
+    mask |= MMD_LOG_ENABLE;
+  if (getenv("MMD_DMA_DEBUG"))
+    mask |= MMD_LOG_DMA;
+  if (getenv("MMD_PROGRAM_DEBUG"))
+    mask |= MMD_LOG_PROGRAM;
+  return mask;
+}
+
+std::atomic<unsigned> g_mmd_log_mask(log_mask_from_env());
+
+// Longest record kept in a ring, longer ones are truncated
+static const size_t log_record_len = 1024;
+// Records per thread, the ring is only allocated once a thread logs
+static const size_t log_ring_slots = 128;
+// How often the flush thread writes out the rings
+static const std::chrono::milliseconds log_flush_period(2);
+
+/** Single-producer single-consumer ring of formatted records. The owning
+ *  thread writes records without locking, drain_mutex serializes the
+ *  consumers: the flush thread, or the owner itself when its ring is full.
+ */
+struct log_ring {
+  struct record {
+    size_t len;
+    char text[log_record_len];
+  };
+
+  log_ring() : head(0), tail(0), retired(false) {}
+
+  record records[log_ring_slots];
+  std::atomic<uint64_t> head; // next record to write, owner only
+  std::atomic<uint64_t> tail; // next record to flush
+  std::atomic<bool> retired;  // owning thread has exited
+  std::mutex drain_mutex;
+
+  // Writes out every complete record, caller holds drain_mutex
+  void drain() {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    for (; pos != end; pos++) {
+      const record &r = records[pos % log_ring_slots];
+      fwrite(r.text, 1, r.len, stderr);
+    }
+    tail.store(pos, std::memory_order_release);
+  }
+};
+
+/** Every ring ever handed out and the thread that flushes them. Never
+ *  destroyed, so threads may still log while the process exits; once
+ *  log_shutdown() has run, records are written synchronously.
+ */
+struct log_registry {
+  std::mutex mutex;
+  std::condition_variable stop_cv;
+  std::vector<log_ring *> rings;
+  std::thread *flusher = nullptr;
+  bool stopping = false;
+  std::atomic<bool> sync{getenv("MMD_LOG_SYNC") != nullptr};
+};
+
+static log_registry &registry() {
+  static log_registry *instance = new log_registry();
+  return *instance;
+}
+
+static void flush_rings(log_registry &reg) {
+  // Called with reg.mutex held, rings of exited threads are dropped once empty
+  for (auto it = reg.rings.begin(); it != reg.rings.end();) {
+    log_ring *ring = *it;
+    bool retired = ring->retired.load(std::memory_order_acquire);
+    {
+      std::lock_guard<std::mutex> lock(ring->drain_mutex);
+      ring->drain();
+    }
+    if (retired) {
+      delete ring;
+      it = reg.rings.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  fflush(stderr);
+}
+
+static void flush_thread() {
+  log_registry &reg = registry();
+  std::unique_lock<std::mutex> lock(reg.mutex);
+  while (!reg.stopping) {
+    reg.stop_cv.wait_for(lock, log_flush_period);
+    flush_rings(reg);
+  }
+}
+
+static void log_shutdown() {
+  log_registry &reg = registry();
+  std::thread *flusher = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.sync.store(true);
+    reg.stopping = true;
+    flusher = reg.flusher;
+    reg.flusher = nullptr;
+  }
+  reg.stop_cv.notify_all();
+  if (flusher) {
+    flusher->join();
+    delete flusher;
+  }
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  flush_rings(reg);
+}
+
+// Stops the flush thread when the library is unloaded or the process exits
+static struct log_shutdown_guard {
+  ~log_shutdown_guard() { log_shutdown(); }
+} shutdown_guard;
+
+/** Gives a thread's ring back to the flush thread when the thread exits */
+struct log_ring_owner {
+  log_ring *ring = nullptr;
+  ~log_ring_owner() {
+    if (ring) {
+      ring->retired.store(true, std::memory_order_release);
+    }
+  }
+};
+
+static thread_local log_ring_owner tls_ring;
+
+static log_ring *thread_ring() {
+  if (tls_ring.ring) {
+    return tls_ring.ring;
+  }
+  log_registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  if (reg.stopping) {
+    return nullptr;
+  }
+  if (!reg.flusher) {
+    reg.flusher = new std::thread(flush_thread);
+  }
+  tls_ring.ring = new log_ring();
+  reg.rings.push_back(tls_ring.ring);
+  return tls_ring.ring;
+}
+
+void mmd_log_write(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  log_ring *ring = registry().sync.load(std::memory_order_relaxed) ? nullptr : thread_ring();
+  if (ring == nullptr) {
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    return;
+  }
+
+  uint64_t pos = ring->head.load(std::memory_order_relaxed);
+  if (pos - ring->tail.load(std::memory_order_acquire) == log_ring_slots) {
+    // Full: write out our own backlog rather than drop or reorder records
+    std::lock_guard<std::mutex> lock(ring->drain_mutex);
+    ring->drain();
+  }
+  log_ring::record &r = ring->records[pos % log_ring_slots];
+  int len = vsnprintf(r.text, sizeof(r.text), fmt, args);
+  va_end(args);
+  r.len = len < 0 ? 0 : std::min(static_cast<size_t>(len), sizeof(r.text) - 1);
+  ring->head.store(pos + 1, std::memory_order_release);
+}
+
+void mmd_log_flush() {
+  log_registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  flush_rings(reg);
+}
+
+}; // namespace intel_opae_mmd
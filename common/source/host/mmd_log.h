@@ -0,0 +1,47 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_LOG_H_
+#define MMD_LOG_H_
+
+#include <atomic>
+
+namespace intel_opae_mmd {
+
+// Debug categories, each enabled by one environment variable that is read
+// once when the library is loaded
+enum mmd_log_category : unsigned {
+  MMD_LOG_ENABLE = 1u << 0,  // MMD_ENABLE_DEBUG
+  MMD_LOG_DMA = 1u << 1,     // MMD_DMA_DEBUG
+  MMD_LOG_PROGRAM = 1u << 2, // MMD_PROGRAM_DEBUG
+};
+
+// Enabled mmd_log_category bits
+extern std::atomic<unsigned> g_mmd_log_mask;
+
+/** mmd_log_write() formats a debug record into the calling thread's log
+ *  ring, a background thread writes the rings to stderr. Records of one
+ *  thread keep their order, records of different threads may interleave
+ *  differently than they were written. Set MMD_LOG_SYNC to write straight
+ *  to stderr instead, e.g. when chasing a crash.
+ */
+void mmd_log_write(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Writes out everything logged so far
+void mmd_log_flush();
+
+}; // namespace intel_opae_mmd
+
+// Debug checks cost one relaxed load, building with MMD_DISABLE_DEBUG_LOG
+// removes them and the logging they guard altogether
+#ifdef MMD_DISABLE_DEBUG_LOG
+#define MMD_DEBUG_ENABLED(categories) false
+#else
+#define MMD_DEBUG_ENABLED(categories)                                          \
+  __builtin_expect((intel_opae_mmd::g_mmd_log_mask.load(                       \
+                        std::memory_order_relaxed) &                           \
+                    (categories)) != 0,                                        \
+                   0)
+#endif
+
+#endif // MMD_LOG_H_
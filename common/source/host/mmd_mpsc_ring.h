@@ -0,0 +1,108 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_MPSC_RING_H_
+#define MMD_MPSC_RING_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace intel_opae_mmd {
+
+/** Bounded multi-producer single-consumer ring with preallocated slots.
+ *
+ *  Every slot carries a sequence number that tells producers and the consumer
+ *  whose turn it is, so a push is one compare-and-swap on the tail plus a
+ *  store, and nothing is allocated after construction. try_push() fails
+ *  instead of blocking when the ring is full. Only one thread may call
+ *  try_pop().
+ */
+template <typename T> class mpsc_ring final {
+public:
+  // capacity must be a power of two
+  explicit mpsc_ring(size_t capacity)
+      : m_mask(capacity - 1), m_cells(new cell[capacity]), m_pad0(), m_tail(0),
+        m_pad1(), m_head(0) {
+    assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    for (size_t i = 0; i < capacity; i++) {
+      m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool try_push(const T &value) {
+    uint64_t pos = m_tail.load(std::memory_order_relaxed);
+    while (true) {
+      cell &c = m_cells[pos & m_mask];
+      uint64_t seq = c.seq.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+        if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+          c.value = value;
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; // full
+      } else {
+        pos = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T &value) {
+    uint64_t pos = m_head.load(std::memory_order_relaxed);
+    cell &c = m_cells[pos & m_mask];
+    uint64_t seq = c.seq.load(std::memory_order_acquire);
+    if (static_cast<int64_t>(seq - (pos + 1)) < 0) {
+      return false; // empty, or the producer has not finished writing
+    }
+    value = c.value;
+    c.seq.store(pos + m_mask + 1, std::memory_order_release);
+    m_head.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Copies the oldest element without removing it, consumer only
+  bool peek(T &value) const {
+    uint64_t pos = m_head.load(std::memory_order_relaxed);
+    const cell &c = m_cells[pos & m_mask];
+    if (static_cast<int64_t>(c.seq.load(std::memory_order_acquire) - (pos + 1)) < 0) {
+      return false;
+    }
+    value = c.value;
+    return true;
+  }
+
+  // Only meaningful from the consumer thread
+  bool empty() const {
+    uint64_t pos = m_head.load(std::memory_order_relaxed);
+    uint64_t seq = m_cells[pos & m_mask].seq.load(std::memory_order_acquire);
+    return static_cast<int64_t>(seq - (pos + 1)) < 0;
+  }
+
+  mpsc_ring(const mpsc_ring &) = delete;
+  mpsc_ring &operator=(const mpsc_ring &) = delete;
+
+private:
+  struct cell {
+    std::atomic<uint64_t> seq;
+    T value;
+  };
+
+  const uint64_t m_mask;
+  std::unique_ptr<cell[]> m_cells;
+  // Producers and the consumer update different ends, keep them on separate
+  // cache lines
+  char m_pad0[64];
+  std::atomic<uint64_t> m_tail;
+  char m_pad1[64];
+  std::atomic<uint64_t> m_head;
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_MPSC_RING_H_
@@ -0,0 +1,427 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "mmd_pin_cache.h"
+
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "mmd_device.h"
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+namespace intel_opae_mmd {
+
+static const uint64_t pin_cache_page_size = 4096;
+
+struct pin_cache::region {
+  uint64_t start;
+  uint64_t end;
+  int users;
+  bool stale;
+  std::list<region *>::iterator lru_pos;
+};
+
+static void unregister_range(int uffd, uint64_t start, uint64_t end) {
+  uffdio_range range;
+  range.start = start;
+  range.len = end - start;
+  // Fails harmlessly when the range has already been unmapped
+  ioctl(uffd, UFFDIO_UNREGISTER, &range);
+}
+
+/** pin_cache constructor
+ *  the budget comes from the pin_cache_mb setting of the device configuration
+ *  the cache is only enabled when we can get unmap notifications from userfaultfd,
+ *  otherwise a cached pin could outlive the memory it was created for
+ */
+pin_cache::pin_cache(mpf_handle_t mpf_handle_arg, uint64_t budget_bytes)
+    : mpf_handle(mpf_handle_arg), m_enabled(false),
+      m_budget(budget_bytes), m_pinned_bytes(0),
+      m_uffd(-1), m_wake_fd(-1), m_thread(nullptr), m_hits(0), m_misses(0),
+      m_bypasses(0), m_evictions(0), m_invalidations(0) {
+
+  if (m_budget == 0) {
+    return;
+  }
+
+  if (!open_userfaultfd()) {
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+      DEBUG_LOG("DEBUG LOG : userfaultfd not available (%s), pin cache disabled\n", strerror(errno));
+    }
+    return;
+  }
+
+  m_wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (m_wake_fd < 0) {
+    close(m_uffd);
+    m_uffd = -1;
+    return;
+  }
+
+  m_thread = new std::thread([this] { this->monitor_thread(); });
+  m_enabled = true;
+
+  if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    DEBUG_LOG("DEBUG LOG : Pin cache enabled, budget 0x%lx bytes\n", m_budget);
+  }
+}
+
+pin_cache::~pin_cache() {
+  if (m_thread) {
+    uint64_t wake = 1;
+    ssize_t ret = write(m_wake_fd, &wake, sizeof(wake));
+    (void)ret;
+    m_thread->join();
+    delete m_thread;
+  }
+
+  if(m_enabled && MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+    stats s = get_stats();
+    DEBUG_LOG("DEBUG LOG : Pin cache stats : hits %lu , misses %lu , bypasses %lu , evictions %lu , invalidations %lu , regions %lu , pinned bytes 0x%lx\n",
+              s.hits, s.misses, s.bypasses, s.evictions, s.invalidations, s.num_regions, s.pinned_bytes);
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  while (!m_regions.empty()) {
+    region *r = m_regions.begin()->second;
+    drop(r);
+    unpin(r);
+  }
+  for (region *r : m_stale) {
+    unpin(r);
+  }
+  m_stale.clear();
+
+  if (m_uffd >= 0) {
+    close(m_uffd);
+  }
+  if (m_wake_fd >= 0) {
+    close(m_wake_fd);
+  }
+}
+
+/** Try a userfaultfd that also traps kernel accesses first so a racing
+ *  syscall waits for us instead of failing, then fall back to user mode
+ *  only which is all unprivileged processes get on most distributions.
+ */
+bool pin_cache::open_userfaultfd() {
+  m_uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+  if (m_uffd < 0) {
+    m_uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+  }
+  if (m_uffd < 0) {
+    return false;
+  }
+
+  uffdio_api api;
+  memset(&api, 0, sizeof(api));
+  api.api = UFFD_API;
+  api.features = UFFD_FEATURE_EVENT_UNMAP | UFFD_FEATURE_EVENT_REMOVE |
+                 UFFD_FEATURE_EVENT_REMAP;
+  if (ioctl(m_uffd, UFFDIO_API, &api) < 0) {
+    close(m_uffd);
+    m_uffd = -1;
+    return false;
+  }
+  return true;
+}
+
+/** monitor_thread() drains userfaultfd events and drops every cached region
+ *  the event touches. This is best effort: the kernel queues an UNMAP event
+ *  only after munmap() has removed the mapping and dropped mmap_lock, and
+ *  madvise() zaps the pages of a REMOVE as soon as the event has been read,
+ *  before invalidate() has run. In either window another thread can map new
+ *  pages at the same address or touch the zapped range, and a cache hit then
+ *  DMAs to the old pinned pages. See the limitation in mmd_pin_cache.h.
+ *  A page fault inside a cached region should never happen since the pages
+ *  are pinned; if one does, dropping the region unregisters it and wakes up
+ *  the faulting thread.
+ */
+void pin_cache::monitor_thread() {
+  pollfd fds[2];
+  fds[0].fd = m_uffd;
+  fds[0].events = POLLIN;
+  fds[1].fd = m_wake_fd;
+  fds[1].events = POLLIN;
+
+  while (true) {
+    int ret = poll(fds, 2, -1);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Pin cache: poll error %s\n", strerror(errno));
+      return;
+    }
+    if (fds[1].revents) {
+      return;
+    }
+
+    uffd_msg msg;
+    while (read(m_uffd, &msg, sizeof(msg)) == sizeof(msg)) {
+      switch (msg.event) {
+      case UFFD_EVENT_UNMAP:
+      case UFFD_EVENT_REMOVE:
+        invalidate(msg.arg.remove.start, msg.arg.remove.end);
+        break;
+      case UFFD_EVENT_REMAP:
+        invalidate(msg.arg.remap.from, msg.arg.remap.from + msg.arg.remap.len);
+        // The moved mapping keeps its registration, we no longer track it
+        unregister_range(m_uffd, msg.arg.remap.to, msg.arg.remap.to + msg.arg.remap.len);
+        break;
+      case UFFD_EVENT_PAGEFAULT: {
+        uint64_t page = msg.arg.pagefault.address & ~(pin_cache_page_size - 1);
+        invalidate(page, page + pin_cache_page_size);
+        unregister_range(m_uffd, page, page + pin_cache_page_size);
+        break;
+      }
+      default:
+        break;
+      }
+    }
+  }
+}
+
+void pin_cache::invalidate(uint64_t start, uint64_t end) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for (auto &p : m_pending) {
+    if (p.first < end && p.second.end > start) {
+      p.second.invalidated = true;
+    }
+  }
+
+  auto it = m_regions.upper_bound(start);
+  if (it != m_regions.begin() && std::prev(it)->second->end > start) {
+    --it;
+  }
+  while (it != m_regions.end() && it->first < end) {
+    region *r = it->second;
+    ++it;
+    drop(r);
+    m_invalidations++;
+    if (r->users == 0) {
+      unpin(r);
+    } else {
+      // A DMA is still using the region, unpin it when that completes
+      r->stale = true;
+      m_stale.push_back(r);
+    }
+  }
+}
+
+/** Evict idle regions, least recently used first, until at most 'target'
+ *  bytes are pinned. Returns false if in-use regions keep us above it.
+ */
+bool pin_cache::evict_idle(uint64_t target) {
+  auto it = m_lru.end();
+  while (m_pinned_bytes > target && it != m_lru.begin()) {
+    --it;
+    region *r = *it;
+    if (r->users > 0) {
+      continue;
+    }
+    it = m_lru.erase(it);
+    m_regions.erase(r->start);
+    unregister_range(m_uffd, r->start, r->end);
+    unpin(r);
+    m_evictions++;
+  }
+  return m_pinned_bytes <= target;
+}
+
+// Remove a region from the index and stop watching it; m_mutex must be held
+void pin_cache::drop(region *r) {
+  m_regions.erase(r->start);
+  m_lru.erase(r->lru_pos);
+  unregister_range(m_uffd, r->start, r->end);
+}
+
+// Release the pin and free the region; m_mutex must be held
+void pin_cache::unpin(region *r) {
+  fpga_result res = mpfVtpReleaseBuffer(mpf_handle, reinterpret_cast<void *>(r->start));
+  if (res != FPGA_OK) {
+    fprintf(stderr, "Pin cache: Error mpfVtpReleaseBuffer %s\n", fpgaErrStr(res));
+  }
+  m_pinned_bytes -= r->end - r->start;
+  delete r;
+}
+
+/** acquire() pins a missing region without holding m_mutex, a pin can take
+ *  long and the monitor thread needs the lock to let faulting threads go on.
+ *  The range and its share of the budget are reserved in m_pending meanwhile,
+ *  so no other thread pins an overlapping range, and invalidate() flags the
+ *  reservation when the memory goes away before the region is in the index.
+ */
+pin_cache::region *pin_cache::acquire(void *addr, size_t len) {
+  if (!m_enabled || len == 0) {
+    return nullptr;
+  }
+
+  const uint64_t start = reinterpret_cast<uint64_t>(addr) & ~(pin_cache_page_size - 1);
+  const uint64_t end = (reinterpret_cast<uint64_t>(addr) + len + pin_cache_page_size - 1) &
+                       ~(pin_cache_page_size - 1);
+  const uint64_t size = end - start;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  // Regions never overlap, so only the one starting at or below 'start' can
+  // contain the range. Partial overlaps are not cached.
+  auto it = m_regions.upper_bound(start);
+  if (it != m_regions.begin()) {
+    region *r = std::prev(it)->second;
+    if (r->end >= end) {
+      r->users++;
+      m_lru.splice(m_lru.begin(), m_lru, r->lru_pos);
+      m_hits++;
+      return r;
+    }
+    if (r->end > start) {
+      m_bypasses++;
+      return nullptr;
+    }
+  }
+  if ((it != m_regions.end() && it->first < end) || size > m_budget ||
+      pending_overlaps(start, end)) {
+    m_bypasses++;
+    return nullptr;
+  }
+
+  if (m_pinned_bytes + size > m_budget && !evict_idle(m_budget - size)) {
+    m_bypasses++;
+    return nullptr;
+  }
+  pending_pin pending = {end, false};
+  m_pending[start] = pending;
+  m_pinned_bytes += size;
+  lock.unlock();
+
+  void *pin_addr = reinterpret_cast<void *>(start);
+  fpga_result res = mpfVtpPrepareBuffer(mpf_handle, size, &pin_addr, FPGA_BUF_PREALLOCATED);
+  if (res != FPGA_OK) {
+    // Most likely ran into the locked memory limit, retry with no idle pins
+    lock.lock();
+    uint64_t pinned_before = m_pinned_bytes;
+    evict_idle(0);
+    bool evicted = m_pinned_bytes < pinned_before;
+    lock.unlock();
+    if (evicted) {
+      res = mpfVtpPrepareBuffer(mpf_handle, size, &pin_addr, FPGA_BUF_PREALLOCATED);
+    }
+  }
+
+  // Watch the range only after it is pinned; pinning faults the pages in and
+  // a fault on a registered range would wait for the monitor thread.
+  bool registered = false;
+  if (res == FPGA_OK) {
+    uffdio_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.range.start = start;
+    reg.range.len = size;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    // Fails e.g. for hugetlbfs mappings not aligned to the huge page size, or
+    // memory already watched by another userfaultfd
+    registered = ioctl(m_uffd, UFFDIO_REGISTER, &reg) == 0;
+  }
+
+  lock.lock();
+  auto pending_it = m_pending.find(start);
+  bool invalidated = pending_it->second.invalidated;
+  m_pending.erase(pending_it);
+  if (res != FPGA_OK || !registered || invalidated) {
+    // Pinning or watching failed, or the memory went away meanwhile
+    if (registered) {
+      unregister_range(m_uffd, start, end);
+    }
+    if (res == FPGA_OK) {
+      mpfVtpReleaseBuffer(mpf_handle, pin_addr);
+    }
+    m_pinned_bytes -= size;
+    m_bypasses++;
+    return nullptr;
+  }
+
+  region *r = new region;
+  r->start = start;
+  r->end = end;
+  r->users = 1;
+  r->stale = false;
+  m_lru.push_front(r);
+  r->lru_pos = m_lru.begin();
+  m_regions[start] = r;
+  m_misses++;
+  return r;
+}
+
+// True if a pin in progress overlaps [start, end); m_mutex must be held
+bool pin_cache::pending_overlaps(uint64_t start, uint64_t end) const {
+  for (const auto &p : m_pending) {
+    if (p.first < end && p.second.end > start) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void pin_cache::release(region *r) {
+  if (r == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (--r->users > 0 || !r->stale) {
+    return;
+  }
+  m_stale.erase(std::find(m_stale.begin(), m_stale.end(), r));
+  unpin(r);
+}
+
+pin_cache::stats pin_cache::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  stats s;
+  s.hits = m_hits;
+  s.misses = m_misses;
+  s.bypasses = m_bypasses;
+  s.evictions = m_evictions;
+  s.invalidations = m_invalidations;
+  s.pinned_bytes = m_pinned_bytes;
+  s.num_regions = m_regions.size();
+  return s;
+}
+
+void pinned_range_table::insert(void *addr, size_t len) {
+  uint64_t start = reinterpret_cast<uint64_t>(addr);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ranges[start] = start + len;
+}
+
+void pinned_range_table::erase(void *addr) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ranges.erase(reinterpret_cast<uint64_t>(addr));
+}
+
+bool pinned_range_table::contains(const void *addr, size_t len) {
+  uint64_t start = reinterpret_cast<uint64_t>(addr);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_ranges.upper_bound(start);
+  if (it == m_ranges.begin()) {
+    return false;
+  }
+  --it;
+  return start + len <= it->second;
+}
+
+}; // namespace intel_opae_mmd
@@ -0,0 +1,132 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_PIN_CACHE_H_
+#define MMD_PIN_CACHE_H_
+
+#include <opae/fpga.h>
+#include <opae/mpf/mpf.h>
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace intel_opae_mmd {
+
+/** Cache of host regions that are pinned and translated by MPF VTP.
+ *
+ *  Pinning a user buffer with mpfVtpPrepareBuffer and releasing it again after
+ *  every transfer is expensive, and applications tend to reuse the same
+ *  buffers over and over. The cache keeps regions pinned after the transfer,
+ *  indexed by start address, and evicts the least recently used idle regions
+ *  once the pinned byte budget is exceeded.
+ *
+ *  A cached pin goes stale as soon as the application unmaps the memory (and
+ *  the virtual range gets reused for different pages), so every cached region
+ *  is registered with a userfaultfd and a monitor thread drops regions on
+ *  unmap, madvise(DONTNEED) and mremap events. If userfaultfd is not available
+ *  the cache disables itself and callers fall back to pin/unpin per transfer.
+ *
+ *  The events arrive after the mapping has already changed, so there is a
+ *  window in which a hit still returns the old pages of a range that was
+ *  unmapped or zapped, and a DMA to it silently misses the application's
+ *  memory. The cache is therefore off by default and is only safe for
+ *  applications that do not unmap or madvise() buffers while other threads
+ *  transfer to the same addresses.
+ */
+class pin_cache final {
+public:
+  struct region;
+
+  struct stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t bypasses;
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint64_t pinned_bytes;
+    uint64_t num_regions;
+  };
+
+  // budget_bytes of 0 disables the cache
+  pin_cache(mpf_handle_t mpf_handle_arg, uint64_t budget_bytes);
+  ~pin_cache();
+
+  bool enabled() const { return m_enabled; }
+
+  // Returns a cached region covering [addr, addr + len), pinning it on a
+  // miss, or nullptr when the range can not be cached; in that case the caller
+  // has to pin the memory itself. Every non-null result must be passed back
+  // to release() once the DMA using it has completed.
+  region *acquire(void *addr, size_t len);
+  void release(region *r);
+
+  stats get_stats();
+
+  pin_cache(const pin_cache &) = delete;
+  pin_cache &operator=(const pin_cache &) = delete;
+
+private:
+  bool open_userfaultfd();
+  void monitor_thread();
+  void invalidate(uint64_t start, uint64_t end);
+  bool pending_overlaps(uint64_t start, uint64_t end) const;
+  bool evict_idle(uint64_t bytes_needed);
+  void drop(region *r);
+  void unpin(region *r);
+
+  mpf_handle_t mpf_handle;
+  bool m_enabled;
+  uint64_t m_budget;
+  uint64_t m_pinned_bytes;
+
+  std::mutex m_mutex;
+  std::map<uint64_t, region *> m_regions; // keyed by region start
+  std::list<region *> m_lru;              // most recently used at the front
+  std::vector<region *> m_stale;          // invalidated while still in use
+
+  // A range being pinned by acquire() without the lock held
+  struct pending_pin {
+    uint64_t end;
+    bool invalidated; // unmapped or remapped before the pin completed
+  };
+  std::map<uint64_t, pending_pin> m_pending; // keyed by range start
+
+  int m_uffd;
+  int m_wake_fd;
+  std::thread *m_thread;
+
+  uint64_t m_hits;
+  uint64_t m_misses;
+  uint64_t m_bypasses;
+  uint64_t m_evictions;
+  uint64_t m_invalidations;
+};
+
+/** Host ranges that stay pinned for as long as they are allocated, i.e. the
+ *  memory handed out by aocl_mmd_host_alloc. DMA into these ranges can go
+ *  straight to the descriptors without any VTP calls.
+ */
+class pinned_range_table final {
+public:
+  pinned_range_table() = default;
+
+  void insert(void *addr, size_t len);
+  void erase(void *addr);
+  // True if [addr, addr + len) lies within a single pinned range
+  bool contains(const void *addr, size_t len);
+
+  pinned_range_table(const pinned_range_table &) = delete;
+  pinned_range_table &operator=(const pinned_range_table &) = delete;
+
+private:
+  std::mutex m_mutex;
+  std::map<uint64_t, uint64_t> m_ranges; // range start -> range end
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_PIN_CACHE_H_
@@ -0,0 +1,183 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <numa.h>
+#include <numaif.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "mmd_device.h"
+#include "mmd_staging_pool.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace intel_opae_mmd {
+
+static const size_t small_page_len = 4096;
+static const size_t huge_2m_len = 2 * 1024 * 1024;
+static const size_t huge_1g_len = 1024 * 1024 * 1024;
+// Smallest region mapped at a time, so a device's slots usually share one
+static const size_t min_region_len = 32 * 1024 * 1024;
+
+staging_pool::staging_pool(int numa_node, uint64_t page_kb,
+                           pinned_range_table *prepinned)
+    : m_numa_node(numa_node), m_page_len(small_page_len),
+      m_prepinned(prepinned), m_mpf_handle(nullptr) {
+  if (page_kb * 1024 == huge_1g_len) {
+    m_page_len = huge_1g_len;
+  } else if (page_kb * 1024 == huge_2m_len) {
+    m_page_len = huge_2m_len;
+  }
+  if (m_numa_node >= 0 && numa_available() < 0) {
+    m_numa_node = -1;
+  }
+}
+
+staging_pool::~staging_pool() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (region &r : m_regions) {
+    unpin_region(r);
+    munmap(r.addr, r.len);
+  }
+}
+
+/** map_region() maps a new region of at least min_bytes, trying the
+ *  configured page size first and smaller ones after that. The node is set
+ *  as the preferred policy of the region before it is touched, so the first
+ *  fault places every page there. Preferred rather than bind: hugepage
+ *  reservations are not per node, and a bound hugetlb fault with no page
+ *  left on the node would SIGBUS instead of falling back.
+ *  Called with m_mutex held.
+ */
+bool staging_pool::map_region(size_t min_bytes) {
+  const size_t page_lens[] = {huge_1g_len, huge_2m_len, small_page_len};
+  for (size_t page_len : page_lens) {
+    if (page_len > m_page_len) {
+      continue;
+    }
+    size_t len = std::max(min_bytes, min_region_len);
+    len = (len + page_len - 1) & ~(page_len - 1);
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (page_len == huge_1g_len) {
+      flags |= MAP_HUGETLB | (30 << MAP_HUGE_SHIFT);
+    } else if (page_len == huge_2m_len) {
+      flags |= MAP_HUGETLB | (21 << MAP_HUGE_SHIFT);
+    }
+    void *addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+      if(MMD_DEBUG_ENABLED(MMD_LOG_DMA)){
+        DEBUG_LOG("DEBUG LOG : staging pool : no %zu KB pages for 0x%zx bytes : %s\n",
+                  page_len / 1024, len, strerror(errno));
+      }
+      continue;
+    }
+    if (page_len == small_page_len) {
+      madvise(addr, len, MADV_HUGEPAGE);
+    }
+    if (m_numa_node >= 0) {
+      unsigned long nodemask = 1UL << m_numa_node;
+      if (m_numa_node >= static_cast<int>(sizeof(nodemask) * 8) ||
+          mbind(addr, len, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+        fprintf(stderr, "Could not place DMA staging memory on NUMA node %d\n", m_numa_node);
+      }
+    }
+    // Fault everything in now rather than during the first transfer
+    memset(addr, 0, len);
+
+    region r = {static_cast<char *>(addr), len, 0, page_len, false};
+    if (m_mpf_handle && !pin_region(r)) {
+      munmap(addr, len);
+      return false;
+    }
+    m_regions.push_back(r);
+    if(MMD_DEBUG_ENABLED(MMD_LOG_DMA | MMD_LOG_ENABLE)){
+      DEBUG_LOG("DEBUG LOG : staging pool : mapped 0x%zx bytes of %zu KB pages on NUMA node %d\n",
+                len, page_len / 1024, m_numa_node);
+    }
+    return true;
+  }
+  fprintf(stderr, "Error mapping 0x%zx bytes of DMA staging memory\n", min_bytes);
+  return false;
+}
+
+bool staging_pool::pin_region(region &r) {
+  void *addr = r.addr;
+  if (mpfVtpPrepareBuffer(m_mpf_handle, r.len, &addr, FPGA_BUF_PREALLOCATED) != FPGA_OK) {
+    fprintf(stderr, "Error pinning 0x%zx bytes of DMA staging memory\n", r.len);
+    return false;
+  }
+  r.pinned = true;
+  if (m_prepinned) {
+    m_prepinned->insert(r.addr, r.len);
+  }
+  return true;
+}
+
+void staging_pool::unpin_region(region &r) {
+  if (!r.pinned) {
+    return;
+  }
+  if (m_prepinned) {
+    m_prepinned->erase(r.addr);
+  }
+  mpfVtpReleaseBuffer(m_mpf_handle, r.addr);
+  r.pinned = false;
+}
+
+bool staging_pool::pin(mpf_handle_t mpf_handle) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_mpf_handle = mpf_handle;
+  bool ok = true;
+  for (region &r : m_regions) {
+    if (!r.pinned && !pin_region(r)) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void staging_pool::unpin() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (region &r : m_regions) {
+    unpin_region(r);
+  }
+  m_mpf_handle = nullptr;
+}
+
+void *staging_pool::get(size_t bytes) {
+  bytes = (bytes + small_page_len - 1) & ~(small_page_len - 1);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_free.find(bytes);
+  if (it != m_free.end()) {
+    void *block = it->second;
+    m_free.erase(it);
+    return block;
+  }
+  if (m_regions.empty() || m_regions.back().len - m_regions.back().used < bytes) {
+    if (!map_region(bytes)) {
+      return nullptr;
+    }
+  }
+  region &r = m_regions.back();
+  void *block = r.addr + r.used;
+  r.used += bytes;
+  return block;
+}
+
+void staging_pool::put(void *block, size_t bytes) {
+  if (block == nullptr) {
+    return;
+  }
+  bytes = (bytes + small_page_len - 1) & ~(small_page_len - 1);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_free.insert(std::make_pair(bytes, block));
+}
+
+}; // namespace intel_opae_mmd
@@ -0,0 +1,83 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#ifndef MMD_STAGING_POOL_H_
+#define MMD_STAGING_POOL_H_
+
+#include <opae/fpga.h>
+#include <opae/mpf/mpf.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "mmd_pin_cache.h"
+
+namespace intel_opae_mmd {
+
+/** Pool of pinned host memory for the DMA staging slots and the
+ *  aocl_mmd_copy bounce buffer of one device.
+ *
+ *  Memory is mapped in regions placed explicitly on the NUMA node of the card
+ *  with mbind, so nothing else in the process has its memory or CPU policy
+ *  changed. Regions use hugepages of page_kb when the system has them
+ *  reserved, 1GB pages fall back to 2MB pages and those to normal pages with
+ *  transparent hugepages requested. Every region is pinned with MPF VTP and
+ *  listed in the prepinned range table, so buffers from the pool never need
+ *  pinning per transfer.
+ *
+ *  The memory outlives MPF connections: unpin() before the connection goes
+ *  away (reprogramming) and pin() with the new one afterwards. Blocks are
+ *  handed out with get() and returned with put(); freed blocks are reused by
+ *  later requests of the same size, the regions are unmapped with the pool.
+ */
+class staging_pool final {
+public:
+  // numa_node < 0 leaves placement to the default policy, page_kb of 1048576
+  // asks for 1GB pages, 2048 for 2MB pages, anything else for normal pages
+  staging_pool(int numa_node, uint64_t page_kb, pinned_range_table *prepinned);
+  ~staging_pool();
+
+  // Pins every region with VTP of mpf_handle, regions mapped later are pinned
+  // as they are created. Returns false if a region could not be pinned.
+  bool pin(mpf_handle_t mpf_handle);
+  void unpin();
+
+  // Returns a 4KB aligned block of at least bytes, nullptr on failure
+  void *get(size_t bytes);
+  void put(void *block, size_t bytes);
+
+  int numa_node() const { return m_numa_node; }
+
+  staging_pool(const staging_pool &) = delete;
+  staging_pool &operator=(const staging_pool &) = delete;
+
+private:
+  struct region {
+    char *addr;
+    size_t len;
+    size_t used;
+    size_t page_len;
+    bool pinned;
+  };
+
+  bool map_region(size_t min_bytes);
+  bool pin_region(region &r);
+  void unpin_region(region &r);
+
+  int m_numa_node;
+  size_t m_page_len;
+  pinned_range_table *m_prepinned;
+  mpf_handle_t m_mpf_handle; // nullptr while unpinned
+
+  std::mutex m_mutex;
+  std::vector<region> m_regions;
+  std::multimap<size_t, void *> m_free; // block size -> returned block
+};
+
+}; // namespace intel_opae_mmd
+
+#endif // MMD_STAGING_POOL_H_
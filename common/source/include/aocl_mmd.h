@@ -183,10 +183,13 @@ typedef enum {
    AOCL_MMD_MIN_HOST_MEMORY_ALIGNMENT = 12,  /* Min alignment that the ASP supports for host allocations (size_t) */
    AOCL_MMD_HOST_MEM_CAPABILITIES = 13,      /* Capabilities of aocl_mmd_host_alloc() (unsigned int)*/
    AOCL_MMD_SHARED_MEM_CAPABILITIES = 14,    /* Capabilities of aocl_mmd_shared_alloc (unsigned int)*/
-   AOCL_MMD_DEVICE_MEM_CAPABILITIES = 15,    /* Capabilities of aocl_mmd_device_alloc (unsigned int)*/
+   AOCL_MMD_DEVICE_MEM_CAPABILITIES = 15,    /* Capabilities of aocl_mmd_device_alloc (unsigned int), 0 unless device_alloc_mb is set with interleaving off*/
    AOCL_MMD_HOST_MEM_CONCURRENT_GRANULARITY = 16,   /*(size_t)*/
    AOCL_MMD_SHARED_MEM_CONCURRENT_GRANULARITY = 17, /*(size_t)*/
    AOCL_MMD_DEVICE_MEM_CONCURRENT_GRANULARITY = 18, /*(size_t)*/
+   /* MMD extension, kept clear of the ids above */
+   AOCL_MMD_EFFECTIVE_CONFIG = 1000,               /* Resolved tuning knobs, key=value pairs delimiter=; (char*) */
+   AOCL_MMD_DEVICE_MEM_STATS = 1001,               /* Per bank free, largest free and allocated bytes of aocl_mmd_device_alloc, key=value pairs delimiter=; (char*) */
 } aocl_mmd_info_t;
 
 typedef struct {
@@ -359,6 +362,56 @@ AOCL_MMD_CALL int aocl_mmd_copy(
       size_t len,
       int mmd_interface, size_t src_offset, size_t dst_offset ) WEAK;
 
+/* Vectored read and write, an extension of this MMD.
+ * Moves a list of host fragments to or from one contiguous range of the
+ * interface, in list order, as a single operation: op is completed once for
+ * the whole list and the same blocking rules as aocl_mmd_read/aocl_mmd_write
+ * apply. The fragment list may be released as soon as the call returns, the
+ * fragments themselves must stay valid until the operation completes.
+ *
+ * Arguments:
+ *   iov - the host fragments, iovcnt entries
+ *
+ *   offset - the byte offset within the interface of the first fragment, the
+ *   others follow back to back
+ */
+typedef struct {
+  void* base;
+  size_t len;
+} aocl_mmd_iovec_t;
+
+AOCL_MMD_CALL int aocl_mmd_readv(
+      int handle,
+      aocl_mmd_op_t op,
+      const aocl_mmd_iovec_t* iov,
+      size_t iovcnt,
+      int mmd_interface, size_t offset ) WEAK;
+AOCL_MMD_CALL int aocl_mmd_writev(
+      int handle,
+      aocl_mmd_op_t op,
+      const aocl_mmd_iovec_t* iov,
+      size_t iovcnt,
+      int mmd_interface, size_t offset ) WEAK;
+
+/* Transfer priority, an extension of this MMD.
+ * Sets the priority class of the non-blocking transfers the calling thread
+ * starts on handle from now on with aocl_mmd_read, aocl_mmd_write,
+ * aocl_mmd_readv and aocl_mmd_writev; other threads are not affected.
+ * High priority transfers are started ahead of queued normal ones, and large
+ * normal transfers are sent in slices so a high priority transfer only
+ * waits for the slice in progress. Threads start at normal priority.
+ *
+ * The return value is 0 on success, negative for an unknown handle or class.
+ */
+typedef enum {
+   AOCL_MMD_TRANSFER_PRIORITY_NORMAL = 0,
+   AOCL_MMD_TRANSFER_PRIORITY_HIGH = 1
+} aocl_mmd_transfer_priority_t;
+
+AOCL_MMD_CALL int aocl_mmd_set_transfer_priority(
+      int handle,
+      aocl_mmd_transfer_priority_t priority ) WEAK;
+
 /* Host Channel create operation
  * Opens channel between host and kernel.
  *
@@ -487,7 +540,20 @@ typedef enum {
    *  memory bank. It is invalid to specify this property without also specifying
    *  AOCL_MMD_GLOBAL_MEMORY_INTERFACE.
    */
-  AOCL_MMD_MEM_PROPERTIES_MEMORY_BANK
+  AOCL_MMD_MEM_PROPERTIES_MEMORY_BANK,
+  /**
+   *  MMD extension. Page size in bytes that an aocl_mmd_host_alloc() or
+   *  aocl_mmd_shared_alloc() allocation is backed with: 4096, 2097152 (2MB)
+   *  or 1073741824 (1GB). Smaller pages are used when the system has no
+   *  pages of the requested size left, see aocl_mmd_host_alloc_page_size().
+   */
+  AOCL_MMD_MEM_PROPERTIES_PAGE_SIZE=1000,
+  /**
+   *  MMD extension. NUMA node to place an aocl_mmd_host_alloc() or
+   *  aocl_mmd_shared_alloc() allocation on. Without it the allocation goes to
+   *  the node of the first device, when NUMA handling is enabled.
+   */
+  AOCL_MMD_MEM_PROPERTIES_NUMA_NODE=1001
 } aocl_mmd_mem_properties_t;
 
 /**
@@ -524,6 +590,13 @@ AOCL_MMD_CALL void* aocl_mmd_host_alloc (int* handles, size_t num_devices, size_
  */
 AOCL_MMD_CALL int aocl_mmd_free (void* mem) WEAK;
 
+/**
+ * MMD extension. Returns the size in bytes of the pages backing memory
+ * allocated by aocl_mmd_host_alloc() or aocl_mmd_shared_alloc(), 0 if mem is
+ * not the start of such an allocation.
+ */
+AOCL_MMD_CALL size_t aocl_mmd_host_alloc_page_size (void* mem) WEAK;
+
 /**
  *  Allocate memory that is owned by the device. This pointer can only be
  *  accessed by the kernel; can't be accessed by the host. The host is able to
@@ -543,6 +616,15 @@ AOCL_MMD_CALL int aocl_mmd_free (void* mem) WEAK;
  */
 AOCL_MMD_CALL void * aocl_mmd_device_alloc( int handle, size_t size, size_t alignment, aocl_mmd_mem_properties_t *properties, int* error) WEAK;
 
+/**
+ * MMD extension. Frees memory allocated by aocl_mmd_device_alloc() for the
+ * device of handle. Device pointers of different devices can be equal, when
+ * they are aocl_mmd_free() refuses to guess and this has to be used instead.
+ *
+ * @return AOCL_MMD_ERROR_SUCCESS if success, else error code
+ */
+AOCL_MMD_CALL int aocl_mmd_device_free (int handle, void* mem) WEAK;
+
 /**
  *  Shared allocations may migrate between the host and one or more associated
  *  device. The same pointer to a shared allocation may be used on the host and
@@ -15,5 +15,7 @@
 int mmd_device_reprogram(const char *device_name, void *data,
                               size_t data_size);
 extern bool diagnose;
+#ifndef DEBUG_LOG
 #define DEBUG_LOG(...) fprintf(stderr, __VA_ARGS__)
+#endif
 #endif // MMD_H
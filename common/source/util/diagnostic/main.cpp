@@ -13,7 +13,8 @@
  *
  * 4. Large Size DMA transmission between host and the device
  *
- * 5. Measure PCIe bandwidth:
+ * 5. Measure PCIe bandwidth, and the bandwidth of device to device copies
+ * (clEnqueueCopyBuffer, aocl_mmd_copy), checking the copied data:
  *
  * Fastest: Max speed of any one Enqueue call
  * Slowest: Min speed of any one Enqueue call
@@ -301,6 +302,7 @@ int main(int argc, char *argv[]) {
 
   struct speed *readspeed = new struct speed[iterations];
   struct speed *writespeed = new struct speed[iterations];
+  struct speed *copyspeed = new struct speed[iterations];
 
   bool result = true;
 
@@ -330,6 +332,9 @@ int main(int argc, char *argv[]) {
     writespeed[i] = ocl_writespeed((char *)buf, block_bytes, maxbytes);
     readspeed[i] = ocl_readspeed((char *)output, block_bytes, maxbytes);
     result &= check_results(buf, output, maxints);
+    copyspeed[i] = ocl_copyspeed(block_bytes, maxbytes);
+    ocl_read_copy((char *)output, maxbytes);
+    result &= check_results(buf, output, maxints);
     printf(" %.2f MB/s\n", (writespeed[i].fastest > readspeed[i].fastest)
                                ? writespeed[i].fastest
                                : readspeed[i].fastest);
@@ -375,9 +380,27 @@ int main(int argc, char *argv[]) {
       read_topspeed = readspeed[i].total;
   }
 
+  float copy_topspeed = 0;
+  block_bytes = DEFAULT_MINNUMBYTES;
+
+  printf("\n");
+
+  printf("Copying %d KBs on the device with block size (in bytes) below:\n", maxbytes / 1024);
+  printf("\nBlock_Size Avg    Max    Min    End-End (MB/s)\n");
+  for (unsigned i = 0; i < iterations; i++, block_bytes *= 2) {
+    printf("%8d %.2f %.2f %.2f %.2f\n", block_bytes, copyspeed[i].average,
+           copyspeed[i].fastest, copyspeed[i].slowest, copyspeed[i].total);
+
+    if (copyspeed[i].fastest > copy_topspeed)
+      copy_topspeed = copyspeed[i].fastest;
+    if (copyspeed[i].total > copy_topspeed)
+      copy_topspeed = copyspeed[i].total;
+  }
+
   printf("\nWrite top speed = %.2f MB/s\n", write_topspeed);
   printf("Read top speed = %.2f MB/s\n", read_topspeed);
   printf("Throughput = %.2f MB/s\n", (read_topspeed + write_topspeed) / 2);
+  printf("Device copy top speed = %.2f MB/s\n", copy_topspeed);
 
   if (result)
     printf("\nASP DIAGNOSTIC_PASSED\n");
@@ -389,6 +412,7 @@ int main(int argc, char *argv[]) {
 
   delete[] readspeed;
   delete[] writespeed;
+  delete[] copyspeed;
 
   return (result) ? 0 : DIAGNOSE_FAILED;
 }
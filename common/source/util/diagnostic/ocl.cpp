@@ -38,6 +38,7 @@ static cl_program program;
 static cl_int status;
 
 static cl_mem kernel_input;
+static cl_mem copy_output;
 
 float ocl_get_exec_time_ns(cl_event evt);
 
@@ -53,6 +54,8 @@ static void freeResources() {
     clReleaseContext(context);
   if (kernel_input)
     clReleaseMemObject(kernel_input);
+  if (copy_output)
+    clReleaseMemObject(copy_output);
 }
 
 static void dump_error(const char *str, cl_int status) {
@@ -162,6 +165,12 @@ void ocl_device_init(int maxbytes, char *device_name) {
                                 NULL, &status);
   if (status != CL_SUCCESS)
     dump_error("Failed clCreateBuffer.", status);
+
+  // destination of the device-to-device copies
+  copy_output = clCreateBuffer(context, CL_MEM_READ_WRITE, (size_t)maxbytes,
+                               NULL, &status);
+  if (status != CL_SUCCESS)
+    dump_error("Failed clCreateBuffer.", status);
 }
 
 int ocl_test_all_global_memory() {
@@ -382,26 +391,9 @@ float ocl_get_exec_time2_ns(cl_event evt_first, cl_event evt_last) {
   return (float)exectime_ns;
 }
 
-struct speed ocl_readspeed(char *buf, int block_bytes, int bytes) {
-  size_t num_xfers = bytes / block_bytes;
-
-  assert(num_xfers > 0);
-  if (num_xfers <= 0) {
-    exit(1);
-  }
-
-  cl_event *evt = new cl_event[(size_t)num_xfers];
-
-  for (size_t i = 0; i < num_xfers; i++) {
-
-    // read the input
-    status = clEnqueueReadBuffer(
-        queue, kernel_input, CL_TRUE, (size_t)(i * block_bytes),
-        (size_t)block_bytes, (void *)&buf[i * block_bytes], 0, NULL, &evt[i]);
-    if (status != CL_SUCCESS)
-      dump_error("Failed to enqueue buffer.", status);
-  }
-
+// wait for the transfers of evt and summarize their speed, releases the events
+static struct speed ocl_collect_speed(cl_event *evt, size_t num_xfers,
+                                      int block_bytes, int bytes) {
   // Make sure everything is done
   clFinish(queue);
 
@@ -432,6 +424,29 @@ struct speed ocl_readspeed(char *buf, int block_bytes, int bytes) {
   return speed;
 }
 
+struct speed ocl_readspeed(char *buf, int block_bytes, int bytes) {
+  size_t num_xfers = bytes / block_bytes;
+
+  assert(num_xfers > 0);
+  if (num_xfers <= 0) {
+    exit(1);
+  }
+
+  cl_event *evt = new cl_event[(size_t)num_xfers];
+
+  for (size_t i = 0; i < num_xfers; i++) {
+
+    // read the input
+    status = clEnqueueReadBuffer(
+        queue, kernel_input, CL_TRUE, (size_t)(i * block_bytes),
+        (size_t)block_bytes, (void *)&buf[i * block_bytes], 0, NULL, &evt[i]);
+    if (status != CL_SUCCESS)
+      dump_error("Failed to enqueue buffer.", status);
+  }
+
+  return ocl_collect_speed(evt, num_xfers, block_bytes, bytes);
+}
+
 struct speed ocl_writespeed(char *buf, int block_bytes, int bytes) {
   size_t num_xfers = bytes / block_bytes;
 
@@ -450,33 +465,37 @@ struct speed ocl_writespeed(char *buf, int block_bytes, int bytes) {
       dump_error("Failed to enqueue buffer write.", status);
   }
 
-  // Make sure everything is done
-  clFinish(queue);
+  return ocl_collect_speed(evt, num_xfers, block_bytes, bytes);
+}
 
-  struct speed speed;
-  speed.average = 0.0f;
-  speed.fastest = 0.0f;
-  speed.slowest = 10000000.0f;
+// Copy the input buffer to copy_output on the device (aocl_mmd_copy), so the
+// data never crosses PCIe when the DMA has a copy channel
+struct speed ocl_copyspeed(int block_bytes, int bytes) {
+  size_t num_xfers = bytes / block_bytes;
 
-  speed.total = (float)((float)bytes * 1000.0f /
-                        ocl_get_exec_time2_ns(evt[0], evt[num_xfers - 1]));
+  assert(num_xfers > 0);
+  if (num_xfers <= 0) {
+    exit(1);
+  }
+  cl_event *evt = new cl_event[(size_t)num_xfers];
 
   for (size_t i = 0; i < num_xfers; i++) {
-    float time_ns = ocl_get_exec_time_ns(evt[i]);
-    float speed_MBps = (float)block_bytes * 1000.0f / time_ns;
-
-    if (speed_MBps > speed.fastest)
-      speed.fastest = speed_MBps;
-    if (speed_MBps < speed.slowest)
-      speed.slowest = speed_MBps;
-
-    speed.average += time_ns;
-    clReleaseEvent(evt[i]);
-  }
-  if (speed.average != 0.0f) {
-    speed.average = (float)((float)bytes * 1000.0f / speed.average);
+    status = clEnqueueCopyBuffer(queue, kernel_input, copy_output,
+                                 (size_t)(i * block_bytes),
+                                 (size_t)(i * block_bytes),
+                                 (size_t)block_bytes, 0, NULL, &evt[i]);
+    if (status != CL_SUCCESS)
+      dump_error("Failed to enqueue buffer copy.", status);
   }
 
-  delete[] evt;
-  return speed;
+  return ocl_collect_speed(evt, num_xfers, block_bytes, bytes);
+}
+
+// Read back what ocl_copyspeed() wrote, after clearing buf
+void ocl_read_copy(char *buf, int bytes) {
+  memset(buf, 0, (size_t)bytes);
+  status = clEnqueueReadBuffer(queue, copy_output, CL_TRUE, 0, (size_t)bytes,
+                               (void *)buf, 0, NULL, NULL);
+  if (status != CL_SUCCESS)
+    dump_error("Failed to read copied buffer.", status);
 }
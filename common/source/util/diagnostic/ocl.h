@@ -11,4 +11,6 @@ struct speed {
 void ocl_device_init(int maxbytes, char *device_name);
 struct speed ocl_readspeed(char *buf, int block_bytes, int bytes);
 struct speed ocl_writespeed(char *buf, int block_bytes, int bytes);
+struct speed ocl_copyspeed(int block_bytes, int bytes);
+void ocl_read_copy(char *buf, int bytes);
 int ocl_test_all_global_memory();
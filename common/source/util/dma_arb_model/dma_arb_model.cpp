@@ -0,0 +1,517 @@
+// Copyright 2022 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+/* Cycle model of the DMA local-memory port arbiter (dma_local_mem_arb.sv)
+ * with the traffic DMA channel 0 puts on it when the device-to-device copy
+ * block is enabled (DEV_COPY_ENABLE in dma_pkg.sv).
+ *
+ * Two arbiters are modelled, one per local-memory port like dma_top: the
+ * read port is shared by the F2H host transfer and the reads of the copy
+ * block, the write port by the H2F host transfer and the copy writes. The
+ * arbiter follows the RTL always block by always block. The memory ports
+ * raise waitrequest at random and return read data in order after a random
+ * latency, now and then long enough to fill the arbiter's response FIFO.
+ *
+ * Copies are split the way mmd_dma::device_copy() splits them, including
+ * overlapping ranges in both directions, and host reads and writes run
+ * against disjoint regions during every copy. The model checks
+ *    - every read beat reaches the side that issued it, with the right data
+ *    - a command held off by waitrequest never changes and write bursts are
+ *      never interleaved
+ *    - neither side waits longer than max_wait_cycles for the port
+ *    - the copy region matches memmove() after each copy and the host write
+ *      region matches what was written
+ * and returns non-zero with the first violation.
+ *
+ * Usage: dma_arb_model [copies] [seed]
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+// From dma_pkg.sv
+static const unsigned burstcount_max = 16;  // LOCAL_MEM_RD/WR_BURSTCOUNT_MAX
+static const unsigned rspq_depth = 128;     // LOCAL_MEM_ARB_RSPQ_DEPTH
+static const unsigned rspq_almost_full = rspq_depth - 2;
+
+// Memory in 64-byte words, split in regions for each kind of traffic
+static const uint64_t host_rd_base = 0;
+static const uint64_t host_wr_base = 1 << 14;
+static const uint64_t copy_base = 1 << 15;
+static const uint64_t region_words = 1 << 14;
+static const uint64_t mem_words = copy_base + region_words;
+
+// Words of read data the copy block buffers ahead of its writes
+static const unsigned copy_buffer_words = 256;
+static const uint64_t max_wait_cycles = 2000;
+static const uint64_t max_copy_cycles = 1000000;
+
+static std::mt19937_64 rng;
+static uint64_t cycle = 0;
+
+static void expect(bool ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "cycle %" PRIu64 " : %s\n", cycle, what);
+    exit(1);
+  }
+}
+
+static bool chance(unsigned percent) { return rng() % 100 < percent; }
+
+static uint64_t rand_range(uint64_t lo, uint64_t hi) { return lo + rng() % (hi - lo + 1); }
+
+// Source to sink signals of an ofs_plat_avalon_mem_if
+struct avmm_cmd {
+  bool read = false;
+  bool write = false;
+  uint64_t address = 0;
+  unsigned burstcount = 0;
+  uint64_t writedata = 0;
+
+  bool operator==(const avmm_cmd &o) const {
+    return read == o.read && write == o.write && address == o.address &&
+           burstcount == o.burstcount && (!write || writedata == o.writedata);
+  }
+};
+
+// Sink to source signals of an ofs_plat_avalon_mem_if
+struct avmm_rsp {
+  bool waitrequest = false;
+  bool readdatavalid = false;
+  uint64_t readdata = 0;
+};
+
+/** dma_local_mem_arb. comb() is the always_comb logic for this cycle and
+ *  leaves the outputs in out, rsp0 and rsp1, clock() is the always_ff logic
+ *  at the following edge.
+ */
+class local_mem_arb {
+public:
+  avmm_cmd out;
+  avmm_rsp rsp0, rsp1;
+
+  void comb(const avmm_cmd &in0, const avmm_cmd &in1, const avmm_rsp &mem) {
+    bool req0 = in0.read || in0.write;
+    bool req1 = in1.read || in1.write;
+    if (m_hold_q) {
+      m_grant = m_grant_q;
+    } else if (req0 && req1) {
+      m_grant = !m_grant_q;
+    } else {
+      m_grant = req1;
+    }
+
+    bool almost_full = m_rspq.size() >= rspq_almost_full;
+    out = m_grant ? in1 : in0;
+    out.read = out.read && !almost_full;
+    m_out_waitrequest = mem.waitrequest;
+    rsp0.waitrequest = m_grant || mem.waitrequest || (in0.read && almost_full);
+    rsp1.waitrequest = !m_grant || mem.waitrequest || (in1.read && almost_full);
+
+    expect(!mem.readdatavalid || !m_rspq.empty(), "read data without an outstanding read");
+    bool owner = !m_rspq.empty() && m_rspq.front().owner;
+    m_readdatavalid = mem.readdatavalid;
+    rsp0.readdata = rsp1.readdata = mem.readdata;
+    rsp0.readdatavalid = mem.readdatavalid && !owner;
+    rsp1.readdatavalid = mem.readdatavalid && owner;
+
+    m_req[0] = req0;
+    m_req[1] = req1;
+    m_almost_full_cycles += almost_full;
+  }
+
+  void clock() {
+    unsigned wr_beats_left_nxt = m_wr_beats_left;
+    if (out.write && !m_out_waitrequest) {
+      wr_beats_left_nxt = m_wr_beats_left ? m_wr_beats_left - 1 : out.burstcount - 1;
+    }
+
+    // scfifo: pop the head with the last beat of its burst, push accepted reads
+    if (m_readdatavalid) {
+      if (m_rd_beats_returned + 1 == m_rspq.front().burstcount) {
+        m_rspq.pop_front();
+        m_rd_beats_returned = 0;
+      } else {
+        m_rd_beats_returned++;
+      }
+    }
+    if (out.read && !m_out_waitrequest) {
+      m_rspq.push_back(rspq_entry{m_grant, out.burstcount});
+    }
+    expect(m_rspq.size() <= rspq_depth, "response FIFO overflow");
+
+    m_hold_q = ((out.read || out.write) && m_out_waitrequest) || wr_beats_left_nxt != 0;
+    m_grant_q = m_grant;
+    m_wr_beats_left = wr_beats_left_nxt;
+
+    // Starvation check, a side waits while it requests and is held off
+    const avmm_rsp *rsp[2] = {&rsp0, &rsp1};
+    for (int i = 0; i < 2; i++) {
+      m_wait[i] = m_req[i] && rsp[i]->waitrequest ? m_wait[i] + 1 : 0;
+      m_max_wait = std::max(m_max_wait, m_wait[i]);
+      expect(m_wait[i] < max_wait_cycles, "a side of the arbiter is starved");
+    }
+  }
+
+  bool grant() const { return m_grant; }
+  uint64_t max_wait() const { return m_max_wait; }
+  uint64_t almost_full_cycles() const { return m_almost_full_cycles; }
+
+private:
+  struct rspq_entry {
+    bool owner;
+    unsigned burstcount;
+  };
+
+  bool m_grant = false;
+  bool m_grant_q = false;
+  bool m_hold_q = false;
+  unsigned m_wr_beats_left = 0;
+  std::deque<rspq_entry> m_rspq;
+  unsigned m_rd_beats_returned = 0;
+
+  // This cycle's inputs that clock() needs
+  bool m_out_waitrequest = false;
+  bool m_readdatavalid = false;
+  bool m_req[2] = {false, false};
+
+  uint64_t m_wait[2] = {0, 0};
+  uint64_t m_max_wait = 0;
+  uint64_t m_almost_full_cycles = 0;
+};
+
+/** One local-memory port. Read data is sampled when it is returned, not
+ *  when the read is accepted, which is the pessimistic choice for copies
+ *  that read what an earlier piece wrote.
+ */
+class mem_port {
+public:
+  avmm_rsp rsp;
+
+  explicit mem_port(std::vector<uint64_t> &words) : m_words(words) {}
+
+  void comb() {
+    rsp.waitrequest = chance(20);
+    rsp.readdatavalid = !m_reads.empty() && m_reads.front().ready <= cycle;
+    if (rsp.readdatavalid) {
+      const read_burst &r = m_reads.front();
+      rsp.readdata = m_words[r.address + r.beat];
+    }
+  }
+
+  void clock(const avmm_cmd &cmd, bool source) {
+    expect(!m_stalled || cmd == m_stalled_cmd, "command changed while held off by waitrequest");
+    m_stalled = (cmd.read || cmd.write) && rsp.waitrequest;
+    m_stalled_cmd = cmd;
+
+    if (rsp.readdatavalid && ++m_reads.front().beat == m_reads.front().burstcount) {
+      m_reads.pop_front();
+    }
+    if (rsp.waitrequest) {
+      return;
+    }
+
+    if (cmd.read) {
+      expect(m_wr_beat == 0, "read issued inside a write burst");
+      expect(cmd.burstcount >= 1 && cmd.burstcount <= burstcount_max, "bad read burstcount");
+      expect(cmd.address + cmd.burstcount <= mem_words, "read out of range");
+      // In order, now and then stalled long enough to fill the response FIFO
+      uint64_t latency = chance(2) ? rand_range(200, 400) : rand_range(2, 40);
+      m_last_ready = std::max(m_last_ready, cycle + latency);
+      m_reads.push_back(read_burst{cmd.address, cmd.burstcount, 0, m_last_ready});
+    }
+    if (cmd.write) {
+      if (m_wr_beat == 0) {
+        expect(cmd.burstcount >= 1 && cmd.burstcount <= burstcount_max, "bad write burstcount");
+        expect(cmd.address + cmd.burstcount <= mem_words, "write out of range");
+        m_wr_address = cmd.address;
+        m_wr_burstcount = cmd.burstcount;
+        m_wr_source = source;
+      }
+      expect(source == m_wr_source, "write bursts interleaved");
+      m_words[m_wr_address + m_wr_beat] = cmd.writedata;
+      if (++m_wr_beat == m_wr_burstcount) {
+        m_wr_beat = 0;
+      }
+    }
+  }
+
+private:
+  struct read_burst {
+    uint64_t address;
+    unsigned burstcount;
+    unsigned beat;
+    uint64_t ready;
+  };
+
+  std::vector<uint64_t> &m_words;
+  std::deque<read_burst> m_reads;
+  uint64_t m_last_ready = 0;
+  uint64_t m_wr_address = 0;
+  unsigned m_wr_burstcount = 0;
+  unsigned m_wr_beat = 0;
+  bool m_wr_source = false;
+  bool m_stalled = false;
+  avmm_cmd m_stalled_cmd;
+};
+
+/** F2H host transfer reading local memory. The region holds its own word
+ *  addresses, so every beat that comes back can be checked.
+ */
+class host_reader {
+public:
+  avmm_cmd cmd;
+
+  void clock(const avmm_rsp &rsp, bool traffic) {
+    if (rsp.readdatavalid) {
+      expect(!m_expected.empty(), "host read data nobody asked for");
+      expect(rsp.readdata == m_expected.front(), "host read returned the wrong data");
+      m_expected.pop_front();
+      m_beats++;
+    }
+    if (cmd.read && !rsp.waitrequest) {
+      for (unsigned i = 0; i < cmd.burstcount; i++) {
+        m_expected.push_back(cmd.address + i);
+      }
+      cmd.read = false;
+    }
+    if (!cmd.read && traffic && m_expected.size() < 2048 && chance(90)) {
+      cmd.burstcount = rand_range(1, burstcount_max);
+      cmd.address = host_rd_base + rand_range(0, region_words - cmd.burstcount);
+      cmd.read = true;
+    }
+  }
+
+  bool idle() const { return !cmd.read && m_expected.empty(); }
+  uint64_t beats() const { return m_beats; }
+
+private:
+  std::deque<uint64_t> m_expected;
+  uint64_t m_beats = 0;
+};
+
+// H2F host transfer writing local memory, keeps what it wrote in m_shadow
+class host_writer {
+public:
+  avmm_cmd cmd;
+
+  explicit host_writer(const std::vector<uint64_t> &words)
+      : m_shadow(words.begin() + host_wr_base, words.begin() + host_wr_base + region_words) {}
+
+  void clock(const avmm_rsp &rsp, bool traffic) {
+    if (cmd.write && !rsp.waitrequest) {
+      m_shadow[cmd.address - host_wr_base + m_beat] = cmd.writedata;
+      m_beats++;
+      if (++m_beat == cmd.burstcount) {
+        cmd.write = false;
+        m_beat = 0;
+      } else {
+        cmd.writedata = next_data();
+      }
+    }
+    if (!cmd.write && traffic && chance(90)) {
+      cmd.burstcount = rand_range(1, burstcount_max);
+      cmd.address = host_wr_base + rand_range(0, region_words - cmd.burstcount);
+      cmd.writedata = next_data();
+      cmd.write = true;
+    }
+  }
+
+  bool idle() const { return !cmd.write; }
+  uint64_t beats() const { return m_beats; }
+
+  bool matches(const std::vector<uint64_t> &words) const {
+    return std::equal(m_shadow.begin(), m_shadow.end(), words.begin() + host_wr_base);
+  }
+
+private:
+  uint64_t next_data() { return (1ULL << 63) | m_seq++; }
+
+  std::vector<uint64_t> m_shadow;
+  unsigned m_beat = 0;
+  uint64_t m_seq = 0;
+  uint64_t m_beats = 0;
+};
+
+/** The device-to-device copy block, dma_data_transfer between two local
+ *  memory ports. Reads run ahead of the writes as far as the data buffer
+ *  allows, and the reads of the next descriptor start as soon as those of
+ *  the current one are issued, before its writes are done.
+ */
+class copy_block {
+public:
+  avmm_cmd rd_cmd, wr_cmd;
+
+  void submit(uint64_t src, uint64_t dst, uint64_t len) {
+    m_rd_queue.push_back(descriptor{src, dst, len});
+    m_wr_queue.push_back(descriptor{src, dst, len});
+  }
+
+  void clock(const avmm_rsp &rd_rsp, const avmm_rsp &wr_rsp) {
+    // Read side
+    if (rd_rsp.readdatavalid) {
+      expect(m_outstanding > 0, "copy read data nobody asked for");
+      m_outstanding--;
+      m_buffer.push_back(rd_rsp.readdata);
+    }
+    if (rd_cmd.read && !rd_rsp.waitrequest) {
+      rd_cmd.read = false;
+      m_rd_issued += rd_cmd.burstcount;
+      if (m_rd_issued == m_rd_queue.front().len) {
+        m_rd_queue.pop_front();
+        m_rd_issued = 0;
+      }
+    }
+    if (!rd_cmd.read && !m_rd_queue.empty() &&
+        m_outstanding + m_buffer.size() + burstcount_max <= copy_buffer_words) {
+      const descriptor &d = m_rd_queue.front();
+      rd_cmd.burstcount = static_cast<unsigned>(std::min<uint64_t>(burstcount_max, d.len - m_rd_issued));
+      rd_cmd.address = d.src + m_rd_issued;
+      rd_cmd.read = true;
+      m_outstanding += rd_cmd.burstcount;
+    }
+
+    // Write side, a burst only starts once all of its data is buffered
+    if (wr_cmd.write && !wr_rsp.waitrequest) {
+      m_buffer.pop_front();
+      if (++m_wr_beat == wr_cmd.burstcount) {
+        wr_cmd.write = false;
+        m_wr_beat = 0;
+        m_wr_done += wr_cmd.burstcount;
+        if (m_wr_done == m_wr_queue.front().len) {
+          m_wr_queue.pop_front();
+          m_wr_done = 0;
+        }
+      } else {
+        wr_cmd.writedata = m_buffer.front();
+      }
+    }
+    if (!wr_cmd.write && !m_wr_queue.empty()) {
+      const descriptor &d = m_wr_queue.front();
+      unsigned len = static_cast<unsigned>(std::min<uint64_t>(burstcount_max, d.len - m_wr_done));
+      if (m_buffer.size() >= len) {
+        wr_cmd.burstcount = len;
+        wr_cmd.address = d.dst + m_wr_done;
+        wr_cmd.writedata = m_buffer.front();
+        wr_cmd.write = true;
+      }
+    }
+  }
+
+  bool idle() const { return m_wr_queue.empty(); }
+
+private:
+  struct descriptor {
+    uint64_t src, dst, len;
+  };
+
+  std::deque<descriptor> m_rd_queue;
+  std::deque<descriptor> m_wr_queue;
+  uint64_t m_rd_issued = 0;
+  uint64_t m_outstanding = 0;
+  std::deque<uint64_t> m_buffer;
+  uint64_t m_wr_done = 0;
+  unsigned m_wr_beat = 0;
+};
+
+// The split of mmd_dma::device_copy()
+static unsigned submit_copy(copy_block &copy, uint64_t src, uint64_t dst, uint64_t size) {
+  const bool overlap = src < dst + size && dst < src + size;
+  const bool backwards = overlap && dst > src;
+  const uint64_t piece_len = overlap ? (backwards ? dst - src : src - dst) : size;
+  unsigned pieces = 0;
+  for (uint64_t done = 0; done < size; pieces++) {
+    uint64_t len = std::min<uint64_t>(piece_len, size - done);
+    uint64_t offset = backwards ? size - done - len : done;
+    copy.submit(src + offset, dst + offset, len);
+    done += len;
+  }
+  return pieces;
+}
+
+int main(int argc, char **argv) {
+  uint64_t copies = argc > 1 ? strtoull(argv[1], NULL, 0) : 500;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 0) : 1;
+  rng.seed(seed);
+
+  std::vector<uint64_t> words(mem_words);
+  for (uint64_t i = 0; i < mem_words; i++) {
+    words[i] = i;
+  }
+  std::vector<uint64_t> copy_shadow(words.begin() + copy_base, words.end());
+
+  mem_port rd_port(words), wr_port(words);
+  local_mem_arb rd_arb, wr_arb;
+  host_reader f2h;
+  host_writer h2f(words);
+  copy_block copy;
+
+  auto step = [&](bool traffic) {
+    rd_port.comb();
+    wr_port.comb();
+    rd_arb.comb(f2h.cmd, copy.rd_cmd, rd_port.rsp);
+    wr_arb.comb(h2f.cmd, copy.wr_cmd, wr_port.rsp);
+    rd_port.clock(rd_arb.out, rd_arb.grant());
+    wr_port.clock(wr_arb.out, wr_arb.grant());
+    f2h.clock(rd_arb.rsp0, traffic);
+    h2f.clock(wr_arb.rsp0, traffic);
+    copy.clock(rd_arb.rsp1, wr_arb.rsp1);
+    rd_arb.clock();
+    wr_arb.clock();
+    cycle++;
+  };
+
+  uint64_t pieces = 0;
+  for (uint64_t n = 0; n < copies; n++) {
+    uint64_t size = rand_range(1, 1024);
+    uint64_t src = rand_range(0, region_words - size);
+    uint64_t dst;
+    if (chance(50)) {
+      // Overlapping, by anything from one word to all but one
+      uint64_t lo = src >= size - 1 ? src - (size - 1) : 0;
+      uint64_t hi = std::min(src + size - 1, region_words - size);
+      dst = rand_range(lo, hi);
+    } else {
+      dst = rand_range(0, region_words - size);
+    }
+    if (src == dst) {
+      // device_copy() returns right away
+      continue;
+    }
+
+    pieces += submit_copy(copy, copy_base + src, copy_base + dst, size);
+    memmove(&copy_shadow[dst], &copy_shadow[src], size * sizeof(uint64_t));
+    uint64_t start = cycle;
+    while (!copy.idle()) {
+      step(true);
+      expect(cycle - start < max_copy_cycles, "copy did not finish");
+    }
+    expect(std::equal(copy_shadow.begin(), copy_shadow.end(), words.begin() + copy_base),
+           "copy region differs from memmove()");
+  }
+
+  // Drain the host traffic
+  uint64_t start = cycle;
+  while (!f2h.idle() || !h2f.idle()) {
+    step(false);
+    expect(cycle - start < max_copy_cycles, "host traffic did not drain");
+  }
+  expect(h2f.matches(words), "host write region differs from what was written");
+
+  printf("%" PRIu64 " copies in %" PRIu64 " descriptors, %" PRIu64 " cycles\n", copies, pieces,
+         cycle);
+  printf("host read beats %" PRIu64 " , host write beats %" PRIu64 "\n", f2h.beats(), h2f.beats());
+  printf("longest wait for a port %" PRIu64 " cycles , response FIFO almost full %" PRIu64
+         " cycles\n",
+         std::max(rd_arb.max_wait(), wr_arb.max_wait()), rd_arb.almost_full_cycles());
+  printf("PASSED\n");
+  return 0;
+}